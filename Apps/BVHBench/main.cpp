@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <Engine/BVH.h>
+#include <Engine/Bounds.h>
+
+/// Console benchmark for the scene BVH: build, incremental update, full refit,
+/// frustum queries against the flat sphere culling loop, and ray casts, over
+/// a field of randomly placed objects. Pass the object count as the first
+/// argument, defaults to 100k.
+
+using Engine::AABB;
+using Engine::BVH;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Median wall time of \p runs calls to \p fn in milliseconds.
+template <typename F> double timeMs(int runs, F &&fn) {
+  std::vector<double> times;
+  for (int i = 0; i < runs; i++) {
+    auto start = Clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+AABB sphereBox(const Engine::BoundingSphere &s) {
+  return AABB{s.centre - vec3(s.radius), s.centre + vec3(s.radius)};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  const float worldSize = 1000.0f;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-worldSize, worldSize);
+  std::uniform_real_distribution<float> radius(0.5f, 4.0f);
+  std::uniform_real_distribution<float> jitter(-5.0f, 5.0f);
+
+  std::vector<Engine::BoundingSphere> spheres(count);
+  std::vector<AABB> boxes(count);
+  for (int i = 0; i < count; i++) {
+    spheres[i] = {vec3(position(rng), position(rng), position(rng)),
+                  radius(rng)};
+    boxes[i] = sphereBox(spheres[i]);
+  }
+  printf("BVH benchmark, %d objects\n", count);
+
+  BVH bvh;
+  double buildMs = timeMs(5, [&] { bvh.build(boxes); });
+  printf("  build:              %8.3f ms (%zu nodes)\n", buildMs,
+         bvh.nodes().size());
+
+  // Move 1% of the objects and refit just their ancestors.
+  std::vector<uint32_t> moved(count / 100);
+  for (auto &item : moved)
+    item = rng() % count;
+  double updateMs = timeMs(5, [&] {
+    for (auto item : moved) {
+      spheres[item].centre += vec3(jitter(rng), jitter(rng), jitter(rng));
+      bvh.update(item, sphereBox(spheres[item]));
+    }
+  });
+  printf("  update 1%%:          %8.3f ms\n", updateMs);
+
+  // Move everything and refit the whole tree.
+  double refitMs = timeMs(5, [&] {
+    for (int i = 0; i < count; i++) {
+      spheres[i].centre += vec3(jitter(rng), jitter(rng), jitter(rng));
+      bvh.setItemBounds(i, sphereBox(spheres[i]));
+    }
+    bvh.refit();
+  });
+  printf("  move all + refit:   %8.3f ms\n", refitMs);
+  bvh.build(boxes);
+  for (int i = 0; i < count; i++)
+    spheres[i].centre = boxes[i].centre();
+
+  // A camera inside the field looking along a few directions, so a small
+  // part of the scene is visible like in a large level.
+  mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f,
+                               worldSize);
+  std::vector<Engine::Frustum> frusta;
+  for (int i = 0; i < 16; i++) {
+    float angle = glm::radians(360.0f * i / 16.0f);
+    vec3 dir{std::cos(angle), 0.2f, std::sin(angle)};
+    frusta.push_back(Engine::Frustum::fromMatrix(
+        proj * glm::lookAt(vec3(0.0f), dir, vec3(0, 1, 0)), true));
+  }
+
+  Engine::SphereBatch batch;
+  batch.reserve(count);
+  for (const auto &s : spheres)
+    batch.push_back(s);
+  std::vector<uint8_t> visible;
+  size_t flatVisible = 0;
+  double flatMs = timeMs(5, [&] {
+    flatVisible = 0;
+    for (const auto &f : frusta)
+      flatVisible += Engine::cullSpheres(f, batch, visible);
+  }) / frusta.size();
+
+  std::vector<uint32_t> inside, partial;
+  Engine::SphereBatch partialBatch;
+  size_t bvhVisible = 0;
+  double queryMs = timeMs(5, [&] {
+    bvhVisible = 0;
+    for (const auto &f : frusta) {
+      inside.clear();
+      partial.clear();
+      bvh.queryFrustum(f, inside, partial);
+      partialBatch.clear();
+      for (auto item : partial)
+        partialBatch.push_back(spheres[item]);
+      bvhVisible += inside.size() + Engine::cullSpheres(f, partialBatch,
+                                                        visible);
+    }
+  }) / frusta.size();
+  printf("  frustum, flat:      %8.3f ms (%zu visible)\n", flatMs,
+         flatVisible / frusta.size());
+  printf("  frustum, BVH:       %8.3f ms (%zu visible)\n", queryMs,
+         bvhVisible / frusta.size());
+
+  // Random rays from the origin, hit tested against the bounding spheres.
+  const int numRays = 10000;
+  std::vector<vec3> dirs(numRays);
+  for (auto &dir : dirs)
+    dir = glm::normalize(vec3(jitter(rng), jitter(rng), jitter(rng)));
+  int hits = 0;
+  double rayMs = timeMs(5, [&] {
+    hits = 0;
+    for (const auto &dir : dirs) {
+      float t = std::numeric_limits<float>::infinity();
+      uint32_t item;
+      hits += bvh.raycast(vec3(0.0f), dir, t, item);
+    }
+  });
+  printf("  %d raycasts:     %8.3f ms (%d hits)\n", numRays, rayMs, hits);
+  return 0;
+}
@@ -20,9 +20,8 @@ public:
     auto &renderer = getRenderer();
 
     // ----------- Author Shaders -------------
-    auto basic_lighting_cb = [this](Engine::Shader &shader) {
-        shader.setMatrix("view", getViewMatrix());
-        shader.setMatrix("proj", getProjMatrix());
+    // Camera matrices come from the renderer's per-frame uniform block.
+    auto basic_lighting_cb = [](Engine::Shader &shader) {
         shader.setVec3("lightColour", vec3(0.8f));
     };
 
@@ -33,6 +32,10 @@ public:
       basic_lighting_cb
     });
 
+    // Resolve per-object uniforms once so the draw callbacks skip the lookup.
+    auto model_uniform =
+        renderer.getShader(shader_id).getUniformHandle("model");
+
     // -------------- Create Renderables -----------------
     auto default_mat = Engine::Material{};
     auto sphere = renderer.createRenderable<Engine::Sphere>(
@@ -40,8 +43,9 @@ public:
       shader_id,
       vec3(0, 0, 0), 1.0f, 3);
  
-    auto cb = [this](Engine::Shader &shader, const Engine::Sphere &m) {
-          shader.setMatrix("model", mWorldTransform * m.getModelMat());
+    auto cb = [this, model_uniform](Engine::Shader &shader,
+                                    const Engine::Sphere &m) {
+          shader.setMatrix(model_uniform, mWorldTransform * m.getModelMat());
         };
     sphere->bindCallback(cb);
 
@@ -52,11 +56,13 @@ public:
       30, 30, 30
     );
 
-    auto bcb = [this](Engine::Shader &shader, const Engine::Box &m) {
-          shader.setMatrix("model", m.getModelMat());
+    auto bcb = [model_uniform](Engine::Shader &shader, const Engine::Box &m) {
+          shader.setMatrix(model_uniform, m.getModelMat());
         };
     box->mesh().flipNormals();
     box->bindCallback(bcb);
+    // The room stays put while the world turns.
+    box->setUsesWorldTransform(false);
 
     // -------------- Setup Callbacks -----------------
     using std::placeholders::_1;
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Engine/Application.h>
+#include <Engine/Gadgets.h>
+#include <Engine/Log.h>
+#include <Engine/ProgramCache.h>
+#include <Engine/Renderer.h>
+#include <Engine/Sphere.h>
+
+/// Renders a fixed script of scenes offscreen with vsync off and writes the
+/// per-frame CPU and GPU timings as JSON, for tracking performance
+/// regressions. Every scene gets some warmup frames that are not recorded.
+///
+///   Bench [--windowed] [--osmesa] [--warmup N] [--scene-frames N]
+///         [--out file.json]
+///
+/// Without --out the report goes to stdout.
+class Bench : public Engine::Application {
+public:
+  struct Settings {
+    int warmup = 30;
+    int frames = 300;
+    std::string out;
+  };
+
+  Bench(const Options &options, const Settings &settings)
+      : Engine::Application(1280, 720, options), mSettings(settings) {
+    auto &renderer = getRenderer();
+    mShader = renderer.createShader({
+      "cell_shaded.vs", // vertex shader
+      "cell_shaded.fs", // fragment shader
+      "", // no geometry shader
+      [](Engine::Shader &shader) {
+        shader.setVec3("lightColour", vec3(0.8f));
+      }
+    });
+    mInstancedShader = renderer.createShader({
+      "instanced.vs", // vertex shader
+      "instanced.fs", // fragment shader
+      "", // no geometry shader
+      [this](Engine::Shader &shader) {
+        shader.setMatrix("world", mWorldTransform);
+      }
+    });
+    // The same lighting built both ways: with its feature switches as
+    // uniforms, and with them compiled out.
+    mSpecializedShader = renderer.createShader({
+      "default_shadows.vs", // vertex shader
+      "default_shadows.fs", // fragment shader
+      "", // no geometry shader
+      [](Engine::Shader &shader) {
+        shader.setMatrix("lightModel", mat4(1.0f));
+        shader.setVec3("lightPos", vec3(0, 40, 40));
+        shader.setVec3("mat.diffuse", vec3(0.6f, 0.4f, 0.3f));
+        shader.setFloat("mat.sheen", 32.0f);
+        shader.setFloat("far_plane", 100.0f);
+        // Keep the samplers off the same unit, they differ in type.
+        shader.setInt("depthMap", 1);
+        shader.setBool("hasTexture", false);
+        shader.setBool("shadows", false);
+      }
+    });
+    mUberShader =
+        renderer.createShaderVariant(mSpecializedShader, {"UBER_SHADER"});
+    // Measure startup with every program built, and keep frames that skip
+    // unbuilt shaders out of the results.
+    renderer.finishShaders();
+
+    mScale = 60.0f;
+    mWorldTranslation = glm::translate(
+        mat4(1.0f), mScale * -glm::normalize(mCamera->getPos()));
+    mWorldTransform = mWorldTranslation * mWorldRotation;
+
+    // The context is gone by the time the report is written.
+    auto glString = [](GLenum name) {
+      auto *str = reinterpret_cast<const char *>(glGetString(name));
+      return std::string(str ? str : "");
+    };
+    mGLRenderer = glString(GL_RENDERER);
+    mGLVersion = glString(GL_VERSION);
+
+    mScenes = {
+      {"instanced_spheres", [this] { buildInstancedSpheres(10000); }},
+      {"renderable_spheres",
+       [this] { buildRenderableSpheres(2000, mShader); }},
+      {"streamed_line", [this] { buildLine(); }},
+      {"uber_shader",
+       [this] { buildRenderableSpheres(2000, mUberShader); }},
+      {"specialized_shader",
+       [this] { buildRenderableSpheres(2000, mSpecializedShader); }},
+      // Detailed spheres spread out far enough for distant ones to drop
+      // levels of detail, and the same without.
+      {"lod_spheres",
+       [this] { buildRenderableSpheres(1000, mShader, 5, 4.0f); }},
+      {"lod_spheres_off",
+       [this] {
+         getRenderer().setLodEnabled(false);
+         buildRenderableSpheres(1000, mShader, 5, 4.0f);
+       }},
+      // The same as 16 byte CompactVertexData.
+      {"compact_spheres", [this] { buildCompactSpheres(1000, 5, 4.0f); }},
+    };
+
+    Engine::GpuProfiler::getInstance().setFrameCallback(
+        [this](const Engine::GpuProfiler::Frame &frame) {
+      mGpuTimes[frame.index] = frame.durationMs;
+    });
+  }
+
+  void tick(float currentTime) override {
+    auto now = Clock::now();
+    recordLastFrame(now);
+    mLastTick = now;
+
+    if (mFrameInScene == 0) {
+      if (mScene == mScenes.size()) {
+        setShouldCloseWindow();
+        return;
+      }
+      clearScene();
+      mScenes[mScene].build();
+    }
+
+    // Scripted camera: a full orbit over the recorded frames, the same on
+    // every run.
+    float angle = 360.0f * mFrameInScene / float(mSettings.frames);
+    mWorldRotation =
+        glm::rotate(mat4(1.0f), glm::radians(angle), vec3(0, 1, 0));
+    mWorldTransform = mWorldTranslation * mWorldRotation;
+    if (mLine)
+      updateLine();
+  }
+
+  /// Time from launch until the app was ready to render.
+  inline void setStartupMs(float ms) { mStartupMs = ms; }
+
+  /// Write the JSON report, call once run() has returned.
+  bool writeReport() const {
+    FILE *file = mSettings.out.empty() ? stdout
+                                       : fopen(mSettings.out.c_str(), "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", mSettings.out.c_str());
+      return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": \"%s\",\n", mGLRenderer.c_str());
+    fprintf(file, "  \"version\": \"%s\",\n", mGLVersion.c_str());
+    fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n",
+            getFramebufferWidth(), getFramebufferHeight());
+    fprintf(file, "  \"headless\": %s,\n", isHeadless() ? "true" : "false");
+    // Run twice to compare a cold shader cache with a warm one.
+    const auto &programs = Engine::ProgramCache::getInstance().getStats();
+    fprintf(file,
+            "  \"startup\": {\"total_ms\": %.3f, \"programs_cached\": %u, "
+            "\"cache_load_ms\": %.3f, \"programs_compiled\": %u, "
+            "\"compile_ms\": %.3f, \"programs_rejected\": %u},\n",
+            mStartupMs, programs.hits, programs.loadMs, programs.misses,
+            programs.compileMs, programs.rejected);
+    fprintf(file, "  \"scenes\": [\n");
+    for (size_t s = 0; s < mScenes.size(); s++) {
+      std::vector<float> cpu, gpu, frame;
+      fprintf(file, "    {\n      \"name\": \"%s\",\n      \"frames\": [\n",
+              mScenes[s].name);
+      bool first = true;
+      for (const auto &record : mRecords) {
+        if (record.scene != s)
+          continue;
+        auto iter = mGpuTimes.find(record.frame);
+        float gpuMs = iter == mGpuTimes.end() ? -1.0f : iter->second;
+        fprintf(file,
+                "%s        {\"cpu_ms\": %.4f, \"gpu_ms\": %.4f, "
+                "\"frame_ms\": %.4f, \"draw_calls\": %u, \"visible\": %u, "
+                "\"triangles\": %zu}",
+                first ? "" : ",\n", record.cpuMs, gpuMs, record.frameMs,
+                record.drawCalls, record.visible, record.triangles);
+        first = false;
+        cpu.push_back(record.cpuMs);
+        frame.push_back(record.frameMs);
+        if (gpuMs >= 0.0f)
+          gpu.push_back(gpuMs);
+      }
+      fprintf(file, "\n      ],\n      \"summary\": {");
+      writeSummary(file, "cpu_ms", cpu);
+      fprintf(file, ", ");
+      writeSummary(file, "gpu_ms", gpu);
+      fprintf(file, ", ");
+      writeSummary(file, "frame_ms", frame);
+      fprintf(file, "}\n    }%s\n", s + 1 < mScenes.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout)
+      fclose(file);
+    return true;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Scene {
+    const char *name;
+    std::function<void()> build;
+  };
+
+  struct FrameRecord {
+    size_t scene;
+    uint64_t frame;
+    float cpuMs;
+    float frameMs;
+    uint drawCalls;
+    uint visible;
+    size_t triangles;
+  };
+
+  static void writeSummary(FILE *file, const char *name,
+                           std::vector<float> values) {
+    if (values.empty()) {
+      fprintf(file, "\"%s\": null", name);
+      return;
+    }
+    std::sort(values.begin(), values.end());
+    float mean = 0.0f;
+    for (auto v : values)
+      mean += v;
+    mean /= values.size();
+    fprintf(file,
+            "\"%s\": {\"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, "
+            "\"max\": %.4f}",
+            name, mean, values[values.size() / 2],
+            values[std::min(values.size() - 1, values.size() * 95 / 100)],
+            values.back());
+  }
+
+  /// The renderer's stats now describe the frame rendered after the
+  /// previous tick.
+  void recordLastFrame(Clock::time_point now) {
+    auto frameIndex = Engine::GpuProfiler::getInstance().getFrameIndex();
+    if (mScene == mScenes.size() || frameIndex == 0)
+      return;
+    if (mFrameInScene >= mSettings.warmup) {
+      const auto &stats = getRenderer().getStats();
+      std::chrono::duration<float, std::milli> frameMs = now - mLastTick;
+      mRecords.push_back(FrameRecord{mScene, frameIndex - 1, stats.cpuTimeMs,
+                                     frameMs.count(), stats.drawCalls,
+                                     stats.visible, stats.triangles});
+    }
+    if (++mFrameInScene == mSettings.warmup + mSettings.frames) {
+      mFrameInScene = 0;
+      mScene++;
+    }
+  }
+
+  void clearScene() {
+    auto &renderer = getRenderer();
+    renderer.clearRenderGroup(mShader);
+    renderer.clearRenderGroup(mInstancedShader);
+    renderer.clearRenderGroup(mUberShader);
+    renderer.clearRenderGroup(mSpecializedShader);
+    if (mLine)
+      renderer.clearRenderGroup(mLine->shaderID());
+    mLine = nullptr;
+    renderer.setLodEnabled(true);
+  }
+
+  vec3 gridPosition(int i, int count, float spacing) const {
+    int side = int(std::ceil(std::cbrt(float(count))));
+    vec3 origin = -0.5f * spacing * vec3(float(side - 1));
+    return origin + spacing * vec3(i % side, (i / side) % side,
+                                   i / (side * side));
+  }
+
+  void buildInstancedSpheres(int count) {
+    auto *spheres = getRenderer().createInstancedRenderable<Engine::Sphere>(
+        Engine::Material{}, mInstancedShader, vec3(0), 0.5f, 1);
+    std::vector<Engine::InstanceData> instances(count);
+    for (int i = 0; i < count; i++) {
+      auto pos = gridPosition(i, count, 1.5f);
+      instances[i].model = glm::translate(mat4(1.0f), pos);
+      instances[i].colour = vec4(0.5f + 0.5f * glm::normalize(pos), 1.0f);
+    }
+    spheres->addInstances(instances);
+  }
+
+  void buildRenderableSpheres(int count, int shaderID, uint8_t level = 1,
+                              float spacing = 1.5f) {
+    auto model_uniform =
+        getRenderer().getShader(shaderID).getUniformHandle("model");
+    for (int i = 0; i < count; i++) {
+      auto sphere = getRenderer().createRenderable<Engine::Sphere>(
+          Engine::Material{}, shaderID, gridPosition(i, count, spacing),
+          0.5f, level);
+      sphere->bindCallback([this, model_uniform](Engine::Shader &shader,
+                                                 const Engine::Sphere &m) {
+        shader.setMatrix(model_uniform, mWorldTransform * m.getModelMat());
+      });
+    }
+  }
+
+  void buildCompactSpheres(int count, uint8_t level, float spacing) {
+    auto &renderer = getRenderer();
+    Engine::StandardMesh unit("UnitSphere", GL_TRIANGLES,
+                              Engine::Sphere::unitSphere(level));
+    Engine::CompactMesh compact("CompactSphere", GL_TRIANGLES);
+    Engine::compactMesh(unit, compact);
+    compact.finalize();
+    auto model_uniform =
+        renderer.getShader(mShader).getUniformHandle("model");
+    for (int i = 0; i < count; i++) {
+      auto sphere = renderer.createRenderable<Engine::CompactMesh>(
+          Engine::Material{}, mShader, "CompactSphere", GL_TRIANGLES,
+          compact.storage());
+      auto &mesh = sphere->mesh();
+      mesh.translate(gridPosition(i, count, spacing));
+      mesh.setScale(vec3(0.5f));
+      sphere->bindCallback([this, model_uniform](Engine::Shader &shader,
+                                                 const Engine::CompactMesh &m) {
+        shader.setMatrix(model_uniform, mWorldTransform * m.getModelMat());
+      });
+    }
+  }
+
+  void buildLine() {
+    using Engine::Gadgets::Line;
+    auto &renderer = getRenderer();
+    auto line = std::make_unique<Line>(renderer, [](Engine::Shader &shader) {
+      shader.setFloat("thickness", 0.01f);
+      shader.setVec3("color", vec3{1, 1, 1});
+    });
+    auto id = line->shaderID();
+    renderer.finishShaders();
+    mLine = dynamic_cast<Line *>(
+        renderer.addRenderable<Line::Mesh>(id, std::move(line)));
+    auto model_uniform = renderer.getShader(id).getUniformHandle("model");
+    mLine->bindCallback([this, model_uniform](Engine::Shader &shader,
+                                              const Line::Mesh &m) {
+      shader.setMatrix(model_uniform, mWorldTransform * m.getModelMat());
+    });
+  }
+
+  /// A 100k point wave that changes every frame.
+  void updateLine() {
+    const int points = 100000;
+    float phase = 0.1f * mFrameInScene;
+    mLine->startLine();
+    for (int i = 0; i < points; i++) {
+      float x = -20.0f + 40.0f * i / float(points - 1);
+      mLine->addPoint(vec3{x, 5.0f * std::sin(x + phase), 0});
+    }
+    mLine->endLine();
+  }
+
+  Settings mSettings;
+  float mStartupMs = 0.0f;
+  std::string mGLRenderer, mGLVersion;
+  int mShader = -1;
+  int mInstancedShader = -1;
+  int mUberShader = -1;
+  int mSpecializedShader = -1;
+  Engine::Gadgets::Line *mLine = nullptr;
+
+  std::vector<Scene> mScenes;
+  size_t mScene = 0;
+  int mFrameInScene = 0;
+  Clock::time_point mLastTick;
+  std::vector<FrameRecord> mRecords;
+  std::unordered_map<uint64_t, float> mGpuTimes;
+};
+
+int main(int argc, char **argv) {
+  auto launch = std::chrono::steady_clock::now();
+  auto options = Engine::Application::parseOptions(argc, argv);
+  options.headless = true;
+  options.vsync = false;
+  options.frames = 0;
+
+  Bench::Settings settings;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--windowed") == 0) {
+      options.headless = options.osmesa;
+    } else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      settings.warmup = std::max(0, atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--scene-frames") == 0 && i + 1 < argc) {
+      settings.frames = std::max(1, atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      settings.out = argv[++i];
+    }
+  }
+
+  Bench app(options, settings);
+  std::chrono::duration<float, std::milli> startup =
+      std::chrono::steady_clock::now() - launch;
+  app.setStartupMs(startup.count());
+  app.run();
+  return app.writeReport() ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+#include <Engine/Application.h>
+#include <Engine/Log.h>
+#include <Engine/Renderer.h>
+#include <Engine/Sphere.h>
+
+/// Draws a grid of identical spheres either as one InstancedRenderable or as
+/// one Renderable per sphere, and reports draw calls and CPU submission time
+/// for both so the two paths can be compared.
+class Example : public Engine::Application {
+public:
+  Example(int argc, char **argv) : Engine::Application(1800, 1000, argc, argv) {
+    auto &renderer = getRenderer();
+
+    // ----------- Author Shaders -------------
+    mShader = renderer.createShader({
+      "cell_shaded.vs", // vertex shader
+      "cell_shaded.fs", // fragment shader
+      "", // no geometry shader
+      [](Engine::Shader &shader) {
+        shader.setVec3("lightColour", vec3(0.8f));
+      }
+    });
+
+    mInstancedShader = renderer.createShader({
+      "instanced.vs", // vertex shader
+      "instanced.fs", // fragment shader
+      "", // no geometry shader
+      [this](Engine::Shader &shader) {
+        shader.setMatrix("world", mWorldTransform);
+      }
+    });
+
+    mModelUniform = renderer.getShader(mShader).getUniformHandle("model");
+
+    mScale = 120.0f;
+    mWorldTranslation = glm::translate(
+        mat4(1.0f), mScale * -glm::normalize(mCamera->getPos()));
+    mWorldTransform = mWorldTranslation * mWorldRotation;
+
+    buildScene();
+
+    // -------------- Setup Callbacks -----------------
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::mem_fn;
+    using std::bind;
+    std::function<void(int, int)> key_cb = bind(mem_fn(&Example::keyCB), this, _1, _2);
+    mInputHandler->addKeyCallback(key_cb);
+    mInputHandler->setMouseCallback([this](double x, double y) {
+      mMouseX = x;
+      mMouseY = y;
+    });
+    std::function<void(int, int)> button_cb = bind(mem_fn(&Example::mouseButtonCB), this, _1, _2);
+    mInputHandler->setMouseButtonCallback(button_cb);
+
+    std::function<void(bool *)> stats_draw = bind(mem_fn(&Example::drawStats), this, _1);
+    mUIManager.registerWidget("Instancing Stats", stats_draw);
+  }
+
+  void tick(float currentTime) override {
+    // Exponential moving averages so the overlay is readable.
+    const auto &stats = getRenderer().getStats();
+    float frameMs = (currentTime - mLastTime) * 1000.0f;
+    mLastTime = currentTime;
+    mAvgCpuMs = 0.95f * mAvgCpuMs + 0.05f * stats.cpuTimeMs;
+    mAvgFrameMs = 0.95f * mAvgFrameMs + 0.05f * frameMs;
+  }
+
+private:
+  void buildScene() {
+    auto &renderer = getRenderer();
+    if (mAvgCpuMs > 0.0f) {
+      LOG_INFO("%s, %d spheres: %u draw calls, %.3f ms CPU submit, %.3f ms "
+               "frame",
+               mInstanced ? "Instanced" : "Per renderable", mCount,
+               renderer.getStats().drawCalls, mAvgCpuMs, mAvgFrameMs);
+    }
+    renderer.clearRenderGroup(mShader);
+    renderer.clearRenderGroup(mInstancedShader);
+    mPicked = nullptr;
+    mAvgCpuMs = mAvgFrameMs = 0.0f;
+
+    // Lay the spheres out in a cube centred on the origin.
+    int side = int(std::ceil(std::cbrt(float(mCount))));
+    float spacing = 3.0f * mRadius;
+    vec3 origin = -0.5f * spacing * vec3(float(side - 1));
+    auto position = [&](int i) {
+      return origin + spacing * vec3(i % side, (i / side) % side,
+                                     i / (side * side));
+    };
+
+    auto default_mat = Engine::Material{};
+    if (mInstanced) {
+      auto *spheres = renderer.createInstancedRenderable<Engine::Sphere>(
+          default_mat, mInstancedShader, vec3(0), mRadius, mIterations);
+      std::vector<Engine::InstanceData> instances(mCount);
+      for (int i = 0; i < mCount; i++) {
+        auto pos = position(i);
+        instances[i].model = glm::translate(mat4(1.0f), pos);
+        instances[i].colour = vec4(0.5f + 0.5f * glm::normalize(pos), 1.0f);
+      }
+      spheres->addInstances(instances);
+    } else {
+      auto model_uniform = mModelUniform;
+      for (int i = 0; i < mCount; i++) {
+        auto sphere = renderer.createRenderable<Engine::Sphere>(
+            default_mat, mShader, position(i), mRadius, mIterations);
+        sphere->bindCallback([this, model_uniform](Engine::Shader &shader,
+                                                   const Engine::Sphere &m) {
+          shader.setMatrix(model_uniform, mWorldTransform * m.getModelMat());
+        });
+      }
+    }
+    LOG_INFO("Built %s scene with %d spheres.",
+             mInstanced ? "instanced" : "per renderable", mCount);
+  }
+
+  /// Right click picks the sphere under the cursor through the renderer's BVH.
+  void mouseButtonCB(int button, int action) {
+    if (button != GLFW_MOUSE_BUTTON_RIGHT || action != GLFW_PRESS)
+      return;
+    mPicked = getRenderer().pick(*this, mMouseX, mMouseY);
+    if (mPicked) {
+      auto pos = mPicked->bounds().centre;
+      LOG_INFO("Picked renderable at (%.2f, %.2f, %.2f).", pos.x, pos.y,
+               pos.z);
+    }
+  }
+
+  void keyCB(int key, int action) {
+    if (action != GLFW_PRESS)
+      return;
+    switch (key) {
+    case GLFW_KEY_I:
+      mInstanced = !mInstanced;
+      buildScene();
+      break;
+    case GLFW_KEY_1:
+      mCount = 10000;
+      buildScene();
+      break;
+    case GLFW_KEY_2:
+      mCount = 100000;
+      buildScene();
+      break;
+    case GLFW_KEY_C:
+      getRenderer().setCullingEnabled(!getRenderer().isCullingEnabled());
+      break;
+    case GLFW_KEY_Q:
+      setShouldCloseWindow();
+      break;
+    }
+  }
+
+  void drawStats(bool *p_open) {
+    if (ImGui::Begin("Instancing Stats", p_open)) {
+      ImGui::Text("Mode: %s", mInstanced ? "Instanced" : "Per renderable");
+      ImGui::Text("Spheres: %d", mCount);
+      const auto &stats = getRenderer().getStats();
+      ImGui::Text("Draw calls: %u", stats.drawCalls);
+      ImGui::Text("State changes: %u issued, %u elided",
+                  stats.stateChangesIssued, stats.stateChangesElided);
+      ImGui::Text("Culling %s: %u visible, %u culled",
+                  getRenderer().isCullingEnabled() ? "on" : "off",
+                  stats.visible, stats.culled);
+      if (mPicked) {
+        auto pos = mPicked->bounds().centre;
+        ImGui::Text("Picked: (%.2f, %.2f, %.2f)", pos.x, pos.y, pos.z);
+      } else {
+        ImGui::Text("Picked: none");
+      }
+      ImGui::Text("CPU submit: %.3f ms", mAvgCpuMs);
+      ImGui::Text("Frame: %.3f ms", mAvgFrameMs);
+      ImGui::Separator();
+      ImGui::Text("I - Toggle instancing");
+      ImGui::Text("1 - 10k spheres, 2 - 100k spheres");
+      ImGui::Text("C - Toggle frustum culling");
+      ImGui::Text("Right click - Pick");
+    }
+    ImGui::End();
+  }
+
+  int mShader = -1;
+  int mInstancedShader = -1;
+  Engine::Shader::UniformHandle mModelUniform;
+
+  bool mInstanced = true;
+  int mCount = 10000;
+  float mRadius = 0.5f;
+  uint8_t mIterations = 1;
+
+  double mMouseX = 0.0, mMouseY = 0.0;
+  Engine::RenderInterface *mPicked = nullptr;
+
+  float mLastTime = 0.0f;
+  float mAvgCpuMs = 0.0f;
+  float mAvgFrameMs = 0.0f;
+};
+
+int main(int argc, char **argv) {
+  Example app(argc, argv);
+  app.run();
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <map>
+#include <chrono>
 #include <cmath>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
@@ -28,18 +29,17 @@ public:
     // -------------- Create Renderables -----------------
     
     using Engine::Gadgets::Line;
-    auto shader_cb = [this](Engine::Shader &shader) {
-        shader.setMatrix("view", mOrthoCamera.getViewMatrix());
-        shader.setMatrix("proj", mOrthoCamera.getProjMatrix(*this));
+    auto shader_cb = [](Engine::Shader &shader) {
         shader.setFloat("thickness", 0.2f);
-        shader.setFloat("aspect", getFramebufferWidth()/getFramebufferHeight());
         shader.setVec3("color", vec3{1, 1, 1});
     };
     auto line_renderable = std::make_unique<Line>(getRenderer(), shader_cb);
+    line_renderable->setUsesWorldTransform(false);
     auto id = line_renderable->shaderID();
     mLine = dynamic_cast<Line*>(renderer.addRenderable<Line::Mesh>(id, std::move(line_renderable)));
-    auto cb = [this](Engine::Shader &shader, const Line::Mesh &m) {
-      shader.setMatrix("model", m.getModelMat());
+    auto model_uniform = renderer.getShader(id).getUniformHandle("model");
+    auto cb = [model_uniform](Engine::Shader &shader, const Line::Mesh &m) {
+      shader.setMatrix(model_uniform, m.getModelMat());
     };
     mLine->bindCallback(cb);
     
@@ -56,6 +56,9 @@ public:
     mInputHandler->addKeyCallback(key_cb);
     mInputHandler->setMouseButtonCallback(button_cb);
     mInputHandler->setMouseCallback(mouse_cb);
+
+    std::function<void(bool *)> stats_draw = bind(mem_fn(&Example::drawStats), this, _1);
+    mUIManager.registerWidget("Line Stats", stats_draw);
   }
 
   void tick(float deltaTime) override {
@@ -63,14 +66,31 @@ public:
     // slow down the rotation.
     float period = 4.0f;
     float time_passed = deltaTime - int(deltaTime/period) * period;
+    auto updateStart = std::chrono::steady_clock::now();
     mLine->startLine();
-    mLine->addPoint(vec3{0,25,0});
-    mLine->addPoint(vec3{25,0,0});
+    if (mBenchmark) {
+      // A wave of mBenchmarkPoints points across the screen, rewritten every
+      // frame to measure the cost of updating dynamic geometry.
+      float phase = 2.0f * PI * time_passed / period;
+      for (int i = 0; i < mBenchmarkPoints; i++) {
+        float x = -25.0f + 50.0f * i / float(mBenchmarkPoints - 1);
+        mLine->addPoint(vec3{x, 10.0f * std::sin(x + phase), 0});
+      }
+    } else {
+      mLine->addPoint(vec3{0,25,0});
+      mLine->addPoint(vec3{25,0,0});
+    }
     /*for(int i = 0; i < 100; i++) {
       double x = float(i)/100.0 * 14 * PI * (time_passed/period);
       mLine->addPoint(vec3{x, sin(x) + sin(x/2.0) + sin(x/1.6), 0});
     }*/
     mLine->endLine();
+    std::chrono::duration<float, std::milli> updateMs =
+        std::chrono::steady_clock::now() - updateStart;
+    float frameMs = (deltaTime - mLastTime) * 1000.0f;
+    mLastTime = deltaTime;
+    mAvgUpdateMs = 0.95f * mAvgUpdateMs + 0.05f * updateMs.count();
+    mAvgFrameMs = 0.95f * mAvgFrameMs + 0.05f * frameMs;
     if (!mMouseDown && mRotVel != 0.0f) {
       auto rads = glm::radians(mRotVel);
       mWorldRotation = glm::rotate(mWorldRotation, rads, vec3(0, 1, 0));
@@ -110,6 +130,15 @@ private:
   void keyCB(int key, int action) {
     if (action == GLFW_PRESS) {
       switch (key) {
+      case GLFW_KEY_B:
+        mBenchmark = !mBenchmark;
+        mAvgUpdateMs = mAvgFrameMs = 0.0f;
+        break;
+      case GLFW_KEY_S:
+        mStreaming = !mStreaming;
+        mLine->setStreaming(mStreaming);
+        mAvgUpdateMs = mAvgFrameMs = 0.0f;
+        break;
       case GLFW_KEY_Q:
         setShouldCloseWindow();
         break;
@@ -117,6 +146,24 @@ private:
     }
   }
 
+  void drawStats(bool *p_open) {
+    if (ImGui::Begin("Line Stats", p_open)) {
+      ImGui::Text("Points: %d", mBenchmark ? mBenchmarkPoints : 2);
+      ImGui::Text("Upload: %s", mStreaming ? "stream buffer" : "finalize");
+      ImGui::Text("Line update: %.3f ms", mAvgUpdateMs);
+      ImGui::Text("Frame: %.3f ms", mAvgFrameMs);
+      const auto &stream = getRenderer().getStreamBuffer();
+      ImGui::Text("Stream buffer: %zu KB, %s", stream.size() / 1024,
+                  stream.isPersistent() ? "persistent" : "orphaning");
+      ImGui::Text("Stalls %u, orphans %u, grows %u", stream.getStats().stalls,
+                  stream.getStats().orphans, stream.getStats().grows);
+      ImGui::Separator();
+      ImGui::Text("B - Toggle 1M point benchmark line");
+      ImGui::Text("S - Toggle streaming");
+    }
+    ImGui::End();
+  }
+
   // Camera
   Engine::OrthoCamera mOrthoCamera;
 
@@ -126,6 +173,14 @@ private:
   bool  mFirstMouse = true;
   float mRotVel = 0.0f;
   Engine::Gadgets::Line *mLine = nullptr;
+
+  // Benchmark state.
+  bool  mBenchmark = false;
+  bool  mStreaming = true;
+  int   mBenchmarkPoints = 1000000;
+  float mLastTime = 0.0f;
+  float mAvgUpdateMs = 0.0f;
+  float mAvgFrameMs = 0.0f;
 };
 
 int main(int argc, char **argv) {
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <Engine/Icosphere.h>
+#include <Engine/MeshOptimize.h>
+#include <Engine/Simplify.h>
+
+/// Console benchmark for mesh generation. Times icosphere subdivision at
+/// every level up to the first argument, defaults to 8, against the old
+/// hash map based generator, and checks the result is a closed sphere with
+/// outward facing triangles. Then reports post-transform cache efficiency
+/// of the built-in primitives before and after optimizeMesh().
+
+using Engine::Icosphere;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Median wall time of \p runs calls to \p fn in milliseconds.
+template <typename F> double timeMs(int runs, F &&fn) {
+  std::vector<double> times;
+  for (int i = 0; i < runs; i++) {
+    auto start = Clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+/// The generator Sphere used before: growing vectors, a midpoint hash map,
+/// front erasure of split faces and a determinant per face for winding.
+Icosphere legacyIcosphere(int level) {
+  float t = (1.0f + sqrt(5.0f)) / 2.0f;
+  std::vector<vec3> points{{-1, t, 0}, {1, t, 0},   {-1, -t, 0}, {1, -t, 0},
+                           {0, -1, t}, {0, 1, t},   {0, -1, -t}, {0, 1, -t},
+                           {t, 0, -1}, {t, 0, 1},   {-t, 0, -1}, {-t, 0, 1}};
+  for (auto &p : points)
+    p = glm::normalize(p);
+  std::unordered_map<uint64_t, size_t> cache;
+  auto midpoint = [&](uint32_t a, uint32_t b) {
+    uint64_t key = (uint64_t(std::min(a, b)) << 32) + std::max(a, b);
+    auto it = cache.find(key);
+    if (it != cache.end())
+      return uint32_t(it->second);
+    points.push_back(glm::normalize(0.5f * (points[a] + points[b])));
+    cache.insert({key, points.size() - 1});
+    return uint32_t(points.size() - 1);
+  };
+  auto ccw = [&](uint32_t a, uint32_t b, uint32_t c) {
+    mat4 check{1.0f};
+    check[0] = vec4(points[a], 1.0f);
+    check[1] = vec4(points[b], 1.0f);
+    check[2] = vec4(points[c], 1.0f);
+    check[3] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return glm::determinant(check) > 0 ? std::make_tuple(a, c, b)
+                                       : std::make_tuple(a, b, c);
+  };
+  std::vector<uint32_t> indices = {
+      0, 11, 5,  0, 5,  1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11,
+      4, 11, 10, 2, 10, 7, 6, 7, 1, 8, 3, 9,  4, 3,  4,  2, 3, 2, 6, 3,
+      6, 8,  3,  8, 9,  4, 9, 5, 2, 4, 11, 6, 2, 10, 8,  6, 7, 9, 8, 1};
+  auto addFace = [&](std::tuple<uint32_t, uint32_t, uint32_t> face) {
+    indices.push_back(std::get<0>(face));
+    indices.push_back(std::get<1>(face));
+    indices.push_back(std::get<2>(face));
+  };
+  for (int i = 0; i < level; i++) {
+    size_t n = indices.size() / 3;
+    for (size_t j = 0; j < n; j++) {
+      size_t k = j * 3;
+      uint32_t a = indices[k], b = indices[k + 1], c = indices[k + 2];
+      uint32_t v1 = midpoint(a, b), v2 = midpoint(a, c), v3 = midpoint(b, c);
+      if (i == level - 1) {
+        addFace(ccw(v1, v2, v3));
+        addFace(ccw(v1, v2, a));
+        addFace(ccw(v1, v3, b));
+        addFace(ccw(v2, v3, c));
+      } else {
+        addFace(std::make_tuple(v1, v2, v3));
+        addFace(std::make_tuple(v1, v2, a));
+        addFace(std::make_tuple(v1, v3, b));
+        addFace(std::make_tuple(v2, v3, c));
+      }
+    }
+    indices.erase(indices.begin(), indices.begin() + n * 3);
+  }
+  return Icosphere{points, indices};
+}
+
+/// Same layout as StandardMeshData.
+struct Vertex {
+  vec3 position;
+  vec3 normal;
+  vec2 uv;
+};
+
+struct Geometry {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+/// The 36 vertices Box uploaded, six per face with flat normals.
+Geometry boxGeometry() {
+  vec3 p[8] = {{1, 0, 0}, {1, 1, 0}, {1, 0, 1}, {1, 1, 1},
+               {0, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0, 1, 1}};
+  const int corners[36] = {0, 2, 1, 2, 3, 1, 0, 4, 6, 0, 6, 2,
+                           1, 5, 4, 1, 4, 0, 4, 5, 7, 4, 7, 6,
+                           2, 6, 7, 2, 7, 3, 3, 7, 5, 3, 5, 1};
+  const vec2 uvs[6] = {{0, 0}, {1, 0}, {0, 1}, {1, 0}, {1, 1}, {0, 1}};
+  Geometry box;
+  for (int i = 0; i < 36; i += 6) {
+    const vec3 &a = p[corners[i]], &b = p[corners[i + 1]],
+               &c = p[corners[i + 2]];
+    vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+    for (int k = 0; k < 6; k++)
+      box.vertices.push_back({p[corners[i + k]], normal, uvs[k]});
+  }
+  return box;
+}
+
+Geometry planeGeometry() {
+  vec3 n{0, 1, 0};
+  return {{{{-1, 0, -1}, n, {0, 0}},
+           {{1, 0, -1}, n, {0, 1}},
+           {{1, 0, 1}, n, {1, 1}},
+           {{-1, 0, 1}, n, {1, 0}}},
+          {0, 1, 3, 3, 1, 2}};
+}
+
+Geometry sphereGeometry(const Icosphere &sphere) {
+  Geometry geometry;
+  for (const auto &p : sphere.positions)
+    geometry.vertices.push_back({p, p, vec2(0.0f)});
+  geometry.indices = sphere.indices;
+  return geometry;
+}
+
+/// ACMR and ATVR with a 16 entry FIFO, before and after optimizing.
+/// Unindexed geometry draws its vertices in order.
+void reportVertexCache(const char *name, const Geometry &geometry) {
+  size_t numVertices = geometry.vertices.size();
+  auto indices = geometry.indices;
+  for (uint32_t i = 0; geometry.indices.empty() && i < numVertices; i++)
+    indices.push_back(i);
+  auto before =
+      Engine::analyzeVertexCache(indices.data(), indices.size(), numVertices);
+
+  Geometry optimized;
+  double ms = timeMs(5, [&] {
+    optimized = geometry;
+    optimized.vertices.resize(Engine::optimizeMesh(
+        optimized.vertices.data(), numVertices, sizeof(Vertex),
+        optimized.indices, {}));
+  });
+  auto after = Engine::analyzeVertexCache(optimized.indices.data(),
+                                          optimized.indices.size(),
+                                          optimized.vertices.size());
+  printf("%-18s %9zu %9zu %7.3f %7.3f %7.3f %7.3f %10.3f\n", name,
+         numVertices, optimized.vertices.size(), before.acmr, after.acmr,
+         before.atvr, after.atvr, ms);
+}
+
+/// Closed, unit radius and consistently wound: every directed edge is used
+/// once and its reverse once, and faces are counter clockwise seen from
+/// outside, or clockwise with \p clockwise.
+bool validate(const Icosphere &sphere, int level, bool clockwise = false) {
+  if (sphere.positions.size() != Icosphere::numVertices(level) ||
+      sphere.indices.size() != 3 * Icosphere::numFaces(level))
+    return false;
+  for (const auto &p : sphere.positions) {
+    if (std::abs(glm::length(p) - 1.0f) > 1e-5f)
+      return false;
+  }
+  std::vector<uint64_t> directed;
+  directed.reserve(sphere.indices.size());
+  for (size_t i = 0; i < sphere.indices.size(); i += 3) {
+    const uint32_t *f = &sphere.indices[i];
+    const vec3 &a = sphere.positions[f[0]], &b = sphere.positions[f[1]],
+               &c = sphere.positions[f[2]];
+    float facing = glm::dot(glm::cross(b - a, c - a), a + b + c);
+    if (clockwise ? facing >= 0.0f : facing <= 0.0f)
+      return false;
+    for (int k = 0; k < 3; k++)
+      directed.push_back(uint64_t(f[k]) << 32 | f[(k + 1) % 3]);
+  }
+  std::sort(directed.begin(), directed.end());
+  if (std::adjacent_find(directed.begin(), directed.end()) != directed.end())
+    return false;
+  for (uint64_t edge : directed) {
+    uint64_t reverse = edge << 32 | edge >> 32;
+    if (!std::binary_search(directed.begin(), directed.end(), reverse))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int maxLevel = std::min(argc > 1 ? atoi(argv[1]) : 8, Icosphere::MaxLevel);
+  uint cores = std::max(1u, std::thread::hardware_concurrency());
+  printf("Icosphere generation, %u threads\n", cores);
+  printf("%5s %10s %10s %12s %12s %12s %8s %8s\n", "level", "vertices",
+         "triangles", "legacy ms", "1 thread ms", "threaded ms", "legacy",
+         "valid");
+
+  for (int level = 0; level <= maxLevel; level++) {
+    int runs = level < 6 ? 21 : 5;
+    double legacy = timeMs(runs, [&] { legacyIcosphere(level); });
+    double single = timeMs(runs, [&] { Icosphere::generate(level, 1); });
+    double threaded = timeMs(runs, [&] { Icosphere::generate(level); });
+    // The legacy generator wound faces clockwise seen from outside, but
+    // only fixed the winding up when splitting, level 0 kept the
+    // icosahedron's.
+    bool legacyValid =
+        validate(legacyIcosphere(level), level, /* clockwise */ level > 0);
+    bool valid = validate(Icosphere::generate(level), level) &&
+                 validate(Icosphere::generate(level, 1), level);
+    printf("%5d %10zu %10zu %12.3f %12.3f %12.3f %8s %8s\n", level,
+           Icosphere::numVertices(level), Icosphere::numFaces(level), legacy,
+           single, threaded, legacyValid ? "yes" : "NO",
+           valid ? "yes" : "NO");
+  }
+
+  printf("\nVertex cache, 16 entry FIFO\n");
+  printf("%-18s %9s %9s %7s %7s %7s %7s %10s\n", "mesh", "verts", "after",
+         "ACMR", "after", "ATVR", "after", "opt ms");
+  reportVertexCache("box", boxGeometry());
+  reportVertexCache("plane", planeGeometry());
+  char name[32];
+  for (int level = 1; level <= std::min(maxLevel, 7); level++) {
+    snprintf(name, sizeof(name), "sphere %d", level);
+    reportVertexCache(name, sphereGeometry(Icosphere::generate(level)));
+  }
+  // An irregular mesh like an imported one: a simplified sphere.
+  auto sphere = sphereGeometry(Icosphere::generate(6));
+  float error;
+  sphere.indices = Engine::simplify(
+      sphere.vertices.data(), sphere.vertices.size(), sizeof(Vertex),
+      sphere.indices, sphere.indices.size() / 4, error);
+  reportVertexCache("simplified sphere", sphere);
+  return 0;
+}
@@ -49,6 +49,8 @@ public:
       "", // no geometry shader
       bind(mem_fn(&Example::updateUniforms), this, _1)
     });
+    // Saving any of the shader files rebuilds it in the background.
+    renderer.setShaderHotReload(true);
 
     // -------------- Create Renderables -----------------
     auto default_mat = Engine::Material{};
@@ -57,6 +59,8 @@ public:
       mShader);
  
     ss_plane->bindCallback([this](Engine::Shader &shader, const SSPlane &m) {});
+    // The plane is drawn straight in clip space, its bounds mean nothing.
+    renderer.setCullingEnabled(false);
 
     std::function<void(int, int)> key_cb = bind(mem_fn(&Example::keyCB), this, _1, _2);
     mInputHandler->addKeyCallback(key_cb);
@@ -83,7 +87,7 @@ private:
       case GLFW_KEY_R:
         auto &r = getRenderer();
         r.getShader(mShader).reload();
-        LOG_INFO("Shader reloaded.")
+        LOG_INFO("Reloading shader.")
         break;
       }
     }
@@ -104,8 +108,14 @@ private:
     ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
     window_flags |= ImGuiWindowFlags_NoMove;
     ImGui::SetNextWindowBgAlpha(0.35f); // Transparent background
-    if (ImGui::Begin("Help", p_open, window_flags))
-        ImGui::Text("R - Reload Shader");
+    if (ImGui::Begin("Help", p_open, window_flags)) {
+        auto &shader = getRenderer().getShader(mShader);
+        ImGui::Text("R - Reload Shader (reloads on save)");
+        ImGui::Text(shader.isBuilding() ? "Building..." : "Last build: %.1f ms",
+                    shader.getLastBuildMs());
+        if (!shader.getBuildError().empty())
+          ImGui::TextWrapped("%s", shader.getBuildError().c_str());
+    }
     ImGui::End();
   }
 
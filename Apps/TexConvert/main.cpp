@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <Engine/Texture.h>
+#include <Engine/TextureFormats.h>
+
+/// Offline converter from regular images (anything stb_image reads) to
+/// block compressed DDS files with a full mip chain, ready for the
+/// TextureLoader. Directories are converted file by file, files that are
+/// already DDS or KTX are skipped.
+///
+///   TexConvert [--format auto|bc1|bc3|bc5|bc7] [--out dir] [inputs...]
+///
+/// Inputs default to textures/. Output goes next to each input unless --out
+/// is given. "auto" picks BC1 for opaque images and BC3 for the rest.
+
+using Engine::Texture;
+namespace Formats = Engine::TextureFormats;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Settings {
+  std::string format = "auto";
+  std::string out;
+};
+
+bool isOpaque(const Texture::Image &image) {
+  if (image.channels == 1 || image.channels == 3)
+    return true;
+  const unsigned char *pixels = image.pixels.get();
+  for (size_t i = image.channels - 1; i < image.size(); i += image.channels) {
+    if (pixels[i] != 255)
+      return false;
+  }
+  return true;
+}
+
+bool chooseBlock(const std::string &name, const Texture::Image &image,
+                 Formats::Block &block) {
+  if (name == "auto")
+    block = isOpaque(image) ? Formats::Block::BC1 : Formats::Block::BC3;
+  else if (name == "bc1")
+    block = Formats::Block::BC1;
+  else if (name == "bc3")
+    block = Formats::Block::BC3;
+  else if (name == "bc5")
+    block = Formats::Block::BC5;
+  else if (name == "bc7")
+    block = Formats::Block::BC7;
+  else
+    return false;
+  return true;
+}
+
+const char *blockName(Formats::Block block) {
+  const char *names[] = {"BC1", "BC3", "BC5", "BC7"};
+  return names[int(block)];
+}
+
+bool convert(const fs::path &input, const Settings &settings) {
+  auto start = std::chrono::steady_clock::now();
+  auto image = Texture::decode(input.string());
+  if (!image.pixels) {
+    fprintf(stderr, "%s: %s\n", input.c_str(), image.error.c_str());
+    return false;
+  }
+  Formats::Block block;
+  if (!chooseBlock(settings.format, image, block)) {
+    fprintf(stderr, "Unknown format %s\n", settings.format.c_str());
+    return false;
+  }
+
+  auto compressed = Formats::compress(image, block);
+  auto output = (settings.out.empty() ? input.parent_path()
+                                      : fs::path(settings.out)) /
+                input.filename().replace_extension(".dds");
+  if (!Formats::writeDDS(output.string(), compressed)) {
+    fprintf(stderr, "Could not write %s\n", output.c_str());
+    return false;
+  }
+
+  std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  // What the same texture costs uncompressed, RGBA8 with mips.
+  size_t rgba = size_t(image.width) * image.height * 4 * 4 / 3;
+  printf("%s -> %s: %dx%d %s, %zu levels, %.1f KB (%.1fx smaller than "
+         "RGBA8), %.1f ms\n",
+         input.c_str(), output.c_str(), image.width, image.height,
+         blockName(block), compressed.levels.size(),
+         compressed.size() / 1024.0f, rgba / float(compressed.size()),
+         elapsed.count());
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Settings settings;
+  std::vector<fs::path> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+      settings.format = argv[++i];
+    else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      settings.out = argv[++i];
+    else
+      inputs.push_back(argv[i]);
+  }
+  if (inputs.empty())
+    inputs.push_back("textures");
+  if (!settings.out.empty())
+    fs::create_directories(settings.out);
+
+  int failures = 0;
+  for (const auto &input : inputs) {
+    std::vector<fs::path> files;
+    if (fs::is_directory(input)) {
+      for (const auto &entry : fs::directory_iterator(input)) {
+        if (entry.is_regular_file())
+          files.push_back(entry.path());
+      }
+    } else {
+      files.push_back(input);
+    }
+    for (const auto &file : files) {
+      if (!Formats::isCompressed(file.string()))
+        failures += !convert(file, settings);
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -1,11 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <cstring>
 #include <memory>
 
 #include <Engine/Application.h>
 
 namespace Engine {
 
+Application::Options Application::parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--headless") == 0) {
+      options.headless = true;
+    } else if (std::strcmp(argv[i], "--osmesa") == 0) {
+      options.headless = options.osmesa = true;
+    } else if (std::strcmp(argv[i], "--no-vsync") == 0) {
+      options.vsync = false;
+    } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      options.frames = uint(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      options.trace = argv[++i];
+    }
+  }
+  return options;
+}
+
 void Application::createWindow() {
   // Initialize GLFW
   if (!glfwInit()) {
@@ -18,20 +37,15 @@ void Application::createWindow() {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
-  glfwWindowHint(GLFW_SAMPLES, 4);
+  glfwWindowHint(GLFW_VISIBLE, mOptions.headless ? GL_FALSE : GL_TRUE);
+  glfwWindowHint(GLFW_SAMPLES, mOptions.headless ? 0 : 4);
+  if (mOptions.osmesa)
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
   glfwWindowHint(GLFW_RED_BITS, 8);
   glfwWindowHint(GLFW_GREEN_BITS, 8);
   glfwWindowHint(GLFW_BLUE_BITS, 8);
   glfwWindowHint(GLFW_ALPHA_BITS, 8);
 
-  auto *monitor = glfwGetPrimaryMonitor();
-  if (!monitor) {
-    glfwTerminate();
-    std::cerr << "Could not retrive primary monitor" << std::endl;
-    std::abort();
-  }
-
   // Create window
   mWindow = glfwCreateWindow(mWidth, mHeight, "Engine", NULL, NULL);
   if (mWindow == NULL) {
@@ -55,24 +69,59 @@ void Application::centerWindow() {
   glfwSetWindowPos(mWindow, x, y);
 }
 
+void Application::createOffscreenTarget() {
+  // Render at the requested size rather than whatever the hidden window got.
+  mFramebufferWidth = mWidth;
+  mFramebufferHeight = mHeight;
+
+  glGenRenderbuffers(1, &mOffscreenColour);
+  glBindRenderbuffer(GL_RENDERBUFFER, mOffscreenColour);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, mWidth, mHeight);
+  glGenRenderbuffers(1, &mOffscreenDepth);
+  glBindRenderbuffer(GL_RENDERBUFFER, mOffscreenDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mWidth,
+                        mHeight);
+
+  glGenFramebuffers(1, &mOffscreenFBO);
+  GLStateCache::getInstance().bindFramebuffer(mOffscreenFBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, mOffscreenColour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, mOffscreenDepth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+    glfwTerminate();
+    std::abort();
+  }
+  mRenderer->setRenderTarget(mOffscreenFBO);
+}
+
 Application::Application(int width, int height, int argc, char **argv)
-    : mWidth(width),
+    : Application(width, height, parseOptions(argc, argv)) {}
+
+Application::Application(int width, int height, const Options &options)
+    : mOptions(options),
+    mWidth(width),
     mHeight(height),
-    mCamera(Engine::Camera{vec3(0, 3, 3), vec3(0, 1, 0), vec3(1, -3, -3)}) {
+    mDefaultCamera{vec3(0, 3, 3), vec3(0, 1, 0), vec3(1, -3, -3)} {
 
   /************ CREATE WINDOW AND CONTEXT ***********/
   createWindow();
-  centerWindow();
+  if (!mOptions.headless)
+    centerWindow();
 
   // Create context
   glfwMakeContextCurrent(mWindow);
   gl3wInit();
 
   mRenderer = std::make_unique<Renderer>();
+  if (mOptions.headless)
+    createOffscreenTarget();
+  updateCameraMatrices();
 
   // Establish initial position for camera
   mWorldTranslation = glm::translate(
-      mat4(1.0f), float(mScale) * -glm::normalize(mCamera.getPos()));
+      mat4(1.0f), float(mScale) * -glm::normalize(mCamera->getPos()));
   mWorldTransform = mWorldTranslation * mWorldRotation;
 
   /************ INITIALIZE INPUT HANDLER ***********/
@@ -87,40 +136,101 @@ Application::Application(int width, int height, int argc, char **argv)
       mScale = 300.0f;
 
     mWorldTranslation = glm::translate(
-        mat4(1.0f), float(mScale) * -glm::normalize(mCamera.getPos()));
+        mat4(1.0f), float(mScale) * -glm::normalize(mCamera->getPos()));
     mWorldTransform = mWorldTranslation * mWorldRotation;
   });
 
   /************ INITIALIZE UI *************/
   // Init ImGui.
   mUIManager.init(mWindow, /* glsl version */ "#version 330 core");
+  mUIManager.registerWidget("GPU Profiler", [](bool *open) {
+    GpuProfiler::getInstance().draw(open);
+  }, /* visible */ false);
+  mUIManager.registerWidget("Texture Cache", [](bool *open) {
+    TextureCache::getInstance().draw(open);
+  }, /* visible */ false);
+#ifdef ENGINE_PROFILING
+  mUIManager.registerWidget("CPU Profiler", [](bool *open) {
+    CpuProfiler::getInstance().draw(open);
+  }, /* visible */ false);
+#endif
 }
 
 void Application::run() {
-  glfwSwapInterval(1);
+  glfwSwapInterval(mOptions.vsync ? 1 : 0);
 
   do {
-    // Update framebuffer size.
-    glfwGetFramebufferSize(mWindow, &mFramebufferWidth, &mFramebufferHeight);
+    PROFILE_FRAME();
+    // Update framebuffer size, the offscreen target has a fixed size.
+    if (!mOptions.headless)
+      glfwGetFramebufferSize(mWindow, &mFramebufferWidth, &mFramebufferHeight);
     glViewport(0, 0, mFramebufferWidth, mFramebufferHeight);
 
     // Per frame implementation specific update.
     float currentFrame = (float) glfwGetTime();
-    tick(currentFrame);
+    {
+      PROFILE_SCOPE("Tick");
+      tick(currentFrame);
+      updateCameraMatrices();
+    }
+
+    auto &gpuProfiler = GpuProfiler::getInstance();
+    gpuProfiler.beginFrame();
 
     // Render all renderable objects.
     mRenderer->renderFrame(*this, mWorldTransform);
 
     // Check for input.
-    mInputHandler->poll();
-
-    // Draw UI.
-    mUIManager.drawFrame();
-
-    // Swap buffers
-    glfwSwapBuffers(mWindow);
+    {
+      PROFILE_SCOPE("Poll");
+      mInputHandler->poll();
+    }
+
+    if (mOptions.headless) {
+      // Nobody sees the UI and there is nothing to present, just make sure
+      // the frame gets submitted.
+      gpuProfiler.endFrame();
+      PROFILE_SCOPE("Flush");
+      glFlush();
+    } else {
+      // Draw UI.
+      {
+        PROFILE_SCOPE("UI");
+        GPU_SCOPE("UI");
+        mUIManager.drawFrame();
+      }
+      gpuProfiler.endFrame();
+
+      // Swap buffers
+      PROFILE_SCOPE("Swap");
+      glfwSwapBuffers(mWindow);
+    }
+
+    mFrameCount++;
+    if (mOptions.frames && mFrameCount >= mOptions.frames)
+      setShouldCloseWindow();
   } while (glfwWindowShouldClose(mWindow) == 0);
+  GpuProfiler::getInstance().flush();
+#ifdef ENGINE_PROFILING
+  if (!mOptions.trace.empty())
+    CpuProfiler::getInstance().writeChromeTrace(mOptions.trace);
+#endif
+}
 
+Application::~Application() {
+  // Everything holding GL objects has to go while there is still a context
+  // to delete them in. The derived application's members are gone by now,
+  // the renderables go next, then the cached textures nothing uses anymore.
+  mRenderer.reset();
+  if (mOptions.headless) {
+    GLStateCache::getInstance().bindFramebuffer(0);
+    glDeleteFramebuffers(1, &mOffscreenFBO);
+    glDeleteRenderbuffers(1, &mOffscreenColour);
+    glDeleteRenderbuffers(1, &mOffscreenDepth);
+  }
+  TextureCache::getInstance().clear();
+  TextureLoader::getInstance().shutdown();
+  GpuProfiler::getInstance().shutdown();
   mUIManager.shutdown();
   glfwTerminate();
 }
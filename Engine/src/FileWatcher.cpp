@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include <Engine/FileWatcher.h>
+#include <Engine/Log.h>
+
+#ifdef __linux__
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Engine {
+
+FileWatcher::Path FileWatcher::normalize(const std::string &path) {
+  std::error_code error;
+  auto absolute = std::filesystem::absolute(path, error);
+  return (error ? Path(path) : absolute).lexically_normal();
+}
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher()
+    : mFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+      mEventBuffer(64 * (sizeof(inotify_event) + NAME_MAX + 1)) {
+  if (mFd < 0)
+    LOG_ERROR("inotify_init1 failed, file watching disabled.");
+}
+
+FileWatcher::~FileWatcher() {
+  if (mFd >= 0)
+    close(mFd);
+}
+
+void FileWatcher::watch(const std::string &path) {
+  auto file = normalize(path);
+  mFiles[file.string()] = path;
+  if (mFd < 0)
+    return;
+
+  // Watching the same directory again hands back the same descriptor. A
+  // file is only reported once it has been written and closed or renamed
+  // into place, creating it hands over an empty or partial file.
+  auto directory = file.parent_path();
+  int wd = inotify_add_watch(mFd, directory.c_str(),
+                             IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (wd < 0) {
+    LOG_ERROR("Could not watch %s.", directory.c_str());
+    return;
+  }
+  mDirectories[wd] = directory;
+}
+
+std::vector<std::string> FileWatcher::poll() {
+  std::vector<std::string> changed;
+  if (mFd < 0)
+    return changed;
+
+  bool overflowed = false;
+  while (true) {
+    ssize_t length = read(mFd, mEventBuffer.data(), mEventBuffer.size());
+    if (length <= 0)
+      break; // EAGAIN, nothing more queued.
+    for (ssize_t offset = 0; offset < length;) {
+      auto *event =
+          reinterpret_cast<const inotify_event *>(&mEventBuffer[offset]);
+      offset += sizeof(inotify_event) + event->len;
+      overflowed |= (event->mask & IN_Q_OVERFLOW) != 0;
+      auto directory = mDirectories.find(event->wd);
+      if (event->len == 0 || directory == mDirectories.end())
+        continue;
+      auto file = (directory->second / event->name).string();
+      auto iter = mFiles.find(file);
+      if (iter != mFiles.end() &&
+          std::find(changed.begin(), changed.end(), iter->second) ==
+              changed.end())
+        changed.push_back(iter->second);
+    }
+  }
+
+  // Events were dropped, any watched file may have changed without a word.
+  if (overflowed) {
+    LOG_INFO("inotify queue overflowed, reporting every watched file.");
+    changed.clear();
+    for (const auto &file : mFiles)
+      changed.push_back(file.second);
+  }
+  return changed;
+}
+
+#else
+
+FileWatcher::FileWatcher() = default;
+FileWatcher::~FileWatcher() = default;
+
+void FileWatcher::watch(const std::string &path) {
+  auto file = normalize(path).string();
+  mFiles[file] = path;
+  std::error_code error;
+  mTimes[file] = std::filesystem::last_write_time(file, error);
+}
+
+std::vector<std::string> FileWatcher::poll() {
+  std::vector<std::string> changed;
+  auto now = std::chrono::steady_clock::now();
+  if (now - mLastPoll < PollInterval)
+    return changed;
+  mLastPoll = now;
+
+  for (auto &entry : mTimes) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(entry.first, error);
+    if (error || time == entry.second)
+      continue;
+    entry.second = time;
+    changed.push_back(mFiles[entry.first]);
+  }
+  return changed;
+}
+
+#endif
+
+} // namespace Engine
@@ -2,11 +2,16 @@
 #include <Engine/ShaderPresets.h>
 #include <Engine/Log.h>
 
+#include <algorithm>
+
 namespace Engine {
 namespace Gadgets{
 
 static int numLines = 0;
-LineMesh::LineMesh() : Mesh("Line" + std::to_string(numLines++), GL_TRIANGLES) {}
+LineMesh::LineMesh(StreamBuffer *stream)
+    : Mesh("Line" + std::to_string(numLines++), GL_TRIANGLES,
+           BufferUsage::Dynamic),
+      mStream(stream) {}
 
 void LineMesh::startLine() {
     mData.clear();
@@ -21,8 +26,12 @@ void LineMesh::addPoint(const vec3 &p) {
 }
 
 void LineMesh::endLine() {
+    // A line needs at least two points.
+    if (mData.size() < 4)
+        mData.clear();
+
     // Go through line and setup next/prev points.
-    for (auto i = 0; i < mData.size(); i += 2) {
+    for (size_t i = 0; i < mData.size(); i += 2) {
         if (i != 0) {
             mData[i].prev = mData[i-1].pos;
             mData[i+1].prev = mData[i-1].pos;
@@ -40,16 +49,36 @@ void LineMesh::endLine() {
         mData[i].sign = 1.0f;
         mData[i+1].sign = -1.0f;
     }
+    size_t numIndices = mData.empty() ? 0 : 3 * (mData.size() - 2);
+    if (mStream) {
+        if (numIndices > mIndexCapacity) {
+            mIndexCapacity = std::max(numIndices, 2 * mIndexCapacity);
+            std::vector<uint32_t> indices;
+            indices.reserve(mIndexCapacity);
+            for (uint32_t i = 0; indices.size() < mIndexCapacity; i++) {
+                indices.insert(indices.end(), {i, i+1, i+2});
+            }
+            setIndices(indices);
+            finalizeIndices();
+        }
+        stream(*mStream, mData.data(), mData.size(), numIndices);
+        return;
+    }
+
     std::vector<uint32_t> indices;
-    for (uint32_t i = 0; i < mData.size() - 2; i++) {
+    for (uint32_t i = 0; i + 2 < mData.size(); i++) {
         indices.insert(indices.end(), {i, i+1, i+2});
     }
     setIndices(indices);
     setVertexData(mData);
+    mIndexCapacity = 0;
     finalize();
 }
 
-Line::Line(Renderer &renderer, std::function<void(Shader &)> bindCB) : Renderable<LineMesh>(std::make_unique<LineMesh>()) {
+Line::Line(Renderer &renderer, std::function<void(Shader &)> bindCB)
+    : Renderable<LineMesh>(
+          std::make_unique<LineMesh>(&renderer.getStreamBuffer())),
+      mRenderer(renderer) {
     int shaderID = generateShaderPreset(renderer, ShaderPreset::Line, bindCB);
     bindShader(shaderID);
     LOG_DEBUG("Line Created...");
@@ -66,5 +95,9 @@ void Line::addPoint(const vec3 &p) {
 void Line::endLine() {
     line().endLine();
 }
+
+void Line::setStreaming(bool streaming) {
+    line().setStreamBuffer(streaming ? &mRenderer.getStreamBuffer() : nullptr);
+}
 } // namespace Gadgets
 } // namespace Engine
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include <Engine/BVH.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Engine {
+
+namespace {
+
+constexpr uint32_t MaxLeafItems = 4;
+/// Leaves may grow past MaxLeafItems when SAH says splitting doesn't pay off.
+constexpr uint32_t MaxLeafItemsSAH = 16;
+constexpr int NumBins = 12;
+constexpr uint32_t NoParent = ~uint32_t(0);
+
+AABB emptyBox() {
+  float inf = std::numeric_limits<float>::infinity();
+  return AABB{vec3(inf), vec3(-inf)};
+}
+
+inline void grow(AABB &box, const AABB &other) {
+  box.min = glm::min(box.min, other.min);
+  box.max = glm::max(box.max, other.max);
+}
+
+inline void grow(AABB &box, const vec3 &p) {
+  box.min = glm::min(box.min, p);
+  box.max = glm::max(box.max, p);
+}
+
+inline float surfaceArea(const AABB &box) {
+  vec3 d = box.max - box.min;
+  if (d.x < 0.0f)
+    return 0.0f;
+  return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+inline bool sameBox(const AABB &a, const AABB &b) {
+  return a.min == b.min && a.max == b.max;
+}
+
+/// Slab test, returns the entry distance or infinity on a miss.
+inline float intersect(const AABB &box, const vec3 &origin, const vec3 &invDir,
+                       float tMax) {
+  vec3 t0 = (box.min - origin) * invDir;
+  vec3 t1 = (box.max - origin) * invDir;
+  vec3 tNear = glm::min(t0, t1);
+  vec3 tFar = glm::max(t0, t1);
+  float enter = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+  float exit = std::min({tFar.x, tFar.y, tFar.z, tMax});
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+} // namespace
+
+void BVH::clear() {
+  mNodes.clear();
+  mItemBounds.clear();
+  mItemOrder.clear();
+  mItemLeaf.clear();
+  mParents.clear();
+}
+
+void BVH::build(const std::vector<AABB> &items) {
+  clear();
+  if (items.empty())
+    return;
+
+  mItemBounds = items;
+  mItemOrder.resize(items.size());
+  mItemLeaf.resize(items.size());
+  mCentroids.resize(items.size());
+  for (uint32_t i = 0; i < items.size(); i++) {
+    mItemOrder[i] = i;
+    mCentroids[i] = items[i].centre();
+  }
+  // A binary tree with at most one item per leaf has 2n - 1 nodes.
+  mNodes.reserve(2 * items.size());
+  mParents.reserve(2 * items.size());
+  buildNode(0, uint32_t(items.size()), NoParent);
+
+  mCentroids.clear();
+  mCentroids.shrink_to_fit();
+}
+
+void BVH::makeLeaf(Node &node, uint32_t index, uint32_t begin, uint32_t end) {
+  node.offset = begin;
+  node.count = uint16_t(end - begin);
+  for (uint32_t i = begin; i < end; i++)
+    mItemLeaf[mItemOrder[i]] = index;
+}
+
+uint32_t BVH::buildNode(uint32_t begin, uint32_t end, uint32_t parent) {
+  uint32_t index = uint32_t(mNodes.size());
+  mNodes.push_back(Node{});
+  mParents.push_back(parent);
+
+  AABB bounds = emptyBox(), centroidBounds = emptyBox();
+  for (uint32_t i = begin; i < end; i++) {
+    grow(bounds, mItemBounds[mItemOrder[i]]);
+    grow(centroidBounds, mCentroids[mItemOrder[i]]);
+  }
+  mNodes[index].bounds = bounds;
+
+  uint32_t count = end - begin;
+  if (count <= MaxLeafItems) {
+    makeLeaf(mNodes[index], index, begin, end);
+    return index;
+  }
+
+  // Bin centroids along each axis and pick the split with the lowest SAH
+  // cost: area(left) * n(left) + area(right) * n(right).
+  float bestCost = std::numeric_limits<float>::infinity();
+  int bestAxis = -1, bestBin = 0;
+  vec3 extent = centroidBounds.max - centroidBounds.min;
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] <= 0.0f)
+      continue;
+    AABB binBounds[NumBins];
+    uint32_t binCounts[NumBins] = {};
+    std::fill(std::begin(binBounds), std::end(binBounds), emptyBox());
+    float scale = NumBins / extent[axis];
+    for (uint32_t i = begin; i < end; i++) {
+      auto item = mItemOrder[i];
+      int bin = std::min(
+          NumBins - 1,
+          int((mCentroids[item][axis] - centroidBounds.min[axis]) * scale));
+      binCounts[bin]++;
+      grow(binBounds[bin], mItemBounds[item]);
+    }
+
+    // Sweep from the right to get the cost of every right hand side, then
+    // from the left to evaluate each split plane.
+    float rightArea[NumBins];
+    uint32_t rightCount[NumBins];
+    AABB box = emptyBox();
+    uint32_t n = 0;
+    for (int b = NumBins - 1; b > 0; b--) {
+      grow(box, binBounds[b]);
+      n += binCounts[b];
+      rightArea[b] = surfaceArea(box);
+      rightCount[b] = n;
+    }
+    box = emptyBox();
+    n = 0;
+    for (int b = 0; b < NumBins - 1; b++) {
+      grow(box, binBounds[b]);
+      n += binCounts[b];
+      if (n == 0 || rightCount[b + 1] == 0)
+        continue;
+      float cost = surfaceArea(box) * n + rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = b;
+      }
+    }
+  }
+
+  float leafCost = surfaceArea(bounds) * count;
+  bool splitPays = bestAxis >= 0 && bestCost < leafCost;
+  if (!splitPays && count <= MaxLeafItemsSAH) {
+    makeLeaf(mNodes[index], index, begin, end);
+    return index;
+  }
+
+  uint32_t mid;
+  if (bestAxis >= 0) {
+    float scale = NumBins / extent[bestAxis];
+    float minC = centroidBounds.min[bestAxis];
+    auto *first = mItemOrder.data() + begin;
+    auto *split = std::partition(first, mItemOrder.data() + end,
+                                 [&](uint32_t item) {
+      int bin = std::min(
+          NumBins - 1, int((mCentroids[item][bestAxis] - minC) * scale));
+      return bin <= bestBin;
+    });
+    mid = uint32_t(split - mItemOrder.data());
+  } else {
+    // Every centroid coincides, split down the middle.
+    mid = begin + count / 2;
+  }
+  if (mid == begin || mid == end)
+    mid = begin + count / 2;
+
+  mNodes[index].axis = uint16_t(std::max(bestAxis, 0));
+  buildNode(begin, mid, index);
+  uint32_t right = buildNode(mid, end, index);
+  mNodes[index].offset = right;
+  mNodes[index].count = 0;
+  return index;
+}
+
+AABB BVH::leafBounds(const Node &node) const {
+  AABB box = emptyBox();
+  for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+    grow(box, mItemBounds[mItemOrder[i]]);
+  return box;
+}
+
+void BVH::update(uint32_t item, const AABB &bounds) {
+  mItemBounds[item] = bounds;
+  uint32_t index = mItemLeaf[item];
+  mNodes[index].bounds = leafBounds(mNodes[index]);
+
+  // Walk up until a node's bounds stop changing.
+  for (uint32_t parent = mParents[index]; parent != NoParent;
+       parent = mParents[parent]) {
+    auto &node = mNodes[parent];
+    AABB box = mNodes[parent + 1].bounds;
+    grow(box, mNodes[node.offset].bounds);
+    if (sameBox(box, node.bounds))
+      break;
+    node.bounds = box;
+  }
+}
+
+void BVH::refit() {
+  // Children always come after their parent.
+  for (size_t i = mNodes.size(); i-- > 0;) {
+    auto &node = mNodes[i];
+    if (node.isLeaf()) {
+      node.bounds = leafBounds(node);
+    } else {
+      node.bounds = mNodes[i + 1].bounds;
+      grow(node.bounds, mNodes[node.offset].bounds);
+    }
+  }
+}
+
+void BVH::queryFrustum(const Frustum &frustum, std::vector<uint32_t> &inside,
+                       std::vector<uint32_t> &partial) const {
+  if (mNodes.empty())
+    return;
+
+  // Stack entries carry whether an ancestor was already fully inside, in
+  // which case the planes don't need testing again.
+  struct Entry {
+    uint32_t node;
+    bool inside;
+  };
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back(Entry{0, false});
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    const auto &node = mNodes[entry.node];
+
+    bool fullyInside = entry.inside;
+    if (!fullyInside) {
+      vec3 c = node.bounds.centre(), e = node.bounds.extent();
+      bool outside = false;
+      fullyInside = true;
+      for (int p = 0; p < frustum.numPlanes; p++) {
+        const auto &plane = frustum.planes[p];
+        vec3 n = vec3(plane);
+        float r = glm::dot(e, glm::abs(n));
+        float s = glm::dot(n, c) + plane.w;
+        if (s + r < 0.0f) {
+          outside = true;
+          break;
+        }
+        fullyInside &= s - r >= 0.0f;
+      }
+      if (outside)
+        continue;
+    }
+
+    if (node.isLeaf()) {
+      auto &out = fullyInside ? inside : partial;
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+        out.push_back(mItemOrder[i]);
+    } else {
+      stack.push_back(Entry{node.offset, fullyInside});
+      stack.push_back(Entry{entry.node + 1, fullyInside});
+    }
+  }
+}
+
+bool BVH::raycast(const vec3 &origin, const vec3 &dir, float &t,
+                  uint32_t &item, const RayTest &test) const {
+  if (mNodes.empty())
+    return false;
+
+  vec3 invDir = 1.0f / dir;
+  bool hit = false;
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    stack.pop_back();
+    const auto &node = mNodes[index];
+    if (std::isinf(intersect(node.bounds, origin, invDir, t)))
+      continue;
+
+    if (node.isLeaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        auto candidate = mItemOrder[i];
+        float tItem = intersect(mItemBounds[candidate], origin, invDir, t);
+        if (std::isinf(tItem))
+          continue;
+        if (test) {
+          float tExact = t;
+          if (!test(candidate, tExact) || tExact >= t)
+            continue;
+          tItem = tExact;
+        }
+        t = tItem;
+        item = candidate;
+        hit = true;
+      }
+    } else {
+      // Visit the child on the near side of the split axis first so that
+      // the far one is more likely to be rejected by the shrunken t.
+      uint32_t nearChild = index + 1, farChild = node.offset;
+      if (dir[node.axis] < 0.0f)
+        std::swap(nearChild, farChild);
+      stack.push_back(farChild);
+      stack.push_back(nearChild);
+    }
+  }
+  return hit;
+}
+
+} // namespace Engine
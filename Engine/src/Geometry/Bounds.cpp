@@ -0,0 +1,157 @@
+#include <Engine/Bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ANVIL_CULL_SSE 1
+#endif
+
+namespace Engine {
+
+AABB AABB::transform(const mat4 &mat) const {
+  // Arvo's method: transform the centre and project the extent onto each
+  // world axis using the absolute rotation/scale part of the matrix.
+  vec3 c = vec3(mat * vec4(centre(), 1.0f));
+  vec3 e = extent();
+  vec3 newExtent{0.0f};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++)
+      newExtent[i] += std::abs(mat[j][i]) * e[j];
+  }
+  return AABB{c - newExtent, c + newExtent};
+}
+
+BoundingSphere BoundingSphere::transform(const mat4 &mat) const {
+  float scale = std::max({glm::length(vec3(mat[0])), glm::length(vec3(mat[1])),
+                          glm::length(vec3(mat[2]))});
+  return BoundingSphere{vec3(mat * vec4(centre, 1.0f)), radius * scale};
+}
+
+void computeBounds(const void *positions, size_t count, size_t stride,
+                   AABB &aabb, BoundingSphere &sphere) {
+  if (count == 0) {
+    aabb = AABB{};
+    sphere = BoundingSphere{};
+    return;
+  }
+
+  auto position = [&](size_t i) {
+    vec3 p;
+    std::memcpy(&p, static_cast<const char *>(positions) + i * stride,
+                sizeof(vec3));
+    return p;
+  };
+
+  aabb.min = aabb.max = position(0);
+  for (size_t i = 1; i < count; i++) {
+    auto p = position(i);
+    aabb.min = glm::min(aabb.min, p);
+    aabb.max = glm::max(aabb.max, p);
+  }
+
+  // Centre the sphere on the box, then grow it to the farthest vertex. This is
+  // tighter than the box's circumsphere for round meshes.
+  sphere.centre = aabb.centre();
+  float radius2 = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    auto d = position(i) - sphere.centre;
+    radius2 = std::max(radius2, glm::dot(d, d));
+  }
+  sphere.radius = std::sqrt(radius2);
+}
+
+Frustum Frustum::fromMatrix(const mat4 &m, bool depthClamp) {
+  // Gribb/Hartmann: planes are sums/differences of the matrix rows.
+  auto row = [&m](int i) { return vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+  Frustum f;
+  f.planes[Left] = row(3) + row(0);
+  f.planes[Right] = row(3) - row(0);
+  f.planes[Bottom] = row(3) + row(1);
+  f.planes[Top] = row(3) - row(1);
+  f.planes[Near] = row(3) + row(2);
+  f.planes[Far] = row(3) - row(2);
+  for (auto &plane : f.planes)
+    plane /= glm::length(vec3(plane));
+  f.numPlanes = depthClamp ? 5 : 6;
+  return f;
+}
+
+void SphereBatch::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+void SphereBatch::reserve(size_t n) {
+  x.reserve(n);
+  y.reserve(n);
+  z.reserve(n);
+  radius.reserve(n);
+}
+
+void SphereBatch::push_back(const BoundingSphere &sphere) {
+  x.push_back(sphere.centre.x);
+  y.push_back(sphere.centre.y);
+  z.push_back(sphere.centre.z);
+  radius.push_back(sphere.radius);
+}
+
+size_t cullSpheres(const Frustum &frustum, const SphereBatch &batch,
+                   std::vector<uint8_t> &visible) {
+  size_t n = batch.size();
+  size_t numVisible = 0;
+  size_t i = 0;
+  visible.resize(n);
+
+#ifdef ANVIL_CULL_SSE
+  // Four spheres per iteration, a sphere is outside if it is entirely behind
+  // any plane.
+  __m128 planes[6][4];
+  for (int p = 0; p < frustum.numPlanes; p++) {
+    for (int k = 0; k < 4; k++)
+      planes[p][k] = _mm_set1_ps(frustum.planes[p][k]);
+  }
+  const __m128 zero = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(&batch.x[i]);
+    __m128 y = _mm_loadu_ps(&batch.y[i]);
+    __m128 z = _mm_loadu_ps(&batch.z[i]);
+    __m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&batch.radius[i]));
+    __m128 outside = zero;
+    for (int p = 0; p < frustum.numPlanes; p++) {
+      __m128 dist = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+          _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+    }
+    int mask = _mm_movemask_ps(outside);
+    for (int k = 0; k < 4; k++) {
+      uint8_t v = ((mask >> k) & 1) == 0;
+      visible[i + k] = v;
+      numVisible += v;
+    }
+  }
+#endif
+
+  // Written as !(dist < -radius) like the SSE compare, so that NaN bounds
+  // are kept in both.
+  for (; i < n; i++) {
+    bool inside = true;
+    for (int p = 0; p < frustum.numPlanes && inside; p++) {
+      const auto &plane = frustum.planes[p];
+      float dist = plane.x * batch.x[i] + plane.y * batch.y[i] +
+                   plane.z * batch.z[i] + plane.w;
+      inside = !(dist < -batch.radius[i]);
+    }
+    visible[i] = inside;
+    numVisible += inside;
+  }
+  return numVisible;
+}
+
+} // namespace Engine
@@ -15,8 +15,9 @@ Box::Box(const vec3 &position, float length, float width, float height)
 }
 
 void Box::generatePoints() {
-  // Generate points, since we want hard edges we don't use indexing. Remember
-  // that y-axis is up.
+  // Generate points, hard edges need a vertex per face corner. optimize()
+  // merges the corners both triangles of a face share. Remember that y-axis
+  // is up.
   Point p0{mPosition + vec3(mLength, 0, 0)};
   Point p1{mPosition + vec3(mLength, mHeight, 0)};
   Point p2{mPosition + vec3(mLength, 0, mWidth)};
@@ -40,6 +41,8 @@ void Box::generatePoints() {
     vertexData.insert(vertexData.end(), {data1, data2, data3, data4, data5, data6});
   }
   setVertexData(vertexData);
+  setIndices({});
+  optimize();
   finalize();
 }
 
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <thread>
+
+#include <Engine/Icosphere.h>
+
+namespace Engine {
+namespace {
+
+/// Fewer items than this per thread and spawning costs more than it saves.
+constexpr size_t MinBatch = 4096;
+
+struct Edge {
+  uint32_t a, b;
+};
+
+/// Edge k of a triangle runs from vertex k to vertex k + 1.
+struct Triangle {
+  uint32_t v[3];
+  uint32_t e[3];
+};
+
+const float T = 1.61803398875f;
+const vec3 BasePositions[12] = {
+    {-1, T, 0}, {1, T, 0}, {-1, -T, 0}, {1, -T, 0},
+    {0, -1, T}, {0, 1, T}, {0, -1, -T}, {0, 1, -T},
+    {T, 0, -1}, {T, 0, 1}, {-T, 0, -1}, {-T, 0, 1}};
+const uint32_t BaseFaces[20][3] = {
+    // 5 faces around point 0
+    {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+    // 5 adjacent faces
+    {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+    // 5 faces around point 3
+    {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+    // 5 adjacent faces
+    {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+
+/// Run \p fn over [0, \p count) split into contiguous ranges, one per
+/// thread.
+template <typename F> void parallelFor(size_t count, uint threads, F &&fn) {
+  size_t chunks =
+      std::min<size_t>(threads, (count + MinBatch - 1) / MinBatch);
+  if (chunks <= 1) {
+    fn(size_t(0), count);
+    return;
+  }
+  size_t step = (count + chunks - 1) / chunks;
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (size_t begin = step; begin < count; begin += step)
+    workers.emplace_back(fn, begin, std::min(count, begin + step));
+  fn(size_t(0), step);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+} // namespace
+
+float Icosphere::error() const {
+  float nearest = 1.0f;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const vec3 &a = positions[indices[i]], &b = positions[indices[i + 1]],
+               &c = positions[indices[i + 2]];
+    vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+    nearest = std::min(nearest, glm::dot(normal, a));
+  }
+  return 1.0f - nearest;
+}
+
+Icosphere Icosphere::generate(int level, uint threads) {
+  level = std::clamp(level, 0, MaxLevel);
+  // Looking the core count up is not free, do it once.
+  static const uint cores =
+      std::max(1u, std::thread::hardware_concurrency());
+  if (threads == 0)
+    threads = cores;
+
+  Icosphere sphere;
+  sphere.positions.resize(numVertices(level));
+  sphere.indices.resize(3 * numFaces(level));
+  for (int i = 0; i < 12; i++)
+    sphere.positions[i] = glm::normalize(BasePositions[i]);
+  if (level == 0) {
+    std::copy(&BaseFaces[0][0], &BaseFaces[0][0] + 60,
+              sphere.indices.begin());
+    return sphere;
+  }
+
+  // Triangles and edges of the level being split and the next one. The last
+  // pass writes indices instead, so these only ever hold level - 1.
+  std::vector<Triangle> faces(numFaces(level - 1)), nextFaces(faces.size());
+  std::vector<Edge> edges(numEdges(level - 1)), nextEdges(edges.size());
+  faces.resize(20);
+  edges.clear();
+  for (int f = 0; f < 20; f++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t a = BaseFaces[f][k], b = BaseFaces[f][(k + 1) % 3];
+      auto edge = std::find_if(edges.begin(), edges.end(), [&](Edge e) {
+        return (e.a == a && e.b == b) || (e.a == b && e.b == a);
+      });
+      faces[f].v[k] = a;
+      faces[f].e[k] = uint32_t(edge - edges.begin());
+      if (edge == edges.end())
+        edges.push_back({a, b});
+    }
+  }
+
+  auto *positions = sphere.positions.data();
+  auto *indices = sphere.indices.data();
+  for (int l = 0; l < level; l++) {
+    bool last = l == level - 1;
+    uint32_t numVerts = uint32_t(numVertices(l));
+    size_t numEdgesL = numEdges(l), numFacesL = numFaces(l);
+    nextFaces.resize(last ? 0 : 4 * numFacesL);
+    nextEdges.resize(last ? 0 : numEdges(l + 1));
+
+    // Edge e is split at the new vertex numVerts + e, its halves become
+    // edges 2e, starting at e.a, and 2e + 1.
+    parallelFor(numEdgesL, threads, [&](size_t begin, size_t end) {
+      for (size_t e = begin; e < end; e++) {
+        Edge edge = edges[e];
+        uint32_t mid = numVerts + uint32_t(e);
+        positions[mid] =
+            glm::normalize(positions[edge.a] + positions[edge.b]);
+        if (!last) {
+          nextEdges[2 * e] = {edge.a, mid};
+          nextEdges[2 * e + 1] = {mid, edge.b};
+        }
+      }
+    });
+
+    // Each corner keeps its own orientation, so the four children are wound
+    // like their parent. The three inner edges of face f follow the split
+    // edges.
+    parallelFor(numFacesL, threads, [&](size_t begin, size_t end) {
+      for (size_t f = begin; f < end; f++) {
+        const Triangle &face = faces[f];
+        const uint32_t *v = face.v, *e = face.e;
+        uint32_t m[3] = {numVerts + e[0], numVerts + e[1], numVerts + e[2]};
+        if (last) {
+          uint32_t children[12] = {v[0], m[0], m[2], v[1], m[1], m[0],
+                                   v[2], m[2], m[1], m[0], m[1], m[2]};
+          std::copy(children, children + 12, indices + 12 * f);
+          continue;
+        }
+        // The half of edge k that ends at \p corner.
+        auto half = [&](int k, uint32_t corner) {
+          return 2 * e[k] + (edges[e[k]].a == corner ? 0 : 1);
+        };
+        uint32_t inner = uint32_t(2 * numEdgesL + 3 * f);
+        nextEdges[inner] = {m[0], m[2]};
+        nextEdges[inner + 1] = {m[1], m[0]};
+        nextEdges[inner + 2] = {m[2], m[1]};
+        Triangle *children = &nextFaces[4 * f];
+        children[0] = {{v[0], m[0], m[2]},
+                       {half(0, v[0]), inner, half(2, v[0])}};
+        children[1] = {{v[1], m[1], m[0]},
+                       {half(1, v[1]), inner + 1, half(0, v[1])}};
+        children[2] = {{v[2], m[2], m[1]},
+                       {half(2, v[2]), inner + 2, half(1, v[2])}};
+        children[3] = {{m[0], m[1], m[2]}, {inner + 1, inner + 2, inner}};
+      }
+    });
+
+    faces.swap(nextFaces);
+    edges.swap(nextEdges);
+  }
+  return sphere;
+}
+
+} // namespace Engine
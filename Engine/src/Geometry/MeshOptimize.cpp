@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <Engine/MeshOptimize.h>
+
+namespace Engine {
+namespace {
+
+/// Forsyth's vertex scoring, tuned for a 32 entry LRU cache. It is only a
+/// model, orders built for it also do well on smaller FIFO caches.
+constexpr int ScoreCacheSize = 32;
+constexpr int MaxValence = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriangleScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+/// Scores by cache position, the last slot for vertices outside the cache,
+/// and by the number of triangles still to draw.
+struct ScoreTable {
+  float cache[ScoreCacheSize + 1];
+  float valence[MaxValence];
+
+  ScoreTable() {
+    for (int i = 0; i < ScoreCacheSize; i++) {
+      // The last triangle's vertices score the same whatever their order,
+      // so it doesn't matter which one of them comes first.
+      cache[i] = i < 3 ? LastTriangleScore
+                       : std::pow(1.0f - float(i - 3) / (ScoreCacheSize - 3),
+                                  CacheDecayPower);
+    }
+    cache[ScoreCacheSize] = 0.0f;
+    valence[0] = 0.0f;
+    for (int i = 1; i < MaxValence; i++)
+      valence[i] = ValenceBoostScale * std::pow(float(i), -ValenceBoostPower);
+  }
+
+  inline float score(int position, uint32_t remaining) const {
+    if (remaining == 0)
+      return -1.0f;
+    return cache[position < 0 ? ScoreCacheSize : position] +
+           valence[std::min<uint32_t>(remaining, MaxValence - 1)];
+  }
+};
+
+/// FIFO post-transform cache, an entry is evicted \p size insertions after
+/// it was added.
+struct FifoCache {
+  std::vector<uint32_t> added;
+  uint32_t time;
+  uint32_t size;
+
+  FifoCache(size_t numVertices, uint32_t size)
+      : added(numVertices, 0), time(size + 1), size(size) {}
+
+  /// Whether \p vertex had to be transformed.
+  inline bool miss(uint32_t vertex) {
+    if (time - added[vertex] <= size)
+      return false;
+    added[vertex] = time++;
+    return true;
+  }
+  inline void clear() { time += size; }
+};
+
+constexpr uint32_t CacheSize = 16;
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t count,
+                                    size_t numVertices, uint cacheSize) {
+  VertexCacheStats stats;
+  if (count < 3)
+    return stats;
+  FifoCache cache(numVertices, cacheSize);
+  std::vector<uint8_t> used(numVertices, 0);
+  size_t misses = 0, numUsed = 0;
+  for (size_t i = 0; i < count; i++) {
+    numUsed += !used[indices[i]];
+    used[indices[i]] = 1;
+    misses += cache.miss(indices[i]);
+  }
+  stats.acmr = float(misses) / float(count / 3);
+  stats.atvr = float(misses) / float(numUsed);
+  return stats;
+}
+
+size_t deduplicateVertices(const void *vertices, size_t count, size_t stride,
+                           std::vector<uint32_t> &remap) {
+  auto *bytes = static_cast<const uint8_t *>(vertices);
+  remap.assign(count, 0);
+
+  // Open addressing over vertex numbers, kept at most half full.
+  size_t tableSize = 1;
+  while (tableSize < 2 * count)
+    tableSize *= 2;
+  std::vector<uint32_t> table(tableSize, UINT32_MAX);
+  uint32_t numUnique = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *vertex = bytes + i * stride;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t b = 0; b < stride; b++)
+      hash = (hash ^ vertex[b]) * 1099511628211ull;
+    for (size_t slot = hash & (tableSize - 1);;
+         slot = (slot + 1) & (tableSize - 1)) {
+      uint32_t entry = table[slot];
+      if (entry == UINT32_MAX) {
+        table[slot] = uint32_t(i);
+        remap[i] = numUnique++;
+        break;
+      }
+      if (std::memcmp(bytes + entry * stride, vertex, stride) == 0) {
+        remap[i] = remap[entry];
+        break;
+      }
+    }
+  }
+  return numUnique;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t count,
+                         size_t numVertices) {
+  static const ScoreTable scores;
+  size_t numTriangles = count / 3;
+  if (numTriangles < 2)
+    return;
+
+  // Triangles around each vertex, the first remaining[v] of them not drawn
+  // yet.
+  std::vector<uint32_t> offsets(numVertices + 1, 0), around(3 * numTriangles);
+  for (size_t i = 0; i < 3 * numTriangles; i++)
+    offsets[indices[i] + 1]++;
+  for (size_t v = 0; v < numVertices; v++)
+    offsets[v + 1] += offsets[v];
+  std::vector<uint32_t> remaining(numVertices, 0);
+  for (size_t i = 0; i < 3 * numTriangles; i++) {
+    uint32_t v = indices[i];
+    around[offsets[v] + remaining[v]++] = uint32_t(i / 3);
+  }
+
+  std::vector<float> vertexScore(numVertices);
+  for (size_t v = 0; v < numVertices; v++)
+    vertexScore[v] = scores.score(-1, remaining[v]);
+  std::vector<float> triangleScore(numTriangles);
+  std::vector<uint8_t> drawn(numTriangles, 0);
+
+  std::vector<uint32_t> result(3 * numTriangles);
+  uint32_t cache[ScoreCacheSize + 3];
+  int cacheCount = 0;
+  // Start from the triangle with the fewest neighbours, usually on a border.
+  size_t best = 0;
+  float bestScore = -1.0f;
+  for (size_t t = 0; t < numTriangles; t++) {
+    const uint32_t *tri = indices + 3 * t;
+    triangleScore[t] =
+        vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    if (triangleScore[t] > bestScore) {
+      best = t;
+      bestScore = triangleScore[t];
+    }
+  }
+  size_t next = 0;
+  for (size_t out = 0; out < numTriangles; out++) {
+    // Nothing in the cache has triangles left, carry on in input order.
+    if (best == SIZE_MAX) {
+      while (drawn[next])
+        next++;
+      best = next;
+    }
+    const uint32_t *tri = indices + 3 * best;
+    std::copy(tri, tri + 3, result.begin() + 3 * out);
+    drawn[best] = 1;
+    for (int k = 0; k < 3; k++) {
+      uint32_t *list = &around[offsets[tri[k]]];
+      uint32_t &live = remaining[tri[k]];
+      auto *iter = std::find(list, list + live, uint32_t(best));
+      if (iter != list + live)
+        std::swap(*iter, list[--live]);
+    }
+
+    // The triangle's vertices move to the front, the rest shift back.
+    uint32_t updated[ScoreCacheSize + 3];
+    int numUpdated = 0;
+    for (int k = 0; k < 3; k++) {
+      if (std::find(updated, updated + numUpdated, tri[k]) ==
+          updated + numUpdated)
+        updated[numUpdated++] = tri[k];
+    }
+    for (int i = 0; i < cacheCount; i++) {
+      if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+        updated[numUpdated++] = cache[i];
+    }
+    cacheCount = std::min(numUpdated, ScoreCacheSize);
+    std::copy(updated, updated + cacheCount, cache);
+
+    // Only triangles around these vertices changed score, by the change in
+    // the vertex's.
+    best = SIZE_MAX;
+    bestScore = -1.0f;
+    for (int i = 0; i < numUpdated; i++) {
+      uint32_t v = updated[i];
+      float score = scores.score(i < ScoreCacheSize ? i : -1, remaining[v]);
+      float delta = score - vertexScore[v];
+      vertexScore[v] = score;
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        uint32_t t = around[offsets[v] + j];
+        triangleScore[t] += delta;
+        if (i < ScoreCacheSize && triangleScore[t] > bestScore) {
+          best = t;
+          bestScore = triangleScore[t];
+        }
+      }
+    }
+  }
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t count, const void *positions,
+                      size_t numVertices, size_t stride, float threshold) {
+  size_t numTriangles = count / 3;
+  if (numTriangles < 2)
+    return;
+  auto position = [&](uint32_t v) {
+    vec3 p;
+    std::memcpy(&p, static_cast<const uint8_t *>(positions) + v * stride,
+                sizeof(vec3));
+    return p;
+  };
+  auto before = analyzeVertexCache(indices, count, numVertices, CacheSize);
+  float target = before.acmr * threshold;
+
+  // Split as soon as the cluster so far beats the target starting from a
+  // cold cache, then it can go anywhere in the order.
+  std::vector<size_t> clusters{0};
+  FifoCache cache(numVertices, CacheSize);
+  size_t misses = 0;
+  for (size_t t = 0; t < numTriangles; t++) {
+    const uint32_t *tri = indices + 3 * t;
+    size_t size = t - clusters.back();
+    if (size > 0 && float(misses) <= target * float(size)) {
+      clusters.push_back(t);
+      cache.clear();
+      misses = 0;
+    }
+    for (int k = 0; k < 3; k++)
+      misses += cache.miss(tri[k]);
+  }
+  clusters.push_back(numTriangles);
+
+  // Clusters facing away from the centre are drawn first, on closed and
+  // mostly convex meshes they hide what is behind them.
+  struct Cluster {
+    size_t begin, end;
+    vec3 centroid{0.0f}, normal{0.0f};
+    float area = 0.0f;
+    float key = 0.0f;
+  };
+  std::vector<Cluster> sorted(clusters.size() - 1);
+  vec3 centre{0.0f};
+  float totalArea = 0.0f;
+  for (size_t i = 0; i + 1 < clusters.size(); i++) {
+    auto &cluster = sorted[i];
+    cluster.begin = clusters[i];
+    cluster.end = clusters[i + 1];
+    for (size_t t = cluster.begin; t < cluster.end; t++) {
+      vec3 a = position(indices[3 * t]), b = position(indices[3 * t + 1]),
+           c = position(indices[3 * t + 2]);
+      vec3 n = glm::cross(b - a, c - a);
+      float area = glm::length(n);
+      cluster.centroid += area * (a + b + c) / 3.0f;
+      cluster.normal += n;
+      cluster.area += area;
+    }
+    centre += cluster.centroid;
+    totalArea += cluster.area;
+    if (cluster.area > 0.0f)
+      cluster.centroid /= cluster.area;
+  }
+  if (totalArea > 0.0f)
+    centre /= totalArea;
+  for (auto &cluster : sorted) {
+    float length = glm::length(cluster.normal);
+    if (length > 0.0f)
+      cluster.key = glm::dot(cluster.centroid - centre, cluster.normal) /
+                    length;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Cluster &l, const Cluster &r) {
+                     return l.key > r.key;
+                   });
+
+  std::vector<uint32_t> result;
+  result.reserve(3 * numTriangles);
+  for (const auto &cluster : sorted) {
+    result.insert(result.end(), indices + 3 * cluster.begin,
+                  indices + 3 * cluster.end);
+  }
+  auto after =
+      analyzeVertexCache(result.data(), result.size(), numVertices, CacheSize);
+  if (after.acmr <= target)
+    std::copy(result.begin(), result.end(), indices);
+}
+
+size_t optimizeVertexFetch(const uint32_t *indices, size_t count,
+                           size_t numVertices, std::vector<uint32_t> &remap) {
+  remap.assign(numVertices, UINT32_MAX);
+  uint32_t numUsed = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (remap[indices[i]] == UINT32_MAX)
+      remap[indices[i]] = numUsed++;
+  }
+  return numUsed;
+}
+
+size_t optimizeMesh(void *vertices, size_t count, size_t stride,
+                    std::vector<uint32_t> &indices,
+                    const std::vector<std::pair<uint32_t, uint32_t>> &ranges,
+                    bool overdraw) {
+  auto *bytes = static_cast<uint8_t *>(vertices);
+  std::vector<uint32_t> remap;
+  size_t numVertices = deduplicateVertices(bytes, count, stride, remap);
+  std::vector<uint8_t> unique(numVertices * stride);
+  for (size_t v = 0; v < count; v++)
+    std::memcpy(&unique[remap[v] * stride], bytes + v * stride, stride);
+  if (indices.empty()) {
+    indices = remap;
+  } else {
+    for (auto &index : indices)
+      index = remap[index];
+  }
+
+  auto optimizeRange = [&](uint32_t first, uint32_t numIndices) {
+    optimizeVertexCache(indices.data() + first, numIndices, numVertices);
+    if (overdraw)
+      optimizeOverdraw(indices.data() + first, numIndices, unique.data(),
+                       numVertices, stride);
+  };
+  if (ranges.empty())
+    optimizeRange(0, uint32_t(indices.size()));
+  for (const auto &range : ranges)
+    optimizeRange(range.first, range.second);
+
+  numVertices =
+      optimizeVertexFetch(indices.data(), indices.size(), numVertices, remap);
+  for (size_t v = 0; v < remap.size(); v++) {
+    if (remap[v] != UINT32_MAX)
+      std::memcpy(bytes + remap[v] * stride, &unique[v * stride], stride);
+  }
+  for (auto &index : indices)
+    index = remap[index];
+  return numVertices;
+}
+
+} // namespace Engine
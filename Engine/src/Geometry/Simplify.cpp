@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include <Engine/Simplify.h>
+
+namespace Engine {
+namespace {
+
+/// Sum of squared distances to a set of planes, weighted by triangle area.
+/// Kept in double, the terms cancel out near the surface.
+struct Quadric {
+  double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0;
+  double ad = 0, bd = 0, cd = 0, d2 = 0;
+  double weight = 0;
+
+  static Quadric plane(const vec3 &n, float d, float weight) {
+    Quadric q;
+    q.a2 = weight * n.x * n.x;
+    q.b2 = weight * n.y * n.y;
+    q.c2 = weight * n.z * n.z;
+    q.ab = weight * n.x * n.y;
+    q.ac = weight * n.x * n.z;
+    q.bc = weight * n.y * n.z;
+    q.ad = weight * n.x * d;
+    q.bd = weight * n.y * d;
+    q.cd = weight * n.z * d;
+    q.d2 = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &q) {
+    a2 += q.a2, b2 += q.b2, c2 += q.c2, ab += q.ab, ac += q.ac, bc += q.bc;
+    ad += q.ad, bd += q.bd, cd += q.cd, d2 += q.d2, weight += q.weight;
+    return *this;
+  }
+
+  /// Weighted squared distance of \p p to the planes.
+  double evaluate(const vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a2 * x * x + b2 * y * y + c2 * z * z +
+               2 * (ab * x * y + ac * x * z + bc * y * z) +
+               2 * (ad * x + bd * y + cd * z) + d2;
+    return std::max(e, 0.0);
+  }
+};
+
+/// Smallest cosine between a triangle's normal before and after a
+/// collapse, about 60 degrees.
+constexpr float MinCosine = 0.5f;
+
+struct Collapse {
+  uint32_t from, to;
+  double cost;
+  float distance;
+};
+
+inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+  return uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+}
+
+/// Vertices that must not move: the ends of edges used by a single
+/// triangle, and vertices whose position another vertex shares.
+std::vector<uint8_t> findLocked(const std::vector<vec3> &positions,
+                                const std::vector<uint32_t> &indices) {
+  std::vector<uint8_t> locked(positions.size(), 0);
+
+  std::unordered_map<uint64_t, uint32_t> first;
+  first.reserve(positions.size());
+  for (uint32_t i = 0; i < positions.size(); i++) {
+    uint32_t bits[3];
+    std::memcpy(bits, &positions[i], sizeof(bits));
+    uint64_t key = (uint64_t(bits[0]) * 73856093) ^
+                   (uint64_t(bits[1]) * 19349663) ^
+                   (uint64_t(bits[2]) * 83492791);
+    auto iter = first.emplace(key, i).first;
+    if (iter->second != i && positions[iter->second] == positions[i])
+      locked[i] = locked[iter->second] = 1;
+  }
+
+  std::vector<uint64_t> directed;
+  directed.reserve(indices.size());
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (int k = 0; k < 3; k++)
+      directed.push_back(uint64_t(indices[i + k]) << 32 |
+                         indices[i + (k + 1) % 3]);
+  }
+  std::sort(directed.begin(), directed.end());
+  for (uint64_t edge : directed) {
+    uint64_t reverse = edge << 32 | edge >> 32;
+    if (!std::binary_search(directed.begin(), directed.end(), reverse))
+      locked[edge >> 32] = locked[uint32_t(edge)] = 1;
+  }
+  return locked;
+}
+
+/// Whether moving \p from onto \p to turns any of its other triangles over,
+/// or tilts one far enough to stand it on edge.
+bool flips(const std::vector<vec3> &positions, const uint32_t *triangles,
+           const uint32_t *begin, const uint32_t *end, uint32_t from,
+           uint32_t to) {
+  for (auto *t = begin; t != end; t++) {
+    const uint32_t *tri = triangles + 3 * *t;
+    if (tri[0] == to || tri[1] == to || tri[2] == to)
+      continue;
+    vec3 before[3], after[3];
+    for (int k = 0; k < 3; k++) {
+      before[k] = positions[tri[k]];
+      after[k] = tri[k] == from ? positions[to] : before[k];
+    }
+    vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+    vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+    if (glm::dot(n0, n1) <= MinCosine * glm::length(n0) * glm::length(n1))
+      return true;
+  }
+  return false;
+}
+
+/// Link condition: the only vertices next to both \p from and \p to may be
+/// the far corners of the triangles on their edge. Otherwise the collapse
+/// pinches the surface and leaves folded over duplicate triangles.
+bool keepsManifold(const uint32_t *triangles, const uint32_t *around,
+                   const std::vector<uint32_t> &offsets, uint32_t from,
+                   uint32_t to) {
+  uint32_t common[64];
+  int numCommon = 0, numShared = 0;
+  auto ring = [&](uint32_t v, auto &&visit) {
+    for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+      const uint32_t *tri = triangles + 3 * around[i];
+      for (int k = 0; k < 3; k++)
+        visit(tri[k], tri);
+    }
+  };
+  ring(from, [&](uint32_t v, const uint32_t *) {
+    if (v == to)
+      numShared++;
+  });
+  ring(from, [&](uint32_t a, const uint32_t *) {
+    if (a == from || a == to)
+      return;
+    bool seen = std::find(common, common + numCommon, a) != common + numCommon;
+    if (seen)
+      return;
+    bool shared = false;
+    ring(to, [&](uint32_t b, const uint32_t *) { shared |= a == b; });
+    if (shared && numCommon < 64)
+      common[numCommon++] = a;
+  });
+  return numCommon <= numShared;
+}
+
+} // namespace
+
+std::vector<uint32_t> simplify(const void *positions, size_t count,
+                               size_t stride,
+                               const std::vector<uint32_t> &indices,
+                               size_t targetIndices, float &error) {
+  error = 0.0f;
+  std::vector<vec3> points(count);
+  for (size_t i = 0; i < count; i++) {
+    std::memcpy(&points[i], static_cast<const uint8_t *>(positions) +
+                                i * stride,
+                sizeof(vec3));
+  }
+
+  std::vector<Quadric> quadrics(count);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const vec3 &a = points[indices[i]], &b = points[indices[i + 1]],
+               &c = points[indices[i + 2]];
+    vec3 n = glm::cross(b - a, c - a);
+    float length = glm::length(n);
+    if (length == 0.0f)
+      continue;
+    n /= length;
+    auto q = Quadric::plane(n, -glm::dot(n, a), 0.5f * length);
+    for (int k = 0; k < 3; k++)
+      quadrics[indices[i + k]] += q;
+  }
+  auto locked = findLocked(points, indices);
+
+  std::vector<uint32_t> result = indices;
+  std::vector<uint32_t> collapsed(count), offsets(count + 1), around;
+  std::vector<uint64_t> edges;
+  std::vector<Collapse> candidates;
+  std::vector<uint8_t> touched(count);
+  while (result.size() > targetIndices) {
+    size_t numTriangles = result.size() / 3;
+
+    // Triangles around each vertex.
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t v : result)
+      offsets[v + 1]++;
+    for (size_t v = 0; v < count; v++)
+      offsets[v + 1] += offsets[v];
+    around.resize(result.size());
+    {
+      auto fill = offsets;
+      for (size_t i = 0; i < result.size(); i++)
+        around[fill[result[i]]++] = uint32_t(i / 3);
+    }
+
+    // Each edge once, collapsed towards whichever end is cheaper.
+    edges.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int k = 0; k < 3; k++)
+        edges.push_back(edgeKey(result[i + k], result[i + (k + 1) % 3]));
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    candidates.clear();
+    for (uint64_t edge : edges) {
+      uint32_t a = uint32_t(edge >> 32), b = uint32_t(edge);
+      Quadric q = quadrics[a];
+      q += quadrics[b];
+      double toB = locked[a] ? HUGE_VAL : q.evaluate(points[b]);
+      double toA = locked[b] ? HUGE_VAL : q.evaluate(points[a]);
+      if (toB == HUGE_VAL && toA == HUGE_VAL)
+        continue;
+      double cost = std::min(toB, toA);
+      float distance = float(std::sqrt(cost / std::max(q.weight, 1e-20)));
+      candidates.push_back(toB <= toA ? Collapse{a, b, cost, distance}
+                                      : Collapse{b, a, cost, distance});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse &l, const Collapse &r) {
+                return l.cost < r.cost;
+              });
+
+    // Cheapest first. A collapse freezes the ring around it for the rest of
+    // the pass, so the flip tests stay valid.
+    for (size_t v = 0; v < count; v++)
+      collapsed[v] = uint32_t(v);
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t toRemove = (result.size() - targetIndices + 2) / 3;
+    size_t removed = 0;
+    for (const auto &c : candidates) {
+      if (removed >= toRemove)
+        break;
+      if (touched[c.from] || touched[c.to])
+        continue;
+      const uint32_t *begin = around.data() + offsets[c.from];
+      const uint32_t *end = around.data() + offsets[c.from + 1];
+      if (!keepsManifold(result.data(), around.data(), offsets, c.from,
+                         c.to) ||
+          flips(points, result.data(), begin, end, c.from, c.to))
+        continue;
+      for (auto *t = begin; t != end; t++) {
+        const uint32_t *tri = &result[3 * *t];
+        bool shared = tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+        removed += shared;
+        for (int k = 0; k < 3; k++)
+          touched[tri[k]] = 1;
+      }
+      collapsed[c.from] = c.to;
+      quadrics[c.to] += quadrics[c.from];
+      error = std::max(error, c.distance);
+    }
+    if (removed == 0)
+      break;
+
+    size_t out = 0;
+    for (size_t t = 0; t < numTriangles; t++) {
+      uint32_t a = collapsed[result[3 * t]], b = collapsed[result[3 * t + 1]],
+               c = collapsed[result[3 * t + 2]];
+      if (a == b || b == c || c == a)
+        continue;
+      result[out++] = a;
+      result[out++] = b;
+      result[out++] = c;
+    }
+    result.resize(out);
+  }
+  return result;
+}
+
+} // namespace Engine
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <Engine/VertexFormats.h>
+
+namespace Engine {
+
+uint16_t toHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+  // Rebias the exponent from 127 to 15 and round the dropped 13 bits.
+  uint32_t half = (magnitude - (112u << 23) + (1u << 12)) >> 13;
+  if (magnitude < (113u << 23))
+    half = 0; // Below the smallest normal half.
+  if (magnitude >= (143u << 23))
+    half = 0x7c00;
+  if (magnitude > (255u << 23))
+    half = 0x7e00;
+  return uint16_t(sign | half);
+}
+
+float fromHalf(uint16_t value) {
+  uint32_t sign = uint32_t(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  if (exponent == 0) {
+    float subnormal = std::ldexp(float(mantissa), -24);
+    return sign ? -subnormal : subnormal;
+  }
+  uint32_t bits = sign | mantissa << 13 |
+                  (exponent == 31 ? 0x7f800000 : (exponent + 112) << 23);
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+template <typename T> T toSNorm(float value) {
+  constexpr float max = float(std::numeric_limits<T>::max());
+  return T(std::lround(std::clamp(value, -1.0f, 1.0f) * max));
+}
+
+template <typename T> float fromSNorm(T value) {
+  constexpr float max = float(std::numeric_limits<T>::max());
+  return std::max(float(value) / max, -1.0f);
+}
+
+template int8_t toSNorm<int8_t>(float);
+template int16_t toSNorm<int16_t>(float);
+template float fromSNorm<int8_t>(int8_t);
+template float fromSNorm<int16_t>(int16_t);
+
+Packed1010102 packSNorm1010102(const vec4 &value) {
+  auto field = [](float v, float max, uint32_t mask) {
+    return uint32_t(std::lround(std::clamp(v, -1.0f, 1.0f) * max)) & mask;
+  };
+  return {field(value.x, 511.0f, 0x3ff) |
+          field(value.y, 511.0f, 0x3ff) << 10 |
+          field(value.z, 511.0f, 0x3ff) << 20 |
+          field(value.w, 1.0f, 0x3) << 30};
+}
+
+vec4 unpackSNorm1010102(Packed1010102 packed) {
+  // Shift each field to the top, the arithmetic shift back sign extends it.
+  auto field = [&](int shift, int width, float max) {
+    int32_t v = int32_t(packed.bits << (32 - shift - width)) >> (32 - width);
+    return std::max(float(v) / max, -1.0f);
+  };
+  return {field(0, 10, 511.0f), field(10, 10, 511.0f),
+          field(20, 10, 511.0f), field(30, 2, 1.0f)};
+}
+
+vec2 octEncode(const vec3 &normal) {
+  vec3 p = normal / (std::abs(normal.x) + std::abs(normal.y) +
+                     std::abs(normal.z));
+  if (p.z >= 0.0f)
+    return vec2(p.x, p.y);
+  // Fold the lower half over the diagonals.
+  return vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+              (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+vec3 octDecode(const vec2 &encoded) {
+  vec3 n(encoded.x, encoded.y,
+         1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  float fold = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -fold : fold;
+  n.y += n.y >= 0.0f ? -fold : fold;
+  return glm::normalize(n);
+}
+
+} // namespace Engine
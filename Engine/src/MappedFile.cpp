@@ -0,0 +1,151 @@
+#include <utility>
+
+#include <Engine/MappedFile.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Engine {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return;
+  }
+  mSize = size_t(size.QuadPart);
+  mOpen = true;
+  if (mSize > 0 && mSize < MapThreshold) {
+    mBuffer.resize(mSize);
+    DWORD count = 0;
+    if (ReadFile(file, mBuffer.data(), DWORD(mSize), &count, nullptr) &&
+        count == mSize) {
+      mData = mBuffer.data();
+    } else {
+      mBuffer.clear();
+      mOpen = false;
+      mSize = 0;
+    }
+    CloseHandle(file);
+    return;
+  }
+  mFile = file;
+  // Mapping an empty file fails, there is nothing to map anyway.
+  if (mSize == 0)
+    return;
+  mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mMapping)
+    mData = static_cast<const uint8_t *>(
+        MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+  if (!mData)
+    close();
+}
+
+void MappedFile::close() {
+  if (mData && mBuffer.empty())
+    UnmapViewOfFile(mData);
+  mBuffer.clear();
+  if (mMapping)
+    CloseHandle(mMapping);
+  if (mFile)
+    CloseHandle(mFile);
+  mData = nullptr;
+  mMapping = mFile = nullptr;
+  mSize = 0;
+  mOpen = false;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return;
+  }
+  mSize = size_t(info.st_size);
+  mOpen = true;
+  if (mSize > 0 && mSize < MapThreshold) {
+    mBuffer.resize(mSize);
+    size_t done = 0;
+    while (done < mSize) {
+      ssize_t count = read(fd, mBuffer.data() + done, mSize - done);
+      if (count <= 0)
+        break;
+      done += size_t(count);
+    }
+    if (done == mSize) {
+      mData = mBuffer.data();
+    } else {
+      mBuffer.clear();
+      mOpen = false;
+      mSize = 0;
+    }
+  } else if (mSize > 0) {
+    void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      mOpen = false;
+      mSize = 0;
+    } else {
+      // Loaders read front to back, once. Start paging the file in now
+      // and read ahead aggressively.
+      madvise(data, mSize, MADV_SEQUENTIAL);
+      madvise(data, mSize, MADV_WILLNEED);
+      mData = static_cast<const uint8_t *>(data);
+    }
+  }
+  // The mapping keeps the file alive.
+  ::close(fd);
+}
+
+void MappedFile::close() {
+  if (mData && mBuffer.empty())
+    munmap(const_cast<uint8_t *>(mData), mSize);
+  mBuffer.clear();
+  mData = nullptr;
+  mSize = 0;
+  mOpen = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this == &other)
+    return *this;
+  close();
+  mData = std::exchange(other.mData, nullptr);
+  mBuffer = std::move(other.mBuffer);
+  other.mBuffer.clear();
+  mSize = std::exchange(other.mSize, 0);
+  mOpen = std::exchange(other.mOpen, false);
+#ifdef _WIN32
+  mFile = std::exchange(other.mFile, nullptr);
+  mMapping = std::exchange(other.mMapping, nullptr);
+#endif
+  return *this;
+}
+
+} // namespace Engine
@@ -0,0 +1,194 @@
+#include <cstring>
+
+#include <Engine/GLStateCache.h>
+
+namespace Engine {
+
+bool GLStateCache::hasExtension(const char *name) {
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (GLint i = 0; i < numExtensions; i++) {
+    auto *ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (ext && std::strcmp(ext, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+int GLStateCache::bufferIndex(GLenum target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return ArrayBuffer;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return ElementBuffer;
+  case GL_UNIFORM_BUFFER:
+    return UniformBuffer;
+  }
+  return -1;
+}
+
+int GLStateCache::textureIndex(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return Texture2D;
+  case GL_TEXTURE_CUBE_MAP:
+    return TextureCube;
+  }
+  return -1;
+}
+
+int GLStateCache::capabilityIndex(GLenum cap) {
+  switch (cap) {
+  case GL_DEPTH_TEST:
+    return DepthTest;
+  case GL_DEPTH_CLAMP:
+    return DepthClamp;
+  case GL_BLEND:
+    return Blend;
+  case GL_CULL_FACE:
+    return CullFace;
+  case GL_SCISSOR_TEST:
+    return ScissorTest;
+  case GL_STENCIL_TEST:
+    return StencilTest;
+  }
+  return -1;
+}
+
+void GLStateCache::invalidate() {
+  mProgram = Unknown;
+  mVertexArray = Unknown;
+  mFramebuffer = Unknown;
+  mBuffers.fill(Unknown);
+  mActiveUnit = Unknown;
+  for (auto &unit : mTextures)
+    unit.fill(Unknown);
+  mCapabilities.fill(-1);
+  mDepthMask = -1;
+  mDepthFunc = Unknown;
+  mBlendSrc = mBlendDst = Unknown;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+  if (update(mProgram, program))
+    glUseProgram(program);
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+  if (update(mVertexArray, vao)) {
+    glBindVertexArray(vao);
+    // The element buffer binding is part of the VAO.
+    mBuffers[ElementBuffer] = Unknown;
+  }
+}
+
+void GLStateCache::bindFramebuffer(GLuint fbo) {
+  if (update(mFramebuffer, fbo))
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+  int index = bufferIndex(target);
+  if (index < 0) {
+    mCounters.issued++;
+    glBindBuffer(target, buffer);
+  } else if (update(mBuffers[index], buffer)) {
+    glBindBuffer(target, buffer);
+  }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index,
+                                  GLuint buffer) {
+  // Indexed bindings are rarely rebound, always issue but remember that the
+  // generic binding point changed as a side effect.
+  mCounters.issued++;
+  glBindBufferBase(target, index, buffer);
+  int generic = bufferIndex(target);
+  if (generic >= 0)
+    mBuffers[generic] = buffer;
+}
+
+void GLStateCache::bindTexture(uint unit, GLenum target, GLuint texture) {
+  int index = textureIndex(target);
+  if (index < 0 || unit >= MaxTextureUnits) {
+    mCounters.issued++;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    mActiveUnit = unit;
+    glBindTexture(target, texture);
+    return;
+  }
+  if (!update(mTextures[unit][index], texture))
+    return;
+  if (mActiveUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    mActiveUnit = unit;
+  }
+  glBindTexture(target, texture);
+}
+
+void GLStateCache::setCapability(GLenum cap, bool enabled) {
+  int index = capabilityIndex(cap);
+  if (index < 0) {
+    mCounters.issued++;
+  } else if (!update(mCapabilities[index], int8_t(enabled))) {
+    return;
+  }
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+}
+
+void GLStateCache::depthMask(bool write) {
+  if (update(mDepthMask, int8_t(write)))
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLStateCache::depthFunc(GLenum func) {
+  if (update(mDepthFunc, func))
+    glDepthFunc(func);
+}
+
+void GLStateCache::blendFunc(GLenum src, GLenum dst) {
+  if (mBlendSrc == src && mBlendDst == dst) {
+    mCounters.elided++;
+    return;
+  }
+  mBlendSrc = src;
+  mBlendDst = dst;
+  mCounters.issued++;
+  glBlendFunc(src, dst);
+}
+
+void GLStateCache::deleteBuffer(GLuint buffer) {
+  glDeleteBuffers(1, &buffer);
+  for (auto &bound : mBuffers) {
+    if (bound == buffer)
+      bound = 0;
+  }
+}
+
+void GLStateCache::deleteProgram(GLuint program) {
+  glDeleteProgram(program);
+  // A program in use is only flagged for deletion and stays current.
+}
+
+void GLStateCache::deleteTexture(GLuint texture) {
+  glDeleteTextures(1, &texture);
+  for (auto &unit : mTextures) {
+    for (auto &bound : unit) {
+      if (bound == texture)
+        bound = 0;
+    }
+  }
+}
+
+void GLStateCache::deleteVertexArray(GLuint vao) {
+  glDeleteVertexArrays(1, &vao);
+  if (mVertexArray == vao) {
+    mVertexArray = 0;
+    mBuffers[ElementBuffer] = Unknown;
+  }
+}
+
+} // namespace Engine
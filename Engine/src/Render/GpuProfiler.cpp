@@ -0,0 +1,241 @@
+#include <algorithm>
+
+#include <Engine/GpuProfiler.h>
+#include <Engine/Log.h>
+#include <imgui/imgui.h>
+
+namespace Engine {
+
+namespace {
+
+inline float toMs(GLuint64 begin, GLuint64 end) {
+  return end > begin ? float(end - begin) / 1e6f : 0.0f;
+}
+
+/// Stable colour per scope name so a pass keeps its colour across frames.
+ImU32 scopeColour(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (const char *c = name; *c; c++)
+    hash = (hash ^ uint8_t(*c)) * 16777619u;
+  float hue = float(hash % 360) / 360.0f;
+  float r, g, b;
+  ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.8f, r, g, b);
+  return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+}
+
+} // namespace
+
+void GpuProfiler::History::add(float ms) {
+  if (count == HistoryLength)
+    sum -= samples[next];
+  else
+    count++;
+  samples[next] = ms;
+  sum += ms;
+  next = (next + 1) % HistoryLength;
+}
+
+GLuint GpuProfiler::timestamp() {
+  GLuint query;
+  if (mFreeQueries.empty()) {
+    glGenQueries(1, &query);
+  } else {
+    query = mFreeQueries.back();
+    mFreeQueries.pop_back();
+  }
+  glQueryCounter(query, GL_TIMESTAMP);
+  return query;
+}
+
+uint64_t GpuProfiler::beginFrame() {
+  collect(false);
+  mOpenScopes.clear();
+  mCurrent.scopes.clear();
+  mCurrent.index = mFrameIndex;
+  // If the GPU is that far behind, skip the frame rather than block on it.
+  mRecording = mEnabled && mPending.size() < MaxFramesInFlight;
+  if (mRecording)
+    mCurrent.begin = timestamp();
+  return mFrameIndex++;
+}
+
+void GpuProfiler::endFrame() {
+  if (!mRecording)
+    return;
+  if (!mOpenScopes.empty()) {
+    LOG_ERROR("GPU scope %s still open at the end of the frame.",
+              mCurrent.scopes[mOpenScopes.back()].name);
+    while (!mOpenScopes.empty())
+      popScope();
+  }
+  mCurrent.end = timestamp();
+  mPending.push_back(std::move(mCurrent));
+  mCurrent = PendingFrame{};
+  mRecording = false;
+}
+
+void GpuProfiler::pushScope(const char *name) {
+  if (!mRecording)
+    return;
+  mOpenScopes.push_back(mCurrent.scopes.size());
+  mCurrent.scopes.push_back(
+      PendingScope{name, uint(mOpenScopes.size() - 1), timestamp(), 0});
+}
+
+void GpuProfiler::popScope() {
+  if (!mRecording || mOpenScopes.empty())
+    return;
+  mCurrent.scopes[mOpenScopes.back()].end = timestamp();
+  mOpenScopes.pop_back();
+}
+
+void GpuProfiler::flush() { collect(true); }
+
+void GpuProfiler::shutdown() {
+  collect(true);
+  // A frame still being recorded is dropped, open scopes have no end yet.
+  if (mRecording) {
+    mFreeQueries.push_back(mCurrent.begin);
+    for (auto &scope : mCurrent.scopes) {
+      mFreeQueries.push_back(scope.begin);
+      if (scope.end)
+        mFreeQueries.push_back(scope.end);
+    }
+    mOpenScopes.clear();
+    mCurrent = PendingFrame{};
+    mRecording = false;
+  }
+  if (!mFreeQueries.empty())
+    glDeleteQueries(GLsizei(mFreeQueries.size()), mFreeQueries.data());
+  mFreeQueries.clear();
+}
+
+void GpuProfiler::collect(bool wait) {
+  while (!mPending.empty()) {
+    auto &frame = mPending.front();
+    // The frame's last timestamp is written after all the others.
+    if (!wait) {
+      GLint available = 0;
+      glGetQueryObjectiv(frame.end, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        break;
+    }
+    resolve(frame);
+    mFreeQueries.push_back(frame.begin);
+    mFreeQueries.push_back(frame.end);
+    for (auto &scope : frame.scopes) {
+      mFreeQueries.push_back(scope.begin);
+      mFreeQueries.push_back(scope.end);
+    }
+    mPending.pop_front();
+  }
+}
+
+void GpuProfiler::resolve(const PendingFrame &frame) {
+  GLuint64 frameBegin = 0, frameEnd = 0;
+  glGetQueryObjectui64v(frame.begin, GL_QUERY_RESULT, &frameBegin);
+  glGetQueryObjectui64v(frame.end, GL_QUERY_RESULT, &frameEnd);
+
+  mLastFrame.index = frame.index;
+  mLastFrame.durationMs = toMs(frameBegin, frameEnd);
+  mLastFrame.scopes.clear();
+  mFrameHistory.add(mLastFrame.durationMs);
+  for (auto &pending : frame.scopes) {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(pending.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(pending.end, GL_QUERY_RESULT, &end);
+    Scope scope{pending.name, pending.depth, toMs(frameBegin, begin),
+                toMs(begin, end)};
+    mLastFrame.scopes.push_back(scope);
+
+    // Scopes come parents first, so the parent's path is already there.
+    if (mPathScratch.size() <= scope.depth)
+      mPathScratch.resize(scope.depth + 1);
+    auto &path = mPathScratch[scope.depth];
+    path = scope.depth ? mPathScratch[scope.depth - 1] + "/" : "";
+    path += scope.name;
+    mHistory[path].add(scope.durationMs);
+  }
+
+  if (mFrameCallback)
+    mFrameCallback(mLastFrame);
+}
+
+float GpuProfiler::getAverageMs(const std::string &path) const {
+  auto iter = mHistory.find(path);
+  if (iter == mHistory.end() || iter->second.count == 0)
+    return 0.0f;
+  return iter->second.sum / iter->second.count;
+}
+
+void GpuProfiler::draw(bool *p_open) {
+  if (!ImGui::Begin("GPU Profiler", p_open)) {
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Checkbox("Enabled", &mEnabled);
+  ImGui::SameLine();
+  float frameAverage =
+      mFrameHistory.count ? mFrameHistory.sum / mFrameHistory.count : 0.0f;
+  ImGui::Text("Frame %llu: %.3f ms (avg %.3f ms)",
+              (unsigned long long)mLastFrame.index, mLastFrame.durationMs,
+              frameAverage);
+  ImGui::Separator();
+
+  // Rolling averages, indented by nesting depth.
+  ImGui::Columns(3, "scopes");
+  ImGui::Text("Scope");
+  ImGui::NextColumn();
+  ImGui::Text("Last (ms)");
+  ImGui::NextColumn();
+  ImGui::Text("Avg (ms)");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  std::vector<std::string> path;
+  for (const auto &scope : mLastFrame.scopes) {
+    path.resize(scope.depth + 1);
+    path[scope.depth] =
+        (scope.depth ? path[scope.depth - 1] + "/" : "") + scope.name;
+    ImGui::Text("%*s%s", int(2 * scope.depth), "", scope.name);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", scope.durationMs);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", getAverageMs(path[scope.depth]));
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::Separator();
+
+  // Flame style timeline of the last frame, one row per nesting depth.
+  uint rows = 1;
+  for (const auto &scope : mLastFrame.scopes)
+    rows = std::max(rows, scope.depth + 1);
+  float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+  float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::InvisibleButton("timeline", ImVec2(width, rows * rowHeight));
+  auto *drawList = ImGui::GetWindowDrawList();
+  float scale = mLastFrame.durationMs > 0.0f ? width / mLastFrame.durationMs
+                                             : 0.0f;
+  ImVec2 mouse = ImGui::GetIO().MousePos;
+  for (const auto &scope : mLastFrame.scopes) {
+    ImVec2 min(origin.x + scope.startMs * scale,
+               origin.y + scope.depth * rowHeight);
+    ImVec2 max(std::max(min.x + scope.durationMs * scale, min.x + 1.0f),
+               min.y + rowHeight - 1.0f);
+    drawList->AddRectFilled(min, max, scopeColour(scope.name));
+    // Only label blocks wide enough to hold the text.
+    if (ImGui::CalcTextSize(scope.name).x < max.x - min.x - 4.0f) {
+      drawList->AddText(ImVec2(min.x + 2.0f, min.y),
+                        IM_COL32(0, 0, 0, 255), scope.name);
+    }
+    if (ImGui::IsItemHovered() && mouse.x >= min.x && mouse.x < max.x &&
+        mouse.y >= min.y && mouse.y < max.y) {
+      ImGui::SetTooltip("%s\n%.3f ms", scope.name, scope.durationMs);
+    }
+  }
+  ImGui::End();
+}
+
+} // namespace Engine
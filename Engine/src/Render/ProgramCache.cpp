@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include <Engine/GLStateCache.h>
+#include <Engine/Log.h>
+#include <Engine/ProgramCache.h>
+
+namespace Engine {
+
+namespace {
+
+constexpr uint32_t FileMagic = 0x50524f47; // "PROG"
+/// Bump when the file layout changes.
+constexpr uint32_t FileVersion = 1;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+};
+
+constexpr uint64_t FnvOffset = 14695981039346656037ull;
+
+/// 64-bit FNV-1a, continuing from \p hash.
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash) {
+  auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  return hash;
+}
+
+uint64_t hashString(const std::string &str, uint64_t hash) {
+  // Hash the length too so that moving text between stages changes the key.
+  uint64_t size = str.size();
+  hash = hashBytes(&size, sizeof(size), hash);
+  return hashBytes(str.data(), str.size(), hash);
+}
+
+std::string glString(GLenum name) {
+  auto *str = reinterpret_cast<const char *>(glGetString(name));
+  return str ? str : "";
+}
+
+} // namespace
+
+void ProgramCache::setDirectory(std::string directory) {
+  mDirectory = std::move(directory);
+}
+
+bool ProgramCache::isEnabled() {
+  if (!mEnabled)
+    return false;
+  if (mSupported < 0) {
+    GLint formats = 0;
+    bool available = glGetProgramBinary && glProgramBinary &&
+                     (gl3wIsSupported(4, 1) ||
+                      GLStateCache::hasExtension("GL_ARB_get_program_binary"));
+    if (available)
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    mSupported = formats > 0;
+    mDriverHash = hashString(glString(GL_VENDOR), FnvOffset);
+    mDriverHash = hashString(glString(GL_RENDERER), mDriverHash);
+    mDriverHash = hashString(glString(GL_VERSION), mDriverHash);
+    if (!mSupported)
+      LOG_INFO("Program binaries not supported, shader cache disabled.");
+  }
+  return mSupported;
+}
+
+uint64_t ProgramCache::key(const std::vector<std::string> &sources) {
+  isEnabled();
+  uint64_t hash = mDriverHash;
+  for (const auto &source : sources)
+    hash = hashString(source, hash);
+  return hash;
+}
+
+std::string ProgramCache::pathFor(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return (std::filesystem::path(mDirectory) / name).string();
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program) {
+  if (!isEnabled())
+    return false;
+  auto start = std::chrono::steady_clock::now();
+  auto path = pathFor(key);
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  FileHeader header;
+  std::vector<char> binary;
+  bool valid = bool(file.read(reinterpret_cast<char *>(&header),
+                              sizeof(header))) &&
+               header.magic == FileMagic && header.version == FileVersion &&
+               header.key == key;
+  if (valid) {
+    binary.resize(header.length);
+    valid = bool(file.read(binary.data(), binary.size()));
+  }
+  file.close();
+
+  GLint linked = GL_FALSE;
+  if (valid) {
+    glProgramBinary(program, header.format, binary.data(),
+                    GLsizei(binary.size()));
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  }
+  if (!linked) {
+    // Stale or truncated, recompile and let store() replace it.
+    mStats.rejected++;
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    LOG_DEBUG("Discarded cached program %s.", path.c_str());
+    return false;
+  }
+
+  std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  mStats.hits++;
+  mStats.loadMs += elapsed.count();
+  return true;
+}
+
+void ProgramCache::prepare(GLuint program) {
+  if (isEnabled())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) {
+  if (!isEnabled())
+    return;
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(mDirectory, error);
+  // Write next to the final name and rename over it, so that a crash or a
+  // second instance never leaves a torn file behind.
+  auto path = pathFor(key);
+  auto tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    FileHeader header{FileMagic, FileVersion, key, format, uint32_t(length)};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(binary.data(), length);
+    if (!file) {
+      LOG_ERROR("Could not write cached program %s.", tmpPath.c_str());
+      return;
+    }
+  }
+  std::filesystem::rename(tmpPath, path, error);
+  if (error)
+    LOG_ERROR("Could not write cached program %s.", path.c_str());
+}
+
+} // namespace Engine
@@ -1,39 +1,157 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <Engine/Application.h>
+#include <Engine/CpuProfiler.h>
+#include <Engine/ProgramCache.h>
 #include <Engine/Renderer.h>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 namespace Engine {
 
+namespace {
+
+// Draw packet sort keys, most significant bits first:
+//
+//   opaque:      pass(2) | shader(10) | texture(14) | vao(14) | depth(24)
+//   transparent: pass(2) | ~depth(24) | shader(10) | texture(14) | vao(14)
+//
+// Opaques are grouped by state and drawn front to back within a group to cut
+// overdraw, transparents have to go back to front so depth comes first. IDs
+// wider than their field only cost batching, the packet keeps the real
+// renderable.
+constexpr uint64_t OpaquePass = 0;
+constexpr uint64_t TransparentPass = 1;
+
+uint64_t quantizeDepth(float depth) {
+  // Non-negative IEEE floats order the same as their bit patterns.
+  depth = std::max(depth, 0.0f);
+  uint32_t bits;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  return bits >> 8;
+}
+
+uint64_t makeSortKey(bool transparent, int shaderID, uint texture, uint vao,
+                     float depth) {
+  uint64_t state = (uint64_t(shaderID) & 0x3FF) << 28 |
+                   (uint64_t(texture) & 0x3FFF) << 14 |
+                   (uint64_t(vao) & 0x3FFF);
+  uint64_t quantized = quantizeDepth(depth);
+  if (!transparent)
+    return OpaquePass << 62 | state << 24 | quantized;
+  return TransparentPass << 62 | (~quantized & 0xFFFFFF) << 38 | state;
+}
+
+AABB sphereBox(const BoundingSphere &sphere) {
+  return AABB{sphere.centre - vec3(sphere.radius),
+              sphere.centre + vec3(sphere.radius)};
+}
+
+/// Distance along the normalised ray to \p sphere, false on a miss.
+bool intersectSphere(const BoundingSphere &sphere, const vec3 &origin,
+                     const vec3 &dir, float &t) {
+  vec3 oc = origin - sphere.centre;
+  float b = glm::dot(oc, dir);
+  float c = glm::dot(oc, oc) - sphere.radius * sphere.radius;
+  float disc = b * b - c;
+  if (disc < 0.0f)
+    return false;
+  float root = std::sqrt(disc);
+  t = -b - root >= 0.0f ? -b - root : -b + root;
+  return t >= 0.0f;
+}
+
+/// LSD radix sort on the packet keys, one byte per pass. Bytes that are the
+/// same for every key are skipped, which is most of them in small scenes.
+void radixSort(std::vector<DrawPacket> &packets,
+               std::vector<DrawPacket> &scratch) {
+  if (packets.size() < 2)
+    return;
+  scratch.resize(packets.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t counts[256] = {};
+    for (const auto &p : packets)
+      counts[(p.key >> shift) & 0xFF]++;
+    if (counts[(packets[0].key >> shift) & 0xFF] == packets.size())
+      continue;
+
+    size_t offset = 0;
+    for (auto &count : counts) {
+      auto n = count;
+      count = offset;
+      offset += n;
+    }
+    for (const auto &p : packets)
+      scratch[counts[(p.key >> shift) & 0xFF]++] = p;
+    packets.swap(scratch);
+  }
+}
+
+} // namespace
+
 Renderer::Renderer() {
-  // glEnable(GL_CULL_FACE);
-  // glCullFace(GL_BACK);
-  // glFrontFace(GL_CW);
-  glEnable(GL_DEPTH_TEST);
-  glDepthMask(GL_TRUE);
-  glDepthFunc(GL_LEQUAL);
+  // Face culling stays off, meshes don't agree on a winding yet: Spheres
+  // are counter clockwise seen from outside, GL's default, Boxes clockwise.
+  auto &state = GLStateCache::getInstance();
+  state.enable(GL_DEPTH_TEST);
+  state.depthMask(true);
+  state.depthFunc(GL_LEQUAL);
   glDepthRange(0.0f, 1.0f);
-  glEnable(GL_DEPTH_CLAMP);
+  state.enable(GL_DEPTH_CLAMP);
 
   glClearDepth(1.0f);
   glClearColor(0.85f, 0.85f, 0.9f, 1.0f);
 
+  /*********** CONFIGURE PER FRAME UNIFORMS ************/
+  glGenBuffers(1, &mFrameUBO);
+  state.bindBuffer(GL_UNIFORM_BUFFER, mFrameUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr,
+               GL_DYNAMIC_DRAW);
+  state.bindBufferBase(GL_UNIFORM_BUFFER, Shader::FrameBlockBinding,
+                       mFrameUBO);
+
+  /*********** CONFIGURE STREAMING GEOMETRY ************/
+  mStreamBuffer = std::make_unique<StreamBuffer>(4 * 1024 * 1024);
+
   /*********** CONFIGURE DEPTH BUFFER ************/
+  // Builds in the background and is polled with the others, see
+  // forEachShader().
   auto depth_shader_info = Shader::Info{
     "depth.vs", "depth.fs", "depth.gs", [](Shader &shader) {}
   };
   mDepthShader = std::make_unique<Shader>(depth_shader_info);
 }
 
+Renderer::~Renderer() {
+  GLStateCache::getInstance().deleteBuffer(mFrameUBO);
+}
+
 void Renderer::renderFrame(const Application &app, const mat4 &worldMat) {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glEnable(GL_DEPTH_TEST);
+  PROFILE_SCOPE("Render");
+  auto frameStart = std::chrono::steady_clock::now();
+  auto &state = GLStateCache::getInstance();
+  state.resetCounters();
+  mStats = RenderStats{};
+  mLastWorldTransform = worldMat;
+
+  GPU_SCOPE("Render");
+  pollShaders();
+  auto &textures = TextureLoader::getInstance();
+  textures.update();
+  mStats.texturesLoading = textures.getNumPending();
+  TextureCache::getInstance().trim();
+  updateFrameUniforms(app);
+
+  state.enable(GL_DEPTH_TEST);
 
   // 0. create depth cubemap transformation matrices
   // -----------------------------------------------
@@ -79,7 +197,7 @@ void Renderer::renderFrame(const Application &app, const mat4 &worldMat) {
   //mDepthShader->setFloat("far_plane", far_plane);
   //mDepthShader->setVec3("lightPos", lightPos);
   //renderGeometry(app, worldMat, mDepthShader);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  state.bindFramebuffer(mRenderTarget);
   LOG_IF_GL_ERR();
   glViewport(0, 0, app.getFramebufferWidth(), app.getFramebufferHeight());
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -88,8 +206,120 @@ void Renderer::renderFrame(const Application &app, const mat4 &worldMat) {
   renderGeometry(app, worldMat);
   //renderLights(app, worldMat);
   LOG_IF_GL_ERR();
+
+  // Every draw reading this frame's streamed geometry has been issued.
+  mStreamBuffer->fence();
+
+  std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - frameStart;
+  mStats.cpuTimeMs = elapsed.count();
+  mStats.stateChangesIssued = state.getCounters().issued;
+  mStats.stateChangesElided = state.getCounters().elided;
 } // namespace Engine
 
+int Renderer::createShaderVariant(int baseID,
+                                  std::vector<std::string> defines) {
+  auto info = getShader(baseID).getInfo();
+  defines.insert(defines.end(), info.defines.begin(), info.defines.end());
+  std::sort(defines.begin(), defines.end());
+  defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+
+  std::string key = info.vsPath + "|" + info.fsPath + "|" + info.gsPath;
+  for (const auto &define : defines)
+    key += "|" + define;
+  auto iter = mShaderVariants.find(key);
+  if (iter != mShaderVariants.end() && mShaders.count(iter->second))
+    return iter->second;
+
+  info.defines = std::move(defines);
+  int id = createShader(info);
+  mShaderVariants[key] = id;
+  return id;
+}
+
+void Renderer::setShaderHotReload(bool enabled) {
+  if (!enabled) {
+    mShaderWatcher = nullptr;
+    return;
+  }
+  if (mShaderWatcher)
+    return;
+  mShaderWatcher = std::make_unique<FileWatcher>();
+  forEachShader([this](Shader &shader) {
+    for (const auto &path : shader.getSourcePaths())
+      mShaderWatcher->watch(path);
+  });
+}
+
+void Renderer::pollShaders() {
+  PROFILE_SCOPE("Poll shaders");
+  if (mShaderWatcher) {
+    for (const auto &changed : mShaderWatcher->poll()) {
+      forEachShader([&changed](Shader &shader) {
+        auto paths = shader.getSourcePaths();
+        if (std::find(paths.begin(), paths.end(), changed) != paths.end()) {
+          LOG_INFO("%s changed, reloading.", changed.c_str());
+          shader.reload();
+        }
+      });
+    }
+  }
+
+  uint building = 0;
+  forEachShader([this, &building](Shader &shader) {
+    if (shader.isBuilding()) {
+      shader.poll();
+      // The build may have read new #includes.
+      if (mShaderWatcher && !shader.isBuilding()) {
+        for (const auto &path : shader.getSourcePaths())
+          mShaderWatcher->watch(path);
+      }
+    }
+    building += shader.isBuilding();
+  });
+  mStats.shadersBuilding = building;
+  if (building == 0 && mShadersBuilding != 0)
+    logProgramStats();
+  mShadersBuilding = building;
+}
+
+void Renderer::finishShaders() {
+  bool building = false;
+  forEachShader([this, &building](Shader &shader) {
+    building |= shader.isBuilding();
+    shader.poll(/* wait */ true);
+    if (mShaderWatcher) {
+      for (const auto &path : shader.getSourcePaths())
+        mShaderWatcher->watch(path);
+    }
+  });
+  if (building)
+    logProgramStats();
+  mShadersBuilding = 0;
+}
+
+void Renderer::logProgramStats() const {
+  const auto &programs = ProgramCache::getInstance().getStats();
+  LOG_INFO("Programs: %u loaded from cache in %.1f ms, %u compiled in %.1f ms"
+           " (%u stale binaries).",
+           programs.hits, programs.loadMs, programs.misses,
+           programs.compileMs, programs.rejected);
+}
+
+void Renderer::updateFrameUniforms(const Application &app) {
+  mFrameUniforms.view = app.getViewMatrix();
+  mFrameUniforms.proj = app.getProjMatrix();
+  mFrameUniforms.viewProj = mFrameUniforms.proj * mFrameUniforms.view;
+  mFrameUniforms.cameraPos = app.getCamera().getPos();
+  mFrameUniforms.time = (float)glfwGetTime();
+  mFrameUniforms.resolution =
+      vec2(app.getFramebufferWidth(), app.getFramebufferHeight());
+
+  GLStateCache::getInstance().bindBuffer(GL_UNIFORM_BUFFER, mFrameUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms),
+                  &mFrameUniforms);
+}
+
 /*void Renderer::addLight(const Application &app, sptr<Mesh> mesh, vec3 &colour) {
   auto light_shader_info = Shader::Info{
     "basicLighting_VS.glsl",
@@ -130,19 +360,269 @@ void Renderer::renderFrame(const Application &app, const mat4 &worldMat) {
 void Renderer::renderGeometry(const Application &app,
                               const mat4 &worldTransform,
                               const sptr<Shader> overrideShader) {
-  // For each list of renderables that share a shader program, draw them all at
-  // once to minimize shader program switching.
-  for (auto &renderGroup : mRenderGroups) {
-    auto shaderID = renderGroup.first;
-    auto &renderList = renderGroup.second;
-    auto &shader = overrideShader ? *overrideShader : *mShaders[shaderID];
-    shader.use();
+  auto &state = GLStateCache::getInstance();
+  // Rendering with an override shader is how depth only passes are drawn.
+  GPU_SCOPE(overrideShader ? "Depth pass" : "Geometry pass");
+  PROFILE_SCOPE(overrideShader ? "Depth pass" : "Geometry pass");
+
+  // Cull against the camera frustum. Override shaders render from somewhere
+  // else (e.g. a light), so skip culling for them. The frustum is taken in
+  // world-transform space so the bounds don't need transforming, except for
+  // renderables drawn without the world transform.
+  //
+  // The BVH rejects whole subtrees at once and hands back items whose box is
+  // entirely inside, only the ones straddling a plane get a sphere test.
+  mCullCandidates.clear();
+  mCullBounds.clear();
+  if (mCullingEnabled && !overrideShader) {
+    updateSceneBVH();
+    PROFILE_SCOPE("Cull");
+    auto frustum = Frustum::fromMatrix(
+        mFrameUniforms.viewProj * worldTransform, /* depthClamp */ true);
+    mQueryInside.clear();
+    mQueryPartial.clear();
+    mSceneBVH.queryFrustum(frustum, mQueryInside, mQueryPartial);
+    for (auto item : mQueryPartial) {
+      mCullCandidates.push_back(mSceneItems[item]);
+      mCullBounds.push_back(mSceneItems[item]->bounds());
+    }
+    for (auto *renderable : mUnboundedItems) {
+      mCullCandidates.push_back(renderable);
+      mCullBounds.push_back(renderable->bounds());
+    }
+    mStats.visible = cullSpheres(frustum, mCullBounds, mCullVisible);
+    for (auto item : mQueryInside) {
+      mCullCandidates.push_back(mSceneItems[item]);
+      mCullVisible.push_back(1);
+    }
+    mStats.visible += mQueryInside.size();
+    if (!mUntransformedItems.empty()) {
+      mCullBounds.clear();
+      for (auto *renderable : mUntransformedItems) {
+        mCullCandidates.push_back(renderable);
+        mCullBounds.push_back(renderable->bounds());
+      }
+      auto cameraFrustum = Frustum::fromMatrix(mFrameUniforms.viewProj,
+                                               /* depthClamp */ true);
+      mStats.visible +=
+          cullSpheres(cameraFrustum, mCullBounds, mUntransformedVisible);
+      mCullVisible.insert(mCullVisible.end(), mUntransformedVisible.begin(),
+                          mUntransformedVisible.end());
+    }
+    mStats.culled = mSceneItems.size() + mUnboundedItems.size() +
+                    mUntransformedItems.size() - mStats.visible;
+  } else {
+    for (auto &renderGroup : mRenderGroups) {
+      for (auto &renderable : renderGroup.second)
+        mCullCandidates.push_back(renderable.get());
+    }
+    mCullVisible.assign(mCullCandidates.size(), 1);
+    mStats.visible = mCullCandidates.size();
+  }
+
+  // Build this frame's draw queue.
+  {
+    PROFILE_SCOPE("Draw queue");
+    mDrawQueue.clear();
+    // Renderables drawn without the world transform are sorted by the
+    // camera's view alone.
+    const mat4 &cameraView = mFrameUniforms.view;
+    mat4 worldView = cameraView * worldTransform;
+    float cameraScale = std::sqrt(glm::dot(cameraView[0], cameraView[0]));
+    float worldScale = std::sqrt(glm::dot(worldView[0], worldView[0]));
+    // Pixels covered by one unit at view distance 1 (perspective) or
+    // anywhere (orthographic). Depth passes keep full detail.
+    const mat4 &proj = mFrameUniforms.proj;
+    bool perspective = proj[2][3] != 0.0f;
+    float pixelsPerViewUnit = 0.5f * proj[1][1] * mFrameUniforms.resolution.y;
+    bool lod = mLodEnabled && !overrideShader;
+    for (size_t i = 0; i < mCullCandidates.size(); i++) {
+      auto *renderable = mCullCandidates[i];
+      if (!mCullVisible[i] || renderable->isEmpty())
+        continue;
+      bool world = renderable->usesWorldTransform();
+      const mat4 &view = world ? worldView : cameraView;
+      if (lod) {
+        float scale = world ? worldScale : cameraScale;
+        float pixelsPerUnit = pixelsPerViewUnit * scale;
+        auto bounds = renderable->bounds();
+        float distance = -(view * vec4(bounds.centre, 1.0f)).z -
+                         bounds.radius * scale;
+        renderable->selectLod(
+            perspective ? pixelsPerUnit / std::max(distance, 1e-3f)
+                        : pixelsPerUnit,
+            mLodThreshold);
+      } else {
+        renderable->selectLod(std::numeric_limits<float>::infinity(),
+                              mLodThreshold);
+      }
+      int shaderID =
+          overrideShader ? overrideShader->id() : renderable->shaderID();
+      float depth = -(view * vec4(renderable->origin(), 1.0f)).z;
+      auto key = makeSortKey(renderable->isTransparent(), shaderID,
+                             renderable->textureID(),
+                             renderable->vertexArray(), depth);
+      mDrawQueue.push_back(DrawPacket{key, renderable});
+    }
+    radixSort(mDrawQueue, mSortScratch);
+  }
+
+  // Packets sharing a shader are now adjacent, so each program is bound (and
+  // its per-bind callback run) once per run of packets.
+  PROFILE_SCOPE("Submit");
+  auto &profiler = GpuProfiler::getInstance();
+  profiler.pushScope("Opaque");
+  Shader *shader = nullptr;
+  int currentID = -1;
+  bool blending = false;
+  for (auto &packet : mDrawQueue) {
+    auto *renderable = packet.renderable;
+    if (renderable->isTransparent() && !blending) {
+      profiler.popScope();
+      profiler.pushScope("Transparent");
+      state.enable(GL_BLEND);
+      state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      state.depthMask(false);
+      blending = true;
+    }
+
+    int shaderID =
+        overrideShader ? overrideShader->id() : renderable->shaderID();
+    if (shaderID != currentID) {
+      currentID = shaderID;
+      auto iter = mShaders.find(shaderID);
+      if (overrideShader)
+        shader = overrideShader.get();
+      else
+        shader = iter != mShaders.end() ? iter->second.get() : nullptr;
+      // Shaders still building on their first go have nothing to draw with,
+      // their renderables are skipped until they are ready.
+      if (shader && !shader->isReady())
+        shader = nullptr;
+      if (shader) {
+        shader->use();
+        LOG_IF_GL_ERR();
+      }
+    }
+    if (!shader)
+      continue;
+
+    renderable->draw(app, *shader);
+    mStats.drawCalls++;
+    mStats.triangles += renderable->numTriangles(false);
+    mStats.trianglesFullDetail += renderable->numTriangles(true);
     LOG_IF_GL_ERR();
-    for (auto &renderable : renderList) {
-      renderable->draw(app, shader);
-      LOG_IF_GL_ERR();
+  }
+  profiler.popScope();
+
+  if (blending) {
+    state.disable(GL_BLEND);
+    state.depthMask(true);
+  }
+}
+
+void Renderer::markMoved(uint32_t item) {
+  if (mSceneDirty || mItemMoved[item])
+    return;
+  mItemMoved[item] = 1;
+  mMovedItems.push_back(item);
+}
+
+void Renderer::updateSceneBVH() {
+  PROFILE_SCOPE("Update BVH");
+  if (mSceneDirty) {
+    mSceneItems.clear();
+    mUnboundedItems.clear();
+    mUntransformedItems.clear();
+    std::vector<AABB> boxes;
+    for (auto &renderGroup : mRenderGroups) {
+      for (auto &renderable : renderGroup.second) {
+        auto sphere = renderable->bounds();
+        if (std::isinf(sphere.radius)) {
+          renderable->setBoundsCallback(nullptr);
+          mUnboundedItems.push_back(renderable.get());
+          continue;
+        }
+        if (!renderable->usesWorldTransform()) {
+          renderable->setBoundsCallback(nullptr);
+          mUntransformedItems.push_back(renderable.get());
+          continue;
+        }
+        auto item = uint32_t(mSceneItems.size());
+        renderable->setBoundsCallback([this, item] { markMoved(item); });
+        mSceneItems.push_back(renderable.get());
+        boxes.push_back(sphereBox(sphere));
+      }
+    }
+    mSceneBVH.build(boxes);
+    mItemMoved.assign(mSceneItems.size(), 0);
+    mMovedItems.clear();
+    mSceneDirty = false;
+    return;
+  }
+
+  // Refitting everything is a single linear pass, past some fraction of
+  // moved items that beats walking up from each one.
+  bool refitAll = mMovedItems.size() > mSceneItems.size() / 8;
+  for (auto item : mMovedItems) {
+    auto box = sphereBox(mSceneItems[item]->bounds());
+    if (refitAll)
+      mSceneBVH.setItemBounds(item, box);
+    else
+      mSceneBVH.update(item, box);
+    mItemMoved[item] = 0;
+  }
+  if (refitAll)
+    mSceneBVH.refit();
+  mMovedItems.clear();
+}
+
+RenderInterface *Renderer::pick(const Application &app, double x, double y) {
+  updateSceneBVH();
+
+  // Unproject the cursor onto the near and far planes, in world-transform
+  // space like the BVH.
+  vec2 ndc{2.0f * float(x) / app.getWidth() - 1.0f,
+           1.0f - 2.0f * float(y) / app.getHeight()};
+  auto unproject = [&ndc](const mat4 &viewProj, vec3 &origin, vec3 &dir) {
+    mat4 inv = glm::inverse(viewProj);
+    vec4 nearPoint = inv * vec4(ndc, -1.0f, 1.0f);
+    vec4 farPoint = inv * vec4(ndc, 1.0f, 1.0f);
+    origin = vec3(nearPoint) / nearPoint.w;
+    dir = glm::normalize(vec3(farPoint) / farPoint.w - origin);
+  };
+  vec3 origin, dir;
+  unproject(mFrameUniforms.viewProj * mLastWorldTransform, origin, dir);
+
+  float t = std::numeric_limits<float>::infinity();
+  uint32_t item;
+  RenderInterface *picked = nullptr;
+  if (mSceneBVH.raycast(origin, dir, t, item,
+                        [&](uint32_t candidate, float &tHit) {
+    return intersectSphere(mSceneItems[candidate]->bounds(), origin, dir,
+                           tHit);
+  }))
+    picked = mSceneItems[item];
+  if (mUntransformedItems.empty())
+    return picked;
+
+  // The rest are hit in world space, compare distances there.
+  vec3 cameraOrigin, cameraDir;
+  unproject(mFrameUniforms.viewProj, cameraOrigin, cameraDir);
+  float nearest = std::numeric_limits<float>::infinity();
+  if (picked) {
+    vec3 hitPoint = vec3(mLastWorldTransform * vec4(origin + t * dir, 1.0f));
+    nearest = glm::length(hitPoint - cameraOrigin);
+  }
+  for (auto *renderable : mUntransformedItems) {
+    float tHit;
+    if (intersectSphere(renderable->bounds(), cameraOrigin, cameraDir, tHit) &&
+        tHit < nearest) {
+      nearest = tHit;
+      picked = renderable;
     }
   }
+  return picked;
 }
 
 /*void Renderer::renderLights(const Application &app,
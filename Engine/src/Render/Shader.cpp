@@ -1,171 +1,780 @@
 #include <GL/gl3w.h>
-#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <filesystem>
+#include <future>
 #include <iostream>
-#include <sstream>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include <Engine/GLStateCache.h>
+#include <Engine/ProgramCache.h>
 #include <Engine/Shader.h>
 #include <Engine/Log.h>
+#include <Engine/MappedFile.h>
 
 namespace Engine {
 
 // Shader ID
 static int nextID = 0;
 
+uint64_t Shader::sLocationQueries = 0;
+
 /* NOTE: Largely borrowed from learnopengl.com */
 
+namespace {
+
+using Macros = std::unordered_map<std::string, std::string>;
+
+/// Value of a #if expression made of integers, defined, macros that expand
+/// to integers, !, parentheses, comparisons, && and ||. Undefined macros
+/// are 0 like in C, except GL_ ones, which the driver may define. Anything
+/// it can't work out is std::nullopt.
+class ConditionParser {
+public:
+  ConditionParser(std::string_view text, const Macros &macros)
+      : mText(text), mMacros(macros) {}
+
+  std::optional<long> parse() {
+    auto value = parseOr();
+    skipSpace();
+    return mPos == mText.size() ? value : std::nullopt;
+  }
+
+private:
+  std::optional<long> parseOr() {
+    auto value = parseAnd();
+    while (match("||")) {
+      auto rhs = parseAnd();
+      if ((value && *value) || (rhs && *rhs))
+        value = 1;
+      else
+        value = value && rhs ? std::optional<long>(0) : std::nullopt;
+    }
+    return value;
+  }
+
+  std::optional<long> parseAnd() {
+    auto value = parseComparison();
+    while (match("&&")) {
+      auto rhs = parseComparison();
+      if ((value && !*value) || (rhs && !*rhs))
+        value = 0;
+      else
+        value = value && rhs ? std::optional<long>(1) : std::nullopt;
+    }
+    return value;
+  }
+
+  std::optional<long> parseComparison() {
+    auto value = parseUnary();
+    for (;;) {
+      // Two character operators first, "<=" is not "<".
+      const char *ops[] = {"==", "!=", "<=", ">=", "<", ">"};
+      int op = 0;
+      while (op < 6 && !match(ops[op]))
+        op++;
+      if (op == 6)
+        return value;
+      auto rhs = parseUnary();
+      if (!value || !rhs) {
+        value = std::nullopt;
+        continue;
+      }
+      long a = *value, b = *rhs;
+      bool results[] = {a == b, a != b, a <= b, a >= b, a < b, a > b};
+      value = results[op];
+    }
+  }
+
+  std::optional<long> parseUnary() {
+    if (match("!")) {
+      auto value = parseUnary();
+      return value ? std::optional<long>(!*value) : std::nullopt;
+    }
+    if (match("(")) {
+      auto value = parseOr();
+      return match(")") ? value : std::nullopt;
+    }
+    skipSpace();
+    if (mPos < mText.size() && std::isdigit((unsigned char)mText[mPos])) {
+      long value = 0;
+      while (mPos < mText.size() &&
+             std::isdigit((unsigned char)mText[mPos]))
+        value = 10 * value + (mText[mPos++] - '0');
+      // Suffixes such as u are fine, anything else is not an integer.
+      while (mPos < mText.size() && std::isalnum((unsigned char)mText[mPos]))
+        if (std::tolower(mText[mPos++]) != 'u')
+          return std::nullopt;
+      return value;
+    }
+    auto name = identifier();
+    if (name.empty())
+      return std::nullopt;
+    if (name == "defined") {
+      bool paren = match("(");
+      name = identifier();
+      if (name.empty() || (paren && !match(")")))
+        return std::nullopt;
+      if (!mMacros.count(name) && name.compare(0, 3, "GL_") == 0)
+        return std::nullopt;
+      return long(mMacros.count(name));
+    }
+    auto iter = mMacros.find(name);
+    if (iter == mMacros.end())
+      return name.compare(0, 3, "GL_") == 0 ? std::nullopt
+                                            : std::optional<long>(0);
+    // One level of expansion is plenty for feature switches.
+    if (iter->second.empty())
+      return std::nullopt;
+    char *end;
+    long value = std::strtol(iter->second.c_str(), &end, 10);
+    return *end == '\0' ? std::optional<long>(value) : std::nullopt;
+  }
+
+  std::string identifier() {
+    skipSpace();
+    size_t begin = mPos;
+    while (mPos < mText.size() && (std::isalnum((unsigned char)mText[mPos]) ||
+                                   mText[mPos] == '_'))
+      mPos++;
+    if (begin < mPos && std::isdigit((unsigned char)mText[begin])) {
+      mPos = begin;
+      return {};
+    }
+    return std::string(mText.substr(begin, mPos - begin));
+  }
+
+  bool match(std::string_view token) {
+    skipSpace();
+    if (mText.compare(mPos, token.size(), token) != 0)
+      return false;
+    mPos += token.size();
+    return true;
+  }
+
+  void skipSpace() {
+    while (mPos < mText.size() && std::isspace((unsigned char)mText[mPos]))
+      mPos++;
+  }
+
+  std::string_view mText;
+  const Macros &mMacros;
+  size_t mPos = 0;
+};
+
+/// Expands #include "file" (or <file>) and injects defines after #version.
+/// Includes are looked up next to the including file, then in the working
+/// directory, and each file is only pulled in once per stage, like
+/// #pragma once. #line directives keep compile errors pointing at the right
+/// line, the source string number indexes files (see legend()).
+///
+/// #if, #ifdef and friends are followed, along with #define and #undef, so
+/// that includes in branches the compiler will skip are skipped too. When a
+/// condition can't be worked out its branch counts as taken, the compiler
+/// still has the final say. Only the top level file may have a #version.
+class Preprocessor {
+public:
+  explicit Preprocessor(const std::vector<std::string> &defines)
+      : mDefines(defines) {
+    for (const auto &define : defines) {
+      auto equals = define.find('=');
+      if (equals == std::string::npos)
+        mMacros[define] = "1";
+      else
+        mMacros[define.substr(0, equals)] = define.substr(equals + 1);
+    }
+  }
+
+  bool run(const std::filesystem::path &path, std::string &out) {
+    return expand(path, out, 0);
+  }
+  /// "0: main.fs, 1: material.glsl", to decode error messages.
+  std::string legend() const {
+    std::string legend;
+    for (size_t i = 0; i < mFiles.size(); i++)
+      legend += (i ? ", " : "") + std::to_string(i) + ": " + mFiles[i];
+    return legend;
+  }
+  inline const std::vector<std::string> &files() const { return mFiles; }
+  inline const std::string &error() const { return mError; }
+
+private:
+  static constexpr int MaxDepth = 16;
+
+  /// One #if ... #endif. Once a branch is surely taken the rest are not,
+  /// until then every branch that might be taken is.
+  struct Conditional {
+    bool enclosingActive;
+    bool active;
+    bool taken;
+  };
+
+  inline bool isActive() const {
+    return mConditionals.empty() || mConditionals.back().active;
+  }
+
+  /// Follow the conditional directive \p name with argument \p arg, comments
+  /// stripped. Returns false for directives that are not conditionals.
+  bool condition(std::string_view name, std::string_view arg) {
+    auto word = [&arg] {
+      auto begin = arg.find_first_not_of(" \t");
+      auto end = arg.find_first_of(" \t", begin);
+      return begin == arg.npos ? std::string()
+                               : std::string(arg.substr(begin, end - begin));
+    };
+    auto evaluate = [&]() -> std::optional<long> {
+      if (name == "ifdef" || name == "ifndef") {
+        auto macro = word();
+        if (!mMacros.count(macro) && macro.compare(0, 3, "GL_") == 0)
+          return std::nullopt;
+        return long(mMacros.count(macro) == (name == "ifdef"));
+      }
+      return ConditionParser(arg, mMacros).parse();
+    };
+
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+      bool enclosing = isActive();
+      auto value = enclosing ? evaluate() : std::optional<long>(0);
+      mConditionals.push_back(
+          {enclosing, enclosing && value.value_or(1) != 0,
+           value.value_or(0) != 0});
+      return true;
+    }
+    if (mConditionals.empty())
+      return name == "elif" || name == "else" || name == "endif";
+    auto &current = mConditionals.back();
+    if (name == "elif") {
+      auto value = current.enclosingActive && !current.taken
+                       ? evaluate()
+                       : std::optional<long>(0);
+      current.active = current.enclosingActive && !current.taken &&
+                       value.value_or(1) != 0;
+      current.taken |= value.value_or(0) != 0;
+      return true;
+    }
+    if (name == "else") {
+      current.active = current.enclosingActive && !current.taken;
+      current.taken = true;
+      return true;
+    }
+    if (name == "endif") {
+      mConditionals.pop_back();
+      return true;
+    }
+    return false;
+  }
+
+  bool expand(const std::filesystem::path &path, std::string &out,
+              int depth) {
+    // Lines are copied straight out of the mapping into the output.
+    MappedFile file(path.string());
+    if (!file.isOpen()) {
+      mError = "could not read " + path.string();
+      return false;
+    }
+    int index = int(mFiles.size());
+    mFiles.push_back(path.lexically_normal().string());
+    mIncluded.push_back(std::filesystem::absolute(path).lexically_normal());
+    out.reserve(out.size() + file.size());
+
+    auto text = file.view();
+    for (int number = 1; !text.empty(); number++) {
+      auto end = text.find('\n');
+      auto line = text.substr(0, end);
+      text.remove_prefix(end == text.npos ? text.size() : end + 1);
+
+      auto first = line.find_first_not_of(" \t");
+      if (first == line.npos || line[first] != '#') {
+        out.append(line);
+        out += '\n';
+        continue;
+      }
+      auto nameBegin = line.find_first_not_of(" \t", first + 1);
+      auto nameEnd = line.find_first_of(" \t(\"<", nameBegin);
+      auto name = nameBegin == line.npos
+                      ? std::string_view()
+                      : line.substr(nameBegin, nameEnd - nameBegin);
+      auto arg = nameEnd == line.npos ? std::string_view()
+                                      : line.substr(nameEnd);
+      arg = arg.substr(0, std::min(arg.find("//"), arg.find("/*")));
+
+      if (name == "version") {
+        if (depth > 0) {
+          mError = mFiles[index] + ":" + std::to_string(number) +
+                   ": #version in an included file";
+          return false;
+        }
+        out.append(line);
+        out += '\n';
+        auto version = std::string(arg);
+        int versionNumber = std::atoi(version.c_str());
+        mMacros["__VERSION__"] = std::to_string(versionNumber);
+        if (versionNumber >= 150 &&
+            version.find("compatibility") == std::string::npos)
+          mMacros["GL_core_profile"] = "1";
+        for (const auto &define : mDefines) {
+          auto equals = define.find('=');
+          out += "#define " +
+                 (equals == std::string::npos
+                      ? define + " 1"
+                      : define.substr(0, equals) + " " +
+                            define.substr(equals + 1)) +
+                 "\n";
+        }
+        out += lineDirective(number + 1, index);
+        continue;
+      }
+      if (name != "include") {
+        if (!condition(name, arg) && isActive() &&
+            (name == "define" || name == "undef")) {
+          auto begin = arg.find_first_not_of(" \t");
+          auto end = arg.find_first_of(" \t(", begin);
+          if (begin != arg.npos) {
+            auto macro = std::string(arg.substr(begin, end - begin));
+            if (name == "undef") {
+              mMacros.erase(macro);
+            } else {
+              auto value = end == arg.npos ? std::string_view()
+                                           : arg.substr(end);
+              auto valueBegin = value.find_first_not_of(" \t");
+              auto valueEnd = value.find_last_not_of(" \t\r");
+              mMacros[macro] =
+                  valueBegin == value.npos
+                      ? std::string()
+                      : std::string(value.substr(
+                            valueBegin, valueEnd - valueBegin + 1));
+            }
+          }
+        }
+        out.append(line);
+        out += '\n';
+        continue;
+      }
+      // Keep the line count, the compiler doesn't know #include.
+      if (!isActive()) {
+        out += "// ";
+        out.append(line);
+        out += '\n';
+        continue;
+      }
+
+      auto open = line.find_first_of("\"<", nameEnd);
+      auto close = open == line.npos ? line.npos
+                                     : line.find_first_of("\">", open + 1);
+      if (close == line.npos) {
+        mError = mFiles[index] + ":" + std::to_string(number) +
+                 ": malformed #include";
+        return false;
+      }
+      auto include = std::string(line.substr(open + 1, close - open - 1));
+      auto includePath = path.parent_path() / include;
+      if (!std::filesystem::exists(includePath))
+        includePath = std::filesystem::path(include);
+      if (!std::filesystem::exists(includePath)) {
+        mError = mFiles[index] + ":" + std::to_string(number) +
+                 ": could not find " + include;
+        return false;
+      }
+      auto absolute =
+          std::filesystem::absolute(includePath).lexically_normal();
+      if (std::find(mIncluded.begin(), mIncluded.end(), absolute) !=
+          mIncluded.end())
+        continue;
+      if (depth == MaxDepth) {
+        mError = mFiles[index] + ": includes nested too deeply";
+        return false;
+      }
+      out += lineDirective(1, int(mFiles.size()));
+      if (!expand(includePath, out, depth + 1))
+        return false;
+      out += lineDirective(number + 1, index);
+    }
+    return true;
+  }
+
+  static std::string lineDirective(int line, int file) {
+    return "#line " + std::to_string(line) + " " + std::to_string(file) +
+           "\n";
+  }
+
+  const std::vector<std::string> &mDefines;
+  Macros mMacros;
+  std::vector<Conditional> mConditionals;
+  std::vector<std::string> mFiles;
+  std::vector<std::filesystem::path> mIncluded;
+  std::string mError;
+};
+
+/// Runs on a worker thread, so errors are handed back rather than logged.
+Shader::Sources readSources(std::string vsPath, std::string fsPath,
+                            std::string gsPath,
+                            std::vector<std::string> defines) {
+  Shader::Sources sources;
+  std::string *code[] = {&sources.vertex, &sources.fragment,
+                         &sources.geometry};
+  const std::string *paths[] = {&vsPath, &fsPath, &gsPath};
+  for (int i = 0; i < 3; i++) {
+    if (paths[i]->empty())
+      continue;
+    Preprocessor preprocessor(defines);
+    if (!preprocessor.run(*paths[i], *code[i])) {
+      sources.error = preprocessor.error();
+      return sources;
+    }
+    if (preprocessor.files().size() > 1)
+      sources.legends[i] = preprocessor.legend();
+    for (const auto &file : preprocessor.files()) {
+      if (file != *paths[i] &&
+          std::find(sources.includes.begin(), sources.includes.end(),
+                    file) == sources.includes.end())
+        sources.includes.push_back(file);
+    }
+  }
+  return sources;
+}
+
+} // namespace
+
 Shader::Shader(Shader::Info info)
     : mPerBind(info.bindCB),
       mID(nextID++),
       mVertexPath(std::move(info.vsPath)),
       mFragmentPath(std::move(info.fsPath)),
-      mGeometryPath(std::move(info.gsPath)) {
-  compile();
-  LOG_INFO("Shader COMPILED");
-}
-
-bool Shader::compile() {
-  std::string vertexCode, fragmentCode, geometryCode;
-  std::ifstream vShaderFile, fShaderFile, gShaderFile;
-
-  // ensure ifstream objects can throw exceptions:
-  vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-  try {
-    // open files
-    vShaderFile.open(std::filesystem::current_path() / std::filesystem::path(mVertexPath));
-    fShaderFile.open(std::filesystem::current_path() / std::filesystem::path(mFragmentPath));
-    std::stringstream vShaderStream, fShaderStream;
-    // read file's buffer contents into streams
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
-    // close file handlers
-    vShaderFile.close();
-    fShaderFile.close();
-    // convert stream into string
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
-    // if provided geometry shader
-    if (!mGeometryPath.empty()) {
-      gShaderFile.open(mGeometryPath.c_str());
-      std::stringstream gShaderStream;
-      gShaderStream << gShaderFile.rdbuf();
-      gShaderFile.close();
-      geometryCode = gShaderStream.str();
-    }
-  } catch (std::ifstream::failure e) {
-    std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << e.what() << std::endl;
-  }
-
-  unsigned int vertex, fragment, geometry;
-  bool success = true;
+      mGeometryPath(std::move(info.gsPath)),
+      mDefines(std::move(info.defines)) {
+  reload();
+}
+
+Shader::~Shader() {
+  if (mBuild)
+    cancelBuild();
+  if (mProgramID)
+    GLStateCache::getInstance().deleteProgram(mProgramID);
+}
+
+bool Shader::parallelCompileSupported() {
+  static int supported = -1;
+  if (supported < 0) {
+    supported = GLStateCache::hasExtension("GL_KHR_parallel_shader_compile") ||
+                GLStateCache::hasExtension("GL_ARB_parallel_shader_compile");
+    // Not loaded by gl3w. The KHR and ARB entry points are the same call.
+    using MaxThreadsProc = void (*)(GLuint);
+    auto maxThreads = reinterpret_cast<MaxThreadsProc>(
+        gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    if (!maxThreads)
+      maxThreads = reinterpret_cast<MaxThreadsProc>(
+          gl3wGetProcAddress("glMaxShaderCompilerThreadsARB"));
+    // Let the driver pick how many threads to use.
+    if (supported && maxThreads)
+      maxThreads(0xFFFFFFFF);
+  }
+  return supported;
+}
+
+void Shader::reload() {
+  // Supersede any build still in flight, the sources may have changed since.
+  if (mBuild)
+    cancelBuild();
+  mBuildError.clear();
+  mBuild = std::make_unique<Build>();
+  mBuild->requested = std::chrono::steady_clock::now();
+  mBuild->sources = std::async(std::launch::async, readSources, mVertexPath,
+                               mFragmentPath, mGeometryPath, mDefines);
+}
+
+void Shader::cancelBuild() {
+  if (mBuild->sources.valid())
+    mBuild->sources.wait();
+  for (auto stage : mBuild->stages) {
+    if (stage)
+      glDeleteShader(stage);
+  }
+  if (mBuild->program)
+    glDeleteProgram(mBuild->program);
+  mBuild.reset();
+}
+
+bool Shader::poll(bool wait) {
+  if (!mBuild)
+    return isReady();
 
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  auto v_code = vertexCode.c_str();
-  glShaderSource(vertex, 1, &v_code, NULL);
-  glCompileShader(vertex);
-  success &= checkCompileErrors(vertex, "VERTEX");
-
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  auto f_code = fragmentCode.c_str();
-  glShaderSource(fragment, 1, &f_code, NULL);
-  glCompileShader(fragment);
-  success &= checkCompileErrors(fragment, "FRAGMENT");
-  
-  // if geometry shader is given, compile geometry shader
-  if (!mGeometryPath.empty()) {
-    const char *gShaderCode = geometryCode.c_str();
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &gShaderCode, NULL);
-    glCompileShader(geometry);
-    success &= checkCompileErrors(geometry, "GEOMETRY");
+  auto &build = *mBuild;
+  if (!build.program) {
+    if (!wait && build.sources.wait_for(std::chrono::seconds(0)) !=
+                     std::future_status::ready)
+      return isReady();
+    auto sources = build.sources.get();
+    if (!sources.error.empty()) {
+      LOG_ERROR("Could not read shader sources: %s", sources.error.c_str());
+      mBuildError = std::move(sources.error);
+      mBuild.reset();
+      return isReady();
+    }
+    mIncludes = std::move(sources.includes);
+    for (int i = 0; i < NumStages; i++)
+      build.legends[i] = std::move(sources.legends[i]);
+
+    auto &cache = ProgramCache::getInstance();
+    build.key = cache.key({sources.vertex, sources.fragment, sources.geometry});
+    build.program = glCreateProgram();
+    if (cache.load(build.key, build.program)) {
+      install(build.program, "cache");
+      return true;
+    }
+    // A rejected binary may leave the program in an unusable state.
+    glDeleteProgram(build.program);
+    build.program = glCreateProgram();
+    build.start = std::chrono::steady_clock::now();
+    issueBuild(sources);
+    // Give the driver until the next poll before asking how it went, asking
+    // right away would make it finish the job on this thread.
+    if (!wait)
+      return isReady();
+  }
+
+  if (!wait && parallelCompileSupported()) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done)
+      return isReady();
   }
+  completeBuild();
+  return isReady();
+}
+
+void Shader::issueBuild(const Sources &sources) {
+  auto &build = *mBuild;
+  const std::string *code[] = {&sources.vertex, &sources.fragment,
+                               &sources.geometry};
+  const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER,
+                          GL_GEOMETRY_SHADER};
+  for (int i = 0; i < NumStages; i++) {
+    if (i == Geometry && mGeometryPath.empty())
+      continue;
+    build.stages[i] = glCreateShader(types[i]);
+    auto *text = code[i]->c_str();
+    glShaderSource(build.stages[i], 1, &text, NULL);
+    glCompileShader(build.stages[i]);
+    glAttachShader(build.program, build.stages[i]);
+  }
+  ProgramCache::getInstance().prepare(build.program);
+  glLinkProgram(build.program);
+}
+
+void Shader::completeBuild() {
+  auto &build = *mBuild;
+  const char *names[] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
+  const std::string *paths[] = {&mVertexPath, &mFragmentPath,
+                                &mGeometryPath};
+  bool success = true;
+  for (int i = 0; i < NumStages; i++) {
+    if (build.stages[i]) {
+      bool compiled =
+          checkCompileErrors(build.stages[i], names[i], *paths[i]);
+      if (!compiled && !build.legends[i].empty())
+        LOG_ERROR("Source strings: %s", build.legends[i].c_str());
+      success &= compiled;
+      glDeleteShader(build.stages[i]);
+      build.stages[i] = 0;
+    }
+  }
+  success &= checkCompileErrors(build.program, "PROGRAM",
+                                mVertexPath + " + " + mFragmentPath);
 
   if (success) {
-    mProgramID = glCreateProgram();
-    glAttachShader(mProgramID, vertex);
-    glAttachShader(mProgramID, fragment);
-    if (!mGeometryPath.empty())
-      glAttachShader(mProgramID, geometry);
-    glLinkProgram(mProgramID);
-    success &= checkCompileErrors(mProgramID, "PROGRAM");
+    std::chrono::duration<float, std::milli> elapsed =
+        std::chrono::steady_clock::now() - build.start;
+    auto &cache = ProgramCache::getInstance();
+    cache.addCompileTime(elapsed.count());
+    cache.store(build.key, build.program);
+    install(build.program, "source");
+  } else {
+    // Keep the previous program, if any, so a failed reload leaves the
+    // shader working.
+    glDeleteProgram(build.program);
+    LOG_ERROR("Keeping the previous program for %s + %s.",
+              mVertexPath.c_str(), mFragmentPath.c_str());
+    mBuild.reset();
   }
+}
 
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);  
+void Shader::install(GLuint program, const char *origin) {
+  std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - mBuild->requested;
+  mLastBuildMs = elapsed.count();
+  mBuild.reset();
+  LOG_INFO("Shader %s + %s built from %s in %.1f ms.", mVertexPath.c_str(),
+           mFragmentPath.c_str(), origin, mLastBuildMs);
+
+  if (mProgramID)
+    GLStateCache::getInstance().deleteProgram(mProgramID);
+  mProgramID = program;
+
+  // GLSL 330 has no layout(binding = N), so wire the frame block up here.
+  // Block bindings are reset by every link, binaries included.
+  auto frameBlock = glGetUniformBlockIndex(mProgramID, FrameBlockName);
+  if (frameBlock != GL_INVALID_INDEX)
+    glUniformBlockBinding(mProgramID, frameBlock, FrameBlockBinding);
+  reflectUniforms();
+}
+
+std::vector<std::string> Shader::getSourcePaths() const {
+  std::vector<std::string> paths{mVertexPath, mFragmentPath};
   if (!mGeometryPath.empty())
-    glDeleteShader(geometry);
+    paths.push_back(mGeometryPath);
+  paths.insert(paths.end(), mIncludes.begin(), mIncludes.end());
+  return paths;
+}
 
-  return success;
+Shader::Info Shader::getInfo() const {
+  return {mVertexPath, mFragmentPath, mGeometryPath, mPerBind, mDefines};
 }
 
 void Shader::use() {
-  glUseProgram(mProgramID);
+  GLStateCache::getInstance().useProgram(mProgramID);
   // Call function that is user defined at every bind.
   mPerBind(*this);
 }
 
-bool Shader::reload() {
-  return compile();
+void Shader::reflectUniforms() {
+  mUniformLocations.clear();
+
+  int count = 0, maxLength = 0;
+  glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<char> nameBuf(maxLength + 1);
+
+  auto addUniform = [this](const std::string &name) {
+    int location = glGetUniformLocation(mProgramID, name.c_str());
+    sLocationQueries++;
+    if (location >= 0)
+      mUniformLocations[name] = location;
+    return location;
+  };
+
+  for (int i = 0; i < count; i++) {
+    int size = 0, length = 0;
+    GLenum type;
+    glGetActiveUniform(mProgramID, i, (GLsizei)nameBuf.size(), &length, &size,
+                       &type, nameBuf.data());
+    std::string name(nameBuf.data(), length);
+
+    // Arrays are reported once as "name[0]", register every element as well
+    // as the bare name so that both spellings resolve.
+    auto bracket = name.rfind("[0]");
+    if (bracket != std::string::npos && bracket + 3 == name.size()) {
+      auto base = name.substr(0, bracket);
+      int first = addUniform(name);
+      if (first >= 0)
+        mUniformLocations[base] = first;
+      for (int j = 1; j < size; j++)
+        addUniform(base + "[" + std::to_string(j) + "]");
+    } else {
+      addUniform(name);
+    }
+  }
+
+  // Re-resolve any handles that were given out for the previous program.
+  for (size_t i = 0; i < mHandleNames.size(); i++)
+    mHandleLocations[i] = getLocation(mHandleNames[i]);
+}
+
+int Shader::getLocation(const std::string &name) const {
+  // Uniforms missing from the table are inactive, the driver would hand back
+  // -1 for them anyway.
+  auto iter = mUniformLocations.find(name);
+  return iter != mUniformLocations.end() ? iter->second : -1;
+}
+
+Shader::UniformHandle Shader::getUniformHandle(const std::string &name) {
+  for (size_t i = 0; i < mHandleNames.size(); i++) {
+    if (mHandleNames[i] == name)
+      return UniformHandle{int(i)};
+  }
+  mHandleNames.push_back(name);
+  mHandleLocations.push_back(getLocation(name));
+  return UniformHandle{int(mHandleNames.size() - 1)};
 }
 
 void Shader::setBool(const std::string &name, bool value) const {
-  glUniform1i(glGetUniformLocation(mProgramID, name.c_str()), (int)value);
+  glUniform1i(getLocation(name), (int)value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-  glUniform1i(glGetUniformLocation(mProgramID, name.c_str()), value);
+  glUniform1i(getLocation(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-  glUniform1f(glGetUniformLocation(mProgramID, name.c_str()), value);
+  glUniform1f(getLocation(name), value);
 }
 
 void Shader::setMatrix(const std::string &name, mat4 value) const {
-  glUniformMatrix4fv(glGetUniformLocation(mProgramID, name.c_str()), 1,
-                     GL_FALSE, &value[0][0]);
+  glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, &value[0][0]);
 }
 
 void Shader::setVec2(const std::string &name, const vec2 &value) const {
-  glUniform2fv(glGetUniformLocation(mProgramID, name.c_str()), 1, &value[0]);
+  glUniform2fv(getLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec2(const std::string &name, float x, float y) const {
-  glUniform2f(glGetUniformLocation(mProgramID, name.c_str()), x, y);
+  glUniform2f(getLocation(name), x, y);
 }
 
 void Shader::setVec3(const std::string &name, const vec3 &value) const {
-  glUniform3fv(glGetUniformLocation(mProgramID, name.c_str()), 1, &value[0]);
+  glUniform3fv(getLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec3(const std::string &name, float x, float y, float z) const {
-  glUniform3f(glGetUniformLocation(mProgramID, name.c_str()), x, y, z);
+  glUniform3f(getLocation(name), x, y, z);
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const {
+  glUniform1i(getLocation(handle), (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const {
+  glUniform1i(getLocation(handle), value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const {
+  glUniform1f(getLocation(handle), value);
+}
+
+void Shader::setMatrix(UniformHandle handle, const mat4 &value) const {
+  glUniformMatrix4fv(getLocation(handle), 1, GL_FALSE, &value[0][0]);
+}
+
+void Shader::setVec2(UniformHandle handle, const vec2 &value) const {
+  glUniform2fv(getLocation(handle), 1, &value[0]);
+}
+
+void Shader::setVec3(UniformHandle handle, const vec3 &value) const {
+  glUniform3fv(getLocation(handle), 1, &value[0]);
 }
 
-bool Shader::checkCompileErrors(unsigned int shader, std::string type) {
+bool Shader::checkCompileErrors(unsigned int shader, std::string type,
+                                const std::string &path) {
   int success;
   char infoLog[1024];
   if (type != "PROGRAM") {
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
       glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-      std::cout
-          << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n"
-          << infoLog
-          << "\n -- --------------------------------------------------- -- "
-          << std::endl;
+      LOG_ERROR("%s shader %s failed to compile:\n%s", type.c_str(),
+                path.c_str(), infoLog);
+      mBuildError += path + ":\n" + infoLog;
     }
   } else {
     glGetProgramiv(shader, GL_LINK_STATUS, &success);
     if (!success) {
       glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-      std::cout
-          << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n"
-          << infoLog
-          << "\n -- --------------------------------------------------- -- "
-          << std::endl;
+      LOG_ERROR("Program %s failed to link:\n%s", path.c_str(), infoLog);
+      mBuildError += path + ":\n" + infoLog;
     }
   }
   return success;
@@ -0,0 +1,194 @@
+#include <algorithm>
+
+#include <Engine/GLStateCache.h>
+#include <Engine/Log.h>
+#include <Engine/StreamBuffer.h>
+
+namespace Engine {
+
+namespace {
+
+inline size_t roundUp(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+inline bool overlaps(size_t b0, size_t e0, size_t b1, size_t e1) {
+  return b0 < e1 && b1 < e0;
+}
+
+// Writes go through GL_COPY_WRITE_BUFFER so that mapping never disturbs the
+// array or element buffer bindings, the latter being part of the bound VAO.
+constexpr GLenum WriteTarget = GL_COPY_WRITE_BUFFER;
+constexpr GLbitfield PersistentFlags =
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+} // namespace
+
+bool StreamBuffer::persistentMappingSupported() {
+  if (!glBufferStorage)
+    return false;
+  return gl3wIsSupported(4, 4) ||
+         GLStateCache::hasExtension("GL_ARB_buffer_storage");
+}
+
+StreamBuffer::StreamBuffer(size_t size)
+    : mPersistent(persistentMappingSupported()) {
+  createStorage(size);
+  LOG_DEBUG("Stream buffer of %zu KB, %s.", size / 1024,
+            mPersistent ? "persistently mapped" : "orphaning");
+}
+
+StreamBuffer::~StreamBuffer() { destroyStorage(); }
+
+void StreamBuffer::createStorage(size_t size) {
+  mSize = size;
+  glGenBuffers(1, &mBuffer);
+  auto &state = GLStateCache::getInstance();
+  state.bindBuffer(WriteTarget, mBuffer);
+  if (mPersistent) {
+    glBufferStorage(WriteTarget, mSize, nullptr, PersistentFlags);
+    mMapped = static_cast<char *>(
+        glMapBufferRange(WriteTarget, 0, mSize, PersistentFlags));
+  } else {
+    glBufferData(WriteTarget, mSize, nullptr, GL_STREAM_DRAW);
+  }
+  LOG_IF_GL_ERR();
+  mGeneration++;
+  mHead = mFrameBegin = mFrameUsed = 0;
+}
+
+void StreamBuffer::destroyStorage() {
+  commit();
+  dropFences();
+  auto &state = GLStateCache::getInstance();
+  if (mMapped) {
+    state.bindBuffer(WriteTarget, mBuffer);
+    glUnmapBuffer(WriteTarget);
+    mMapped = nullptr;
+  }
+  // Deleting a buffer detaches it from the bound VAO only, VAOs that are not
+  // bound keep it alive until they are re-pointed.
+  state.bindVertexArray(0);
+  state.deleteBuffer(mBuffer);
+  mBuffer = 0;
+}
+
+void StreamBuffer::dropFences() {
+  for (auto &fence : mFences)
+    glDeleteSync(fence.sync);
+  mFences.clear();
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(size_t bytes,
+                                                size_t alignment) {
+  commit();
+
+  size_t offset = roundUp(mHead, alignment);
+  bool wrap = offset + bytes > mSize;
+  if (wrap)
+    offset = 0;
+  // Everything this frame wrote is still waiting to be drawn, a frame can
+  // never lap itself. Grow instead, the old storage lives on until the draws
+  // already recorded against it are done.
+  size_t frameUsed = mFrameUsed + (wrap ? mSize - mHead : offset - mHead) +
+                     bytes;
+  if (frameUsed > mSize) {
+    size_t size = std::max(2 * mSize, roundUp(3 * frameUsed, alignment));
+    LOG_DEBUG("Stream buffer growing to %zu KB.", size / 1024);
+    destroyStorage();
+    createStorage(size);
+    mStats.grows++;
+    wrap = false;
+    offset = 0;
+  }
+
+  if (wrap) {
+    if (!mPersistent && mFrameUsed == 0) {
+      // Nothing of this frame lives in the old storage, so let the driver
+      // hand us fresh memory rather than wait for the GPU to catch up.
+      GLStateCache::getInstance().bindBuffer(WriteTarget, mBuffer);
+      glBufferData(WriteTarget, mSize, nullptr, GL_STREAM_DRAW);
+      dropFences();
+      mStats.orphans++;
+    } else {
+      mFrameUsed += mSize - mHead;
+    }
+    mHead = 0;
+  }
+  if (mFrameUsed == 0)
+    mFrameBegin = offset;
+  waitForRange(offset, offset + bytes);
+  mFrameUsed += offset - mHead + bytes;
+  mHead = offset + bytes;
+
+  Allocation allocation;
+  allocation.offset = offset;
+  if (bytes == 0)
+    return allocation;
+  if (mPersistent) {
+    allocation.data = mMapped + offset;
+  } else {
+    GLStateCache::getInstance().bindBuffer(WriteTarget, mBuffer);
+    allocation.data = glMapBufferRange(
+        WriteTarget, offset, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT);
+    mMappedRange = true;
+  }
+  return allocation;
+}
+
+void StreamBuffer::commit() {
+  if (!mMappedRange)
+    return;
+  GLStateCache::getInstance().bindBuffer(WriteTarget, mBuffer);
+  glUnmapBuffer(WriteTarget);
+  mMappedRange = false;
+}
+
+void StreamBuffer::fence() {
+  commit();
+  if (mFrameUsed == 0)
+    return;
+  auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  mFences.push_back(Fence{mFrameBegin, mHead, sync});
+  mFrameUsed = 0;
+}
+
+void StreamBuffer::waitForRange(size_t begin, size_t end) {
+  // Find the newest frame still reading the range. Fences signal in order,
+  // so once it has signalled every older one has too.
+  auto newest = mFences.rend();
+  for (auto iter = mFences.rbegin(); iter != mFences.rend(); ++iter) {
+    // A frame that wrapped covers [begin, size) and [0, end).
+    bool hit = iter->begin < iter->end
+                   ? overlaps(iter->begin, iter->end, begin, end)
+                   : overlaps(iter->begin, mSize, begin, end) ||
+                         overlaps(0, iter->end, begin, end);
+    if (hit) {
+      newest = iter;
+      break;
+    }
+  }
+  if (newest == mFences.rend())
+    return;
+
+  auto result = glClientWaitSync(newest->sync, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    mStats.stalls++;
+    do {
+      result = glClientWaitSync(newest->sync, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+  if (result == GL_WAIT_FAILED)
+    LOG_ERROR("Waiting on a stream buffer fence failed.");
+
+  size_t done = mFences.rend() - newest;
+  for (size_t i = 0; i < done; i++) {
+    glDeleteSync(mFences.front().sync);
+    mFences.pop_front();
+  }
+}
+
+} // namespace Engine
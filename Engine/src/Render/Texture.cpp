@@ -1,35 +1,175 @@
 #include <GL/gl3w.h>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
+#include <Engine/GLStateCache.h>
+#include <Engine/Log.h>
 #include <Engine/Texture.h>
+#include <Engine/TextureFormats.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <Engine/stb_image.h>
 
 namespace Engine {
 
-Texture::Texture(const std::string &path) {
+namespace {
+
+const GLenum Formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+const GLint InternalFormats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+
+} // namespace
+
+Texture::Texture() {
   glGenTextures(1, &mTexture);
-  glBindTexture(GL_TEXTURE_2D, mTexture);
+  GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTexture);
   // set the texture wrapping/filtering options (on the currently bound
   // texture object)
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // load and generate the texture
-  stbi_set_flip_vertically_on_load(true);
-  mData = stbi_load(path.c_str(), &mWidth, &mHeight, &mNumChannels, 0);
-  if (mData) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, mWidth, mWidth, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, mData);
+  // Mid grey until the real image is resident.
+  const unsigned char placeholder[] = {128, 128, 128, 255};
+  setImage(1, 1, 4, placeholder);
+}
+
+Texture::Texture(const std::string &path) : Texture() {
+  auto image = decode(path);
+  if (!image.data() || !isSupported(image)) {
+    LOG_ERROR("Failed to load texture %s: %s", path.c_str(),
+              image.data() ? "format not supported" : image.error.c_str());
+    setFailed();
+    return;
+  }
+  setImage(image, image.data());
+  finishUpload();
+}
+
+Texture::~Texture() { GLStateCache::getInstance().deleteTexture(mTexture); }
+
+Texture::Image Texture::decode(const std::string &path) {
+  if (TextureFormats::isCompressed(path))
+    return TextureFormats::readCompressed(path);
+
+  Image image;
+  // The flip flag is global in stb_image, flip here instead so decodes on
+  // other threads are not affected.
+  // Decode straight out of the mapped file rather than through stdio.
+  MappedFile file(path);
+  if (!file.isOpen()) {
+    image.error = "could not open file";
+    return image;
+  }
+  image.pixels = {stbi_load_from_memory(file.data(), int(file.size()),
+                                        &image.width, &image.height,
+                                        &image.channels, 0),
+                  stbi_image_free};
+  if (!image.pixels) {
+    // The reason is shared between threads, it may belong to a concurrent
+    // decode that failed too.
+    auto *reason = stbi_failure_reason();
+    image.error = reason ? reason : "unknown error";
+    return image;
+  }
+
+  size_t stride = size_t(image.width) * image.channels;
+  std::vector<unsigned char> row(stride);
+  auto *pixels = image.pixels.get();
+  for (int top = 0, bottom = image.height - 1; top < bottom; top++, bottom--) {
+    memcpy(row.data(), pixels + top * stride, stride);
+    memcpy(pixels + top * stride, pixels + bottom * stride, stride);
+    memcpy(pixels + bottom * stride, row.data(), stride);
+  }
+  return image;
+}
+
+bool Texture::isSupported(const Image &image) {
+  switch (image.format) {
+  case 0:
+  case GL_COMPRESSED_RG_RGTC2:
+    return true;
+  case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    return GLStateCache::hasExtension("GL_EXT_texture_compression_s3tc");
+  case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    return gl3wIsSupported(4, 2) ||
+           GLStateCache::hasExtension("GL_ARB_texture_compression_bptc");
+  default:
+    return false;
+  }
+}
+
+void Texture::setImage(const Image &image, const unsigned char *pixels) {
+  if (!image.format) {
+    setImage(image.width, image.height, image.channels, pixels);
+    return;
+  }
+
+  mWidth = image.width;
+  mHeight = image.height;
+  mNumChannels = image.channels;
+  mFormat = image.format;
+  mBytes = 0;
+  GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTexture);
+  // The chain comes with the file, tell GL where it ends in case it stops
+  // short of 1x1.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  GLint(image.levels.size() - 1));
+  const GLint swizzle[] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  for (size_t i = 0; i < image.levels.size(); i++) {
+    const auto &level = image.levels[i];
+    // An offset into the unpack buffer when pixels is null.
+    auto *data = reinterpret_cast<const void *>(
+        reinterpret_cast<uintptr_t>(pixels) + level.offset);
+    glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), mFormat,
+                           std::max(1, mWidth >> i),
+                           std::max(1, mHeight >> i), 0,
+                           GLsizei(level.size), data);
+    mBytes += level.size;
+  }
+}
+
+void Texture::setImage(int width, int height, int channels,
+                       const void *pixels) {
+  mWidth = width;
+  mHeight = height;
+  mNumChannels = channels;
+  mFormat = 0;
+  // Drivers pad RGB8 out to 4 bytes per texel.
+  mBytes = size_t(width) * height * (channels == 3 ? 4 : channels);
+  GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTexture);
+  // Rows of 1 to 3 channel images are not 4 byte aligned in general.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, InternalFormats[channels - 1], width, height,
+               0, Formats[channels - 1], GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // Grey and grey + alpha images sample as grey rather than red.
+  const GLint swizzles[][4] = {{GL_RED, GL_RED, GL_RED, GL_ONE},
+                               {GL_RED, GL_RED, GL_RED, GL_GREEN},
+                               {GL_RED, GL_GREEN, GL_BLUE, GL_ONE},
+                               {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA,
+                   swizzles[channels - 1]);
+}
+
+void Texture::finishUpload() {
+  // Compressed textures bring their own mip chain.
+  if (!mFormat) {
+    GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTexture);
     glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cerr << "Failed to load texture" << std::endl;
-    std::cerr << stbi_failure_reason() << std::endl;
+    // A full mip chain adds a third.
+    mBytes += mBytes / 3;
   }
-  stbi_image_free(mData);
+  mState = State::Resident;
 }
 
-void Texture::bind() { glBindTexture(GL_TEXTURE_2D, mTexture); }
+void Texture::setFailed() { mState = State::Failed; }
+
+void Texture::bind(uint unit) {
+  GLStateCache::getInstance().bindTexture(unit, GL_TEXTURE_2D, mTexture);
+}
 
 } // namespace Engine
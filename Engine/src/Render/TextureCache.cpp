@@ -0,0 +1,120 @@
+#include <filesystem>
+
+#include <Engine/Log.h>
+#include <Engine/TextureCache.h>
+#include <Engine/TextureLoader.h>
+#include <imgui/imgui.h>
+
+namespace Engine {
+
+namespace {
+
+std::string resolve(const std::string &path) {
+  // Follows symlinks where the file exists, and only normalizes otherwise.
+  std::error_code error;
+  auto resolved = std::filesystem::weakly_canonical(path, error);
+  return error ? path : resolved.string();
+}
+
+} // namespace
+
+sptr<Texture> TextureCache::get(const std::string &path) {
+  auto key = resolve(path);
+  auto iter = mEntries.find(key);
+  if (iter != mEntries.end()) {
+    mStats.hits++;
+    mRecent.splice(mRecent.begin(), mRecent, iter->second.recent);
+    return iter->second.texture;
+  }
+
+  mStats.misses++;
+  mRecent.push_front(key);
+  auto texture = TextureLoader::getInstance().load(path);
+  mEntries[key] = Entry{texture, mRecent.begin()};
+  return texture;
+}
+
+void TextureCache::trim() {
+  size_t bytes = 0;
+  for (const auto &entry : mEntries)
+    bytes += entry.second.texture->memoryBytes();
+
+  // Oldest first, skipping whatever is still in use.
+  auto iter = mRecent.end();
+  while (bytes > mBudget && iter != mRecent.begin()) {
+    const auto &entry = mEntries[*--iter];
+    if (!isUnused(entry))
+      continue;
+    bytes -= entry.texture->memoryBytes();
+    auto key = *iter++;
+    evict(key);
+  }
+  mStats.residentBytes = bytes;
+}
+
+void TextureCache::clear() {
+  for (auto iter = mRecent.begin(); iter != mRecent.end();) {
+    auto key = *iter++;
+    if (isUnused(mEntries[key]))
+      evict(key);
+  }
+}
+
+void TextureCache::evict(const std::string &key) {
+  auto iter = mEntries.find(key);
+  LOG_DEBUG("Evicting texture %s.", key.c_str());
+  mRecent.erase(iter->second.recent);
+  mEntries.erase(iter);
+  mStats.evictions++;
+}
+
+void TextureCache::draw(bool *p_open) {
+  if (!ImGui::Begin("Texture Cache", p_open)) {
+    ImGui::End();
+    return;
+  }
+
+  uint lookups = mStats.hits + mStats.misses;
+  ImGui::Text("Hits: %u, misses: %u (%.1f%% hit rate)", mStats.hits,
+              mStats.misses, lookups ? 100.0f * mStats.hits / lookups : 0.0f);
+  ImGui::Text("Resident: %.1f / %.1f MB, %zu textures, %u evicted",
+              mStats.residentBytes / float(1 << 20), mBudget / float(1 << 20),
+              mEntries.size(), mStats.evictions);
+  ImGui::Text("Loading: %u", TextureLoader::getInstance().getNumPending());
+  ImGui::Separator();
+
+  ImGui::Columns(4, "textures");
+  ImGui::Text("Path");
+  ImGui::NextColumn();
+  ImGui::Text("Size");
+  ImGui::NextColumn();
+  ImGui::Text("KB");
+  ImGui::NextColumn();
+  ImGui::Text("Users");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (const auto &key : mRecent) {
+    const auto &texture = *mEntries[key].texture;
+    ImGui::Text("%s", std::filesystem::path(key).filename().c_str());
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("%s", key.c_str());
+    ImGui::NextColumn();
+    if (texture.isResident())
+      ImGui::Text("%dx%dx%d", texture.width(), texture.height(),
+                  texture.channels());
+    else
+      ImGui::Text("%s", texture.state() == Texture::State::Failed
+                            ? "failed"
+                            : "loading");
+    ImGui::NextColumn();
+    ImGui::Text("%zu", texture.memoryBytes() >> 10);
+    ImGui::NextColumn();
+    // Less the cache's own reference.
+    ImGui::Text("%ld", long(mEntries[key].texture.use_count() - 1));
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::End();
+}
+
+} // namespace Engine
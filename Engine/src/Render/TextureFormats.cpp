@@ -0,0 +1,581 @@
+#include <GL/gl3w.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Engine/TextureFormats.h>
+
+namespace Engine {
+namespace TextureFormats {
+
+namespace {
+
+// Container headers, read and written as is, so little endian only.
+
+constexpr uint32_t fourCC(char a, char b, char c, char d) {
+  return uint32_t(a) | uint32_t(b) << 8 | uint32_t(c) << 16 |
+         uint32_t(d) << 24;
+}
+
+constexpr uint32_t DDSMagic = fourCC('D', 'D', 'S', ' ');
+
+struct DDSPixelFormat {
+  uint32_t size, flags, fourCC, rgbBitCount;
+  uint32_t rMask, gMask, bMask, aMask;
+};
+
+struct DDSHeader {
+  uint32_t size, flags, height, width, pitchOrLinearSize, depth;
+  uint32_t mipMapCount, reserved1[11];
+  DDSPixelFormat pixelFormat;
+  uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+static_assert(sizeof(DDSHeader) == 124, "DDS header layout");
+
+struct DDSHeaderDX10 {
+  uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+};
+
+// The few DDS flags and DXGI formats that matter here.
+constexpr uint32_t DDSDMipMapCount = 0x20000;
+constexpr uint32_t DDSDRequired = 0x1 | 0x2 | 0x4 | 0x1000; // caps, h, w, pf
+constexpr uint32_t DDSDLinearSize = 0x80000;
+constexpr uint32_t DDPFFourCC = 0x4;
+constexpr uint32_t DDSCapsTexture = 0x1000, DDSCapsComplex = 0x8,
+                   DDSCapsMipMap = 0x400000;
+constexpr uint32_t DXGIBC1 = 71, DXGIBC3 = 77, DXGIBC5 = 83, DXGIBC7 = 98;
+constexpr uint32_t D3D10Texture2D = 3;
+
+const uint8_t KTXIdentifier[12] = {0xAB, 'K',  'T',  'X',  ' ',  '1',
+                                   '1',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct KTXHeader {
+  uint8_t identifier[12];
+  uint32_t endianness, glType, glTypeSize, glFormat, glInternalFormat;
+  uint32_t glBaseInternalFormat, pixelWidth, pixelHeight, pixelDepth;
+  uint32_t numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+  uint32_t bytesOfKeyValueData;
+};
+static_assert(sizeof(KTXHeader) == 64, "KTX header layout");
+
+size_t levelSize(uint format, int width, int height) {
+  size_t blocksX = std::max(1, (width + 3) / 4);
+  size_t blocksY = std::max(1, (height + 3) / 4);
+  return blocksX * blocksY * blockBytes(format);
+}
+
+int numLevels(int width, int height) {
+  int levels = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    levels++;
+  }
+  return levels;
+}
+
+Texture::Image fail(std::string error) {
+  Texture::Image image;
+  image.error = std::move(error);
+  return image;
+}
+
+/// Lay the levels out one after the other from \p offset, and check they
+/// fit in \p fileSize.
+bool layoutLevels(Texture::Image &image, int count, size_t offset,
+                  size_t fileSize) {
+  for (int i = 0; i < count; i++) {
+    size_t size = levelSize(image.format, std::max(1, image.width >> i),
+                            std::max(1, image.height >> i));
+    image.levels.push_back({offset, size});
+    offset += size;
+  }
+  return offset <= fileSize;
+}
+
+uint ddsFormat(const DDSHeader &header, const DDSHeaderDX10 *dx10) {
+  if (dx10) {
+    switch (dx10->dxgiFormat) {
+    case DXGIBC1: return glFormat(Block::BC1);
+    case DXGIBC3: return glFormat(Block::BC3);
+    case DXGIBC5: return glFormat(Block::BC5);
+    case DXGIBC7: return glFormat(Block::BC7);
+    default: return 0;
+    }
+  }
+  if (!(header.pixelFormat.flags & DDPFFourCC))
+    return 0;
+  switch (header.pixelFormat.fourCC) {
+  case fourCC('D', 'X', 'T', '1'): return glFormat(Block::BC1);
+  case fourCC('D', 'X', 'T', '5'): return glFormat(Block::BC3);
+  case fourCC('A', 'T', 'I', '2'):
+  case fourCC('B', 'C', '5', 'U'): return glFormat(Block::BC5);
+  default: return 0;
+  }
+}
+
+Texture::Image readDDS(const MappedFile &file) {
+  Texture::Image image;
+  uint32_t magic;
+  DDSHeader header;
+  if (file.size() < 4 + sizeof(header))
+    return fail("truncated DDS header");
+  memcpy(&magic, file.data(), 4);
+  memcpy(&header, file.data() + 4, sizeof(header));
+  if (magic != DDSMagic || header.size != sizeof(header))
+    return fail("not a DDS file");
+
+  size_t offset = 4 + sizeof(header);
+  DDSHeaderDX10 dx10;
+  bool hasDX10 = (header.pixelFormat.flags & DDPFFourCC) &&
+                 header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0');
+  if (hasDX10) {
+    if (file.size() < offset + sizeof(dx10))
+      return fail("truncated DX10 header");
+    memcpy(&dx10, file.data() + offset, sizeof(dx10));
+    offset += sizeof(dx10);
+    if (dx10.resourceDimension != D3D10Texture2D || dx10.arraySize > 1)
+      return fail("only single 2D textures are supported");
+  }
+  if (header.caps2 != 0 || header.depth > 1)
+    return fail("cube maps and volumes are not supported");
+
+  image.format = ddsFormat(header, hasDX10 ? &dx10 : nullptr);
+  if (!image.format)
+    return fail("not BC1, BC3, BC5 or BC7");
+  image.width = int(header.width);
+  image.height = int(header.height);
+  image.channels = image.format == glFormat(Block::BC5) ? 2 : 4;
+  int levels = header.flags & DDSDMipMapCount
+                   ? std::max(1, int(header.mipMapCount))
+                   : 1;
+  levels = std::min(levels, numLevels(image.width, image.height));
+  if (!layoutLevels(image, levels, offset, file.size()))
+    return fail("truncated DDS data");
+  return image;
+}
+
+Texture::Image readKTX(const MappedFile &file) {
+  Texture::Image image;
+  KTXHeader header;
+  if (file.size() < sizeof(header))
+    return fail("truncated KTX header");
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.identifier, KTXIdentifier, sizeof(KTXIdentifier)) != 0)
+    return fail("not a KTX 1.1 file");
+  if (header.endianness != 0x04030201)
+    return fail("big endian KTX files are not supported");
+  if (header.glType != 0 || blockBytes(header.glInternalFormat) == 0)
+    return fail("not BC1, BC3, BC5 or BC7");
+  if (header.pixelDepth > 1 || header.numberOfArrayElements > 1 ||
+      header.numberOfFaces != 1)
+    return fail("only single 2D textures are supported");
+
+  image.format = header.glInternalFormat;
+  image.width = int(header.pixelWidth);
+  image.height = int(std::max(1u, header.pixelHeight));
+  image.channels = image.format == glFormat(Block::BC5) ? 2 : 4;
+  // Each level is preceded by its size and padded to 4 bytes.
+  size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+  int levels = std::min(int(std::max(1u, header.numberOfMipmapLevels)),
+                        numLevels(image.width, image.height));
+  for (int i = 0; i < levels; i++) {
+    uint32_t imageSize;
+    if (file.size() < offset + 4)
+      return fail("truncated KTX data");
+    memcpy(&imageSize, file.data() + offset, 4);
+    size_t size = levelSize(image.format, std::max(1, image.width >> i),
+                            std::max(1, image.height >> i));
+    if (imageSize != size || file.size() < offset + 4 + size)
+      return fail("truncated KTX data");
+    image.levels.push_back({offset + 4, size});
+    offset += 4 + (size + 3) / 4 * 4;
+  }
+  return image;
+}
+
+// Encoding. Endpoints come from a range fit along the principal axis of
+// each block's colours, which is fast and good enough for offline
+// conversion of diffuse textures.
+
+using Block4x4 = glm::vec4[16];
+
+/// Principal axis of \p count points, by power iteration on the covariance.
+template <int N>
+glm::vec<N, float> principalAxis(const glm::vec<N, float> *points,
+                                 int count, glm::vec<N, float> &mean) {
+  using Vec = glm::vec<N, float>;
+  mean = Vec(0.0f);
+  for (int i = 0; i < count; i++)
+    mean += points[i];
+  mean /= float(count);
+  glm::mat<N, N, float> covariance(0.0f);
+  for (int i = 0; i < count; i++) {
+    auto d = points[i] - mean;
+    covariance += glm::outerProduct(d, d);
+  }
+  Vec axis(1.0f);
+  for (int i = 0; i < 8; i++) {
+    axis = covariance * axis;
+    float length = glm::length(axis);
+    if (length < 1e-6f)
+      return Vec(0.0f);
+    axis /= length;
+  }
+  return axis;
+}
+
+/// Extreme points of \p count points along their principal axis.
+template <int N>
+void rangeFit(const glm::vec<N, float> *points, int count,
+              glm::vec<N, float> &low, glm::vec<N, float> &high) {
+  glm::vec<N, float> mean;
+  auto axis = principalAxis<N>(points, count, mean);
+  float minT = 0.0f, maxT = 0.0f;
+  for (int i = 0; i < count; i++) {
+    float t = glm::dot(points[i] - mean, axis);
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+  low = glm::clamp(mean + minT * axis, 0.0f, 255.0f);
+  high = glm::clamp(mean + maxT * axis, 0.0f, 255.0f);
+}
+
+uint16_t pack565(const glm::vec3 &c) {
+  return uint16_t(int(std::round(c.r * 31.0f / 255.0f)) << 11 |
+                  int(std::round(c.g * 63.0f / 255.0f)) << 5 |
+                  int(std::round(c.b * 31.0f / 255.0f)));
+}
+
+glm::vec3 unpack565(uint16_t c) {
+  int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+  return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4),
+                   (b << 3) | (b >> 2));
+}
+
+template <typename T> void putLE(uint8_t *out, T value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    out[i] = uint8_t(uint64_t(value) >> (8 * i));
+}
+
+/// 8 bytes, always in four colour mode so it also serves BC3.
+void encodeBC1(const Block4x4 &block, uint8_t *out) {
+  glm::vec3 colours[16], low, high;
+  for (int i = 0; i < 16; i++)
+    colours[i] = glm::vec3(block[i]);
+  rangeFit<3>(colours, 16, low, high);
+
+  uint16_t c0 = pack565(high), c1 = pack565(low);
+  if (c0 < c1)
+    std::swap(c0, c1);
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    glm::vec3 e0 = unpack565(c0), e1 = unpack565(c1);
+    glm::vec3 palette[4] = {e0, e1, (2.0f * e0 + e1) / 3.0f,
+                            (e0 + 2.0f * e1) / 3.0f};
+    for (int i = 0; i < 16; i++) {
+      uint32_t best = 0;
+      float bestError = INFINITY;
+      for (uint32_t j = 0; j < 4; j++) {
+        auto d = colours[i] - palette[j];
+        float error = glm::dot(d, d);
+        if (error < bestError) {
+          bestError = error;
+          best = j;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
+  putLE(out, c0, 2);
+  putLE(out + 2, c1, 2);
+  putLE(out + 4, indices, 4);
+}
+
+/// 8 bytes, one channel in eight value mode. Shared by BC3 and BC5.
+void encodeBC4(const Block4x4 &block, int channel, uint8_t *out) {
+  float low = 255.0f, high = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    low = std::min(low, block[i][channel]);
+    high = std::max(high, block[i][channel]);
+  }
+  uint8_t a0 = uint8_t(std::round(high)), a1 = uint8_t(std::round(low));
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    for (int i = 0; i < 16; i++) {
+      // Step from a1 (0) to a0 (7), then map to the codes in between.
+      int step = int(std::round((block[i][channel] - a1) * 7.0f / (a0 - a1)));
+      step = std::min(7, std::max(0, step));
+      uint64_t code = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+      indices |= code << (3 * i);
+    }
+  }
+  out[0] = a0;
+  out[1] = a1;
+  putLE(out + 2, indices, 6);
+}
+
+/// Writes fields of a 128 bit block, least significant bit first.
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *out) : mOut(out) { memset(mOut, 0, 16); }
+  void put(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, mBit++) {
+      if (value >> i & 1)
+        mOut[mBit / 8] |= uint8_t(1 << (mBit % 8));
+    }
+  }
+
+private:
+  uint8_t *mOut;
+  int mBit = 0;
+};
+
+/// 16 bytes, mode 6 only: one subset, RGBA endpoints of 7 bits plus a
+/// shared low bit each, and 4 bit indices.
+void encodeBC7(const Block4x4 &block, uint8_t *out) {
+  static const int Weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                  34, 38, 43, 47, 51, 55, 60, 64};
+  glm::vec4 low, high;
+  rangeFit<4>(block, 16, low, high);
+
+  // Quantize each endpoint, picking the low bit that fits it best.
+  glm::ivec4 ends[2];
+  int pbits[2];
+  glm::vec4 targets[2] = {low, high};
+  for (int e = 0; e < 2; e++) {
+    float bestError = INFINITY;
+    for (int p = 0; p < 2; p++) {
+      auto q = glm::clamp(glm::ivec4(glm::round((targets[e] - float(p)) /
+                                                2.0f)),
+                          0, 127);
+      auto d = glm::vec4(q * 2 + p) - targets[e];
+      float error = glm::dot(d, d);
+      if (error < bestError) {
+        bestError = error;
+        ends[e] = q;
+        pbits[e] = p;
+      }
+    }
+  }
+
+  glm::vec4 e0 = glm::vec4(ends[0] * 2 + pbits[0]);
+  glm::vec4 e1 = glm::vec4(ends[1] * 2 + pbits[1]);
+  int indices[16];
+  for (int i = 0; i < 16; i++) {
+    float bestError = INFINITY;
+    for (int j = 0; j < 16; j++) {
+      float w = float(Weights[j]);
+      auto c = glm::floor(((64.0f - w) * e0 + w * e1 + 32.0f) / 64.0f);
+      auto d = block[i] - c;
+      float error = glm::dot(d, d);
+      if (error < bestError) {
+        bestError = error;
+        indices[i] = j;
+      }
+    }
+  }
+  // The first index is stored without its top bit, which must be 0.
+  if (indices[0] >= 8) {
+    std::swap(ends[0], ends[1]);
+    std::swap(pbits[0], pbits[1]);
+    for (auto &index : indices)
+      index = 15 - index;
+  }
+
+  BitWriter bits(out);
+  bits.put(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    bits.put(ends[0][c], 7);
+    bits.put(ends[1][c], 7);
+  }
+  bits.put(pbits[0], 1);
+  bits.put(pbits[1], 1);
+  for (int i = 0; i < 16; i++)
+    bits.put(indices[i], i == 0 ? 3 : 4);
+}
+
+/// One mip level as RGBA floats.
+struct Level {
+  int width, height;
+  std::vector<glm::vec4> pixels;
+};
+
+Level toRGBA(const Texture::Image &image) {
+  Level level{image.width, image.height, {}};
+  level.pixels.resize(size_t(image.width) * image.height);
+  const uint8_t *src = image.pixels.get();
+  for (size_t i = 0; i < level.pixels.size(); i++, src += image.channels) {
+    switch (image.channels) {
+    case 1: level.pixels[i] = glm::vec4(src[0], src[0], src[0], 255); break;
+    case 2: level.pixels[i] = glm::vec4(src[0], src[0], src[0], src[1]); break;
+    case 3: level.pixels[i] = glm::vec4(src[0], src[1], src[2], 255); break;
+    default: level.pixels[i] = glm::vec4(src[0], src[1], src[2], src[3]);
+    }
+  }
+  return level;
+}
+
+/// Box filter down to half size, odd edges reuse their last texel.
+Level downsample(const Level &level) {
+  Level half{std::max(1, level.width / 2), std::max(1, level.height / 2), {}};
+  half.pixels.resize(size_t(half.width) * half.height);
+  for (int y = 0; y < half.height; y++) {
+    int y0 = std::min(2 * y, level.height - 1);
+    int y1 = std::min(2 * y + 1, level.height - 1);
+    for (int x = 0; x < half.width; x++) {
+      int x0 = std::min(2 * x, level.width - 1);
+      int x1 = std::min(2 * x + 1, level.width - 1);
+      half.pixels[y * half.width + x] =
+          0.25f * (level.pixels[y0 * level.width + x0] +
+                   level.pixels[y0 * level.width + x1] +
+                   level.pixels[y1 * level.width + x0] +
+                   level.pixels[y1 * level.width + x1]);
+    }
+  }
+  return half;
+}
+
+void encodeLevel(const Level &level, Block format, uint8_t *out) {
+  Block4x4 block;
+  for (int by = 0; by < level.height; by += 4) {
+    for (int bx = 0; bx < level.width; bx += 4) {
+      // Blocks hanging over the edge repeat the last row and column.
+      for (int i = 0; i < 16; i++) {
+        int x = std::min(bx + i % 4, level.width - 1);
+        int y = std::min(by + i / 4, level.height - 1);
+        block[i] = level.pixels[y * level.width + x];
+      }
+      switch (format) {
+      case Block::BC1:
+        encodeBC1(block, out);
+        out += 8;
+        break;
+      case Block::BC3:
+        encodeBC4(block, 3, out);
+        encodeBC1(block, out + 8);
+        out += 16;
+        break;
+      case Block::BC5:
+        encodeBC4(block, 0, out);
+        encodeBC4(block, 1, out + 8);
+        out += 16;
+        break;
+      case Block::BC7:
+        encodeBC7(block, out);
+        out += 16;
+        break;
+      }
+    }
+  }
+}
+
+} // namespace
+
+uint glFormat(Block block) {
+  switch (block) {
+  case Block::BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+  case Block::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case Block::BC5: return GL_COMPRESSED_RG_RGTC2;
+  case Block::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+  return 0;
+}
+
+uint blockBytes(uint format) {
+  switch (format) {
+  case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return 8;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+  case GL_COMPRESSED_RG_RGTC2:
+  case GL_COMPRESSED_RGBA_BPTC_UNORM: return 16;
+  default: return 0;
+  }
+}
+
+bool isCompressed(const std::string &path) {
+  auto extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return char(tolower(c)); });
+  return extension == ".dds" || extension == ".ktx";
+}
+
+Texture::Image readCompressed(const std::string &path) {
+  MappedFile file(path);
+  if (!file.isOpen())
+    return fail("could not open file");
+
+  bool ktx = file.size() >= sizeof(KTXIdentifier) &&
+             memcmp(file.data(), KTXIdentifier, sizeof(KTXIdentifier)) == 0;
+  auto image = ktx ? readKTX(file) : readDDS(file);
+  // Levels are offsets into the whole file, hand the mapping over as is.
+  if (image.error.empty())
+    image.file = std::move(file);
+  return image;
+}
+
+Texture::Image compress(const Texture::Image &image, Block block) {
+  Texture::Image result;
+  result.width = image.width;
+  result.height = image.height;
+  result.channels = block == Block::BC5 ? 2 : 4;
+  result.format = glFormat(block);
+  int levels = numLevels(image.width, image.height);
+  layoutLevels(result, levels, 0, SIZE_MAX);
+  result.pixels.reset(static_cast<unsigned char *>(malloc(result.size())));
+
+  auto level = toRGBA(image);
+  for (int i = 0; i < levels; i++) {
+    if (i > 0)
+      level = downsample(level);
+    encodeLevel(level, block, result.pixels.get() + result.levels[i].offset);
+  }
+  return result;
+}
+
+bool writeDDS(const std::string &path, const Texture::Image &image) {
+  DDSHeader header = {};
+  header.size = sizeof(header);
+  header.flags = DDSDRequired | DDSDMipMapCount | DDSDLinearSize;
+  header.width = uint32_t(image.width);
+  header.height = uint32_t(image.height);
+  header.pitchOrLinearSize = uint32_t(image.levels[0].size);
+  header.mipMapCount = uint32_t(image.levels.size());
+  header.pixelFormat.size = sizeof(DDSPixelFormat);
+  header.pixelFormat.flags = DDPFFourCC;
+  header.caps = DDSCapsTexture | DDSCapsComplex | DDSCapsMipMap;
+
+  // BC7 has no FourCC, it needs the DX10 extension header.
+  DDSHeaderDX10 dx10 = {DXGIBC7, D3D10Texture2D, 0, 1, 0};
+  bool hasDX10 = image.format == glFormat(Block::BC7);
+  if (image.format == glFormat(Block::BC1))
+    header.pixelFormat.fourCC = fourCC('D', 'X', 'T', '1');
+  else if (image.format == glFormat(Block::BC3))
+    header.pixelFormat.fourCC = fourCC('D', 'X', 'T', '5');
+  else if (image.format == glFormat(Block::BC5))
+    header.pixelFormat.fourCC = fourCC('A', 'T', 'I', '2');
+  else if (hasDX10)
+    header.pixelFormat.fourCC = fourCC('D', 'X', '1', '0');
+  else
+    return false;
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(&DDSMagic), 4);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (hasDX10)
+    file.write(reinterpret_cast<const char *>(&dx10), sizeof(dx10));
+  file.write(reinterpret_cast<const char *>(image.data()),
+             image.size());
+  return bool(file);
+}
+
+} // namespace TextureFormats
+} // namespace Engine
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <Engine/CpuProfiler.h>
+#include <Engine/GLStateCache.h>
+#include <Engine/Log.h>
+#include <Engine/TextureLoader.h>
+
+namespace Engine {
+
+namespace {
+
+/// Decoding is mostly memory bound, a few threads are plenty and leave the
+/// rest of the machine to the render thread and the driver.
+constexpr uint MaxWorkers = 4;
+
+} // namespace
+
+TextureLoader::~TextureLoader() {
+  // No GL here, the context is long gone by the time statics are destroyed.
+  std::unique_lock<std::mutex> lock(mMutex);
+  mStopping = true;
+  lock.unlock();
+  mWake.notify_all();
+  for (auto &worker : mWorkers)
+    worker.join();
+}
+
+void TextureLoader::startWorkers() {
+  uint count = std::max(1u, std::thread::hardware_concurrency());
+  count = std::min(MaxWorkers, std::max(1u, count - 1));
+  for (uint i = 0; i < count; i++)
+    mWorkers.emplace_back(&TextureLoader::workerLoop, this);
+}
+
+void TextureLoader::workerLoop() {
+  PROFILE_THREAD("Texture loader");
+  while (true) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mWake.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+    if (mStopping)
+      return;
+    auto job = std::move(mJobs.front());
+    mJobs.pop_front();
+    lock.unlock();
+
+    Decoded decoded{std::move(job.texture), std::move(job.path), {}};
+    float ms = 0.0f;
+    // Skip textures that were dropped while queued.
+    if (!decoded.texture.expired()) {
+      PROFILE_SCOPE("Decode");
+      auto start = std::chrono::steady_clock::now();
+      decoded.image = Texture::decode(decoded.path);
+      std::chrono::duration<float, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      ms = elapsed.count();
+    }
+
+    lock.lock();
+    mStats.decodeMs += ms;
+    mDecoded.push_back(std::move(decoded));
+  }
+}
+
+sptr<Texture> TextureLoader::load(const std::string &path) {
+  if (mWorkers.empty())
+    startWorkers();
+  // The placeholder constructor is private to everyone but the loader.
+  sptr<Texture> texture(new Texture());
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mJobs.push_back(Job{texture, path});
+  }
+  mWake.notify_one();
+  mPending++;
+  return texture;
+}
+
+void TextureLoader::update() {
+  PROFILE_SCOPE("Texture uploads");
+  finishUploads(/* wait */ false);
+  startUploads(mUploadBudget);
+}
+
+void TextureLoader::finish() {
+  while (mPending > 0) {
+    startUploads(SIZE_MAX);
+    finishUploads(/* wait */ true);
+    if (mPending > 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void TextureLoader::startUploads(size_t budget) {
+  auto start = std::chrono::steady_clock::now();
+  auto &state = GLStateCache::getInstance();
+  size_t used = 0;
+  bool uploaded = false;
+  while (true) {
+    Decoded decoded;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mDecoded.empty())
+        break;
+      // Always let one through, whatever its size.
+      size_t size = mDecoded.front().image.size();
+      if (used > 0 && used + size > budget)
+        break;
+      decoded = std::move(mDecoded.front());
+      mDecoded.pop_front();
+    }
+
+    auto texture = decoded.texture.lock();
+    auto &image = decoded.image;
+    if (!texture || !image.data() || !Texture::isSupported(image)) {
+      // The Log is not thread safe, report failures from here.
+      if (texture) {
+        LOG_ERROR("Failed to load texture %s: %s", decoded.path.c_str(),
+                  image.data() ? "format not supported"
+                               : image.error.c_str());
+        texture->setFailed();
+        mStats.failed++;
+      }
+      mPending--;
+      continue;
+    }
+
+    // The copy into the PBO is all the CPU pays for, the transfer into the
+    // texture happens on the GPU's timeline.
+    GLuint pbo = acquirePBO();
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, image.size(), nullptr,
+                 GL_STREAM_DRAW);
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.size(),
+                                    GL_MAP_WRITE_BIT |
+                                        GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+      memcpy(mapped, image.data(), image.size());
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      texture->setImage(image, nullptr);
+    } else {
+      // Mapping can fail for huge images, upload straight from memory.
+      state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      texture->setImage(image, image.data());
+    }
+    auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mUploads.push_back(Upload{texture, pbo, sync});
+    used += image.size();
+    uploaded = true;
+  }
+  // Leaving it bound would turn every later client memory upload into a
+  // read from the PBO.
+  state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (uploaded) {
+    std::chrono::duration<float, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    mStats.uploadMs += elapsed.count();
+    mStats.uploadedBytes += used;
+  }
+}
+
+void TextureLoader::finishUploads(bool wait) {
+  // Fences signal in submission order, stop at the first one still pending.
+  while (!mUploads.empty()) {
+    auto &upload = mUploads.front();
+    auto result = glClientWaitSync(upload.sync, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   wait ? 1000000000 : 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+      return;
+    if (result == GL_WAIT_FAILED)
+      LOG_ERROR("Waiting on a texture upload fence failed.");
+    glDeleteSync(upload.sync);
+    mFreePBOs.push_back(upload.pbo);
+    if (auto texture = upload.texture.lock()) {
+      texture->finishUpload();
+      mStats.loaded++;
+    }
+    mPending--;
+    mUploads.pop_front();
+  }
+}
+
+GLuint TextureLoader::acquirePBO() {
+  if (mFreePBOs.empty()) {
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    return pbo;
+  }
+  GLuint pbo = mFreePBOs.back();
+  mFreePBOs.pop_back();
+  return pbo;
+}
+
+void TextureLoader::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+    mJobs.clear();
+    mDecoded.clear();
+  }
+  mWake.notify_all();
+  for (auto &worker : mWorkers)
+    worker.join();
+  mWorkers.clear();
+  mStopping = false;
+
+  for (auto &upload : mUploads) {
+    glDeleteSync(upload.sync);
+    mFreePBOs.push_back(upload.pbo);
+  }
+  mUploads.clear();
+  for (auto pbo : mFreePBOs)
+    GLStateCache::getInstance().deleteBuffer(pbo);
+  mFreePBOs.clear();
+  mPending = 0;
+}
+
+TextureLoader::Stats TextureLoader::getStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+} // namespace Engine
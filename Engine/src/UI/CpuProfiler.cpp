@@ -0,0 +1,178 @@
+#include <Engine/CpuProfiler.h>
+
+#ifdef ENGINE_PROFILING
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <Engine/Log.h>
+#include <imgui/imgui.h>
+
+namespace Engine {
+
+namespace {
+
+/// Zone names are string literals or function names, escaping quotes and
+/// backslashes is all the JSON needs.
+void writeJsonString(FILE *file, const char *str) {
+  fputc('"', file);
+  for (const char *c = str; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', file);
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+} // namespace
+
+void CpuProfiler::History::add(float ms) {
+  if (count == HistoryLength)
+    sum -= samples[next];
+  else
+    count++;
+  samples[next] = ms;
+  sum += ms;
+  next = (next + 1) % HistoryLength;
+}
+
+CpuProfiler::ThreadBuffer *CpuProfiler::registerThread() {
+  std::lock_guard<std::mutex> lock(mThreadsMutex);
+  mThreads.push_back(std::make_unique<ThreadBuffer>());
+  auto *buffer = mThreads.back().get();
+  buffer->id = uint32_t(mThreads.size() - 1);
+  buffer->name = buffer->id == 0 ? "Main" : "Thread " +
+                                                std::to_string(buffer->id);
+  return buffer;
+}
+
+void CpuProfiler::setThreadName(const char *name) {
+  auto &buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(mThreadsMutex);
+  buffer.name = name;
+}
+
+void CpuProfiler::markFrame() {
+  uint64_t frameEnd = now();
+  auto &buffer = threadBuffer();
+  if (mFrameThread != &buffer) {
+    mFrameThread = &buffer;
+    mFrameStartNs = frameEnd;
+    return;
+  }
+
+  // Zones are written as they finish, so walking back from the head visits
+  // them by descending end time and everything before the frame start can
+  // be skipped.
+  mLastFrame.clear();
+  uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  uint64_t first = head > Capacity ? head - Capacity : 0;
+  for (uint64_t i = head; i-- > first;) {
+    const auto &zone = buffer.zones[i & (Capacity - 1)];
+    if (zone.endNs < mFrameStartNs)
+      break;
+    if (zone.beginNs >= mFrameStartNs)
+      mLastFrame.push_back(zone);
+  }
+  std::sort(mLastFrame.begin(), mLastFrame.end(),
+            [](const Zone &a, const Zone &b) {
+    return a.beginNs != b.beginNs ? a.beginNs < b.beginNs : a.depth < b.depth;
+  });
+
+  mLastFrameMs = float(frameEnd - mFrameStartNs) / 1e6f;
+  // Depths are absolute, zones opened outside any frame (e.g. around the
+  // main loop) sit above the frame's own.
+  uint32_t baseDepth = mLastFrame.empty() ? 0 : mLastFrame.front().depth;
+  for (auto &zone : mLastFrame) {
+    zone.depth = zone.depth > baseDepth ? zone.depth - baseDepth : 0;
+    if (mPathScratch.size() <= zone.depth)
+      mPathScratch.resize(zone.depth + 1);
+    auto &path = mPathScratch[zone.depth];
+    path = zone.depth ? mPathScratch[zone.depth - 1] + "/" : "";
+    path += zone.name;
+    mHistory[path].add(float(zone.endNs - zone.beginNs) / 1e6f);
+  }
+  mFrameStartNs = frameEnd;
+}
+
+float CpuProfiler::getAverageMs(const std::string &path) const {
+  auto iter = mHistory.find(path);
+  if (iter == mHistory.end() || iter->second.count == 0)
+    return 0.0f;
+  return iter->second.sum / iter->second.count;
+}
+
+bool CpuProfiler::writeChromeTrace(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    LOG_ERROR("Could not open %s for writing.", path.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mThreadsMutex);
+  fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  bool first = true;
+  for (auto &buffer : mThreads) {
+    fprintf(file,
+            "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": %u, \"args\": {\"name\": ",
+            first ? "" : ",\n", buffer->id);
+    writeJsonString(file, buffer->name.c_str());
+    fprintf(file, "}}");
+    first = false;
+
+    uint64_t head = buffer->head.load(std::memory_order_acquire);
+    uint64_t begin = head > Capacity ? head - Capacity : 0;
+    for (uint64_t i = begin; i < head; i++) {
+      const auto &zone = buffer->zones[i & (Capacity - 1)];
+      fprintf(file, ",\n{\"name\": ");
+      writeJsonString(file, zone.name);
+      // Trace timestamps are in microseconds.
+      fprintf(file,
+              ", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, "
+              "\"dur\": %.3f}",
+              buffer->id, zone.beginNs / 1e3,
+              (zone.endNs - zone.beginNs) / 1e3);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  LOG_INFO("Wrote CPU trace to %s.", path.c_str());
+  return true;
+}
+
+void CpuProfiler::draw(bool *p_open) {
+  if (!ImGui::Begin("CPU Profiler", p_open)) {
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text("Frame: %.3f ms", mLastFrameMs);
+  ImGui::Separator();
+  ImGui::Columns(3, "zones");
+  ImGui::Text("Zone");
+  ImGui::NextColumn();
+  ImGui::Text("Last (ms)");
+  ImGui::NextColumn();
+  ImGui::Text("Avg (ms)");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  std::vector<std::string> path;
+  for (const auto &zone : mLastFrame) {
+    path.resize(zone.depth + 1);
+    path[zone.depth] =
+        (zone.depth ? path[zone.depth - 1] + "/" : "") + zone.name;
+    ImGui::Text("%*s%s", int(2 * zone.depth), "", zone.name);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", float(zone.endNs - zone.beginNs) / 1e6f);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", getAverageMs(path[zone.depth]));
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::End();
+}
+
+} // namespace Engine
+
+#endif
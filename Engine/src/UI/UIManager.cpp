@@ -56,9 +56,10 @@ void UIManager::drawFrame() {
 }
 
 void UIManager::registerWidget(std::string name,
-                               std::function<void(bool *)> renderFunc) {
+                               std::function<void(bool *)> renderFunc,
+                               bool visible) {
   mWidgets.push_back(renderFunc);
-  mShowWidget.push_back(std::make_pair(name, true));
+  mShowWidget.push_back(std::make_pair(name, visible));
 }
 
 } // namespace Engine
@@ -4,6 +4,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Camera.h"
+#include "CpuProfiler.h"
 #include "InputHandler.h"
 #include "Renderer.h"
 #include "Types.h"
@@ -16,27 +17,59 @@ namespace Engine {
 /// framework/engine.
 class Application {
 public:
+  /// Startup options, parsed from the command line by parseOptions():
+  ///
+  ///   --headless    render offscreen into an FBO behind a hidden window
+  ///   --osmesa      create the context through OSMesa (e.g. llvmpipe on
+  ///                 machines without a display), implies --headless
+  ///   --no-vsync    don't wait for vertical blank
+  ///   --frames N    quit after N frames
+  ///   --trace FILE  write a Chrome trace of the CPU zones on exit (builds
+  ///                 with ENGINE_PROFILING only)
+  struct Options {
+    bool headless = false;
+    bool osmesa = false;
+    bool vsync = true;
+    /// 0 runs until the window is closed.
+    uint frames = 0;
+    std::string trace;
+  };
+  static Options parseOptions(int argc, char **argv);
+
   Application(int width, int height, int argc, char **argv);
-  virtual ~Application() = default;
+  Application(int width, int height, const Options &options);
+  /// Releases the scene and the caches, then the context.
+  virtual ~Application();
+  /// Render frames until the window is closed.
   virtual void run();
   /// Applications implement this for per frame updates.
   virtual void tick(float deltaTime) {}
 
   Renderer &getRenderer() { return *mRenderer; }
   UIManager &getUI() { return mUIManager; }
-  inline void attachCamera(Camera &cam) { std::cout << "ATTACH CAMERA" << std::endl; mCamera = cam; }
+  inline void attachCamera(Camera &cam) {
+    mCamera = &cam;
+    updateCameraMatrices();
+  }
+  inline const Camera &getCamera() const { return *mCamera; }
   inline uint getWidth() const { return mWidth; }
   inline uint getHeight() const { return mHeight; }
   inline uint getFramebufferWidth() const { return mFramebufferWidth; }
   inline uint getFramebufferHeight() const { return mFramebufferHeight; }
-  inline mat4 getViewMatrix() const { return mCamera.getViewMatrix(); }
-  inline mat4 getProjMatrix() const { return mCamera.getProjMatrix(*this); }
+  inline bool isHeadless() const { return mOptions.headless; }
+  /// Frames rendered so far.
+  inline uint getFrameCount() const { return mFrameCount; }
+  /// Camera matrices are computed once per frame, after tick().
+  inline const mat4 &getViewMatrix() const { return mViewMatrix; }
+  inline const mat4 &getProjMatrix() const { return mProjMatrix; }
 
 protected:
+  Options mOptions;
   int mWidth, mHeight;
   int mFramebufferWidth, mFramebufferHeight;
   uptr<InputHandler> mInputHandler;
-  Camera &mCamera;
+  Camera mDefaultCamera;
+  Camera *mCamera = &mDefaultCamera;
   UIManager mUIManager;
   uptr<Renderer> mRenderer;
 
@@ -49,10 +82,24 @@ protected:
     glfwSetWindowShouldClose(mWindow, true);
   }
 
+  inline void updateCameraMatrices() {
+    mViewMatrix = mCamera->getViewMatrix();
+    mProjMatrix = mCamera->getProjMatrix(*this);
+  }
+
 private:
   GLFWwindow *mWindow;
+  /// Headless rendering target, the hidden window's framebuffer is not
+  /// guaranteed to be backed by anything.
+  GLuint mOffscreenFBO = 0;
+  GLuint mOffscreenColour = 0;
+  GLuint mOffscreenDepth = 0;
+  uint mFrameCount = 0;
+  mat4 mViewMatrix{1.0f};
+  mat4 mProjMatrix{1.0f};
   void createWindow();
   void centerWindow();
+  void createOffscreenTarget();
 };
 
 } // namespace Engine
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Bounds.h"
+#include "Types.h"
+
+namespace Engine {
+
+/// Bounding volume hierarchy over a set of AABBs, built with the binned
+/// surface area heuristic. Nodes live in one array in depth first order so a
+/// node's left child is always the next node, which keeps traversal walking
+/// forward through memory.
+///
+/// Items are referred to by their index in the vector given to build(). When
+/// an item moves, update() refits only the nodes above it; quality degrades
+/// as things move a lot, rebuild when that matters.
+class BVH {
+public:
+  struct Node {
+    AABB bounds;
+    /// Leaf: first entry of the node's items in the item order. Interior:
+    /// index of the right child.
+    uint32_t offset;
+    /// Number of items, 0 for interior nodes.
+    uint16_t count;
+    uint16_t axis;
+
+    inline bool isLeaf() const { return count != 0; }
+  };
+  static_assert(sizeof(Node) == 32, "BVH nodes should stay cache friendly");
+
+  /// Exact intersection for a ray query, return true and set \p t if the ray
+  /// hits \p item closer than the incoming \p t.
+  using RayTest = std::function<bool(uint32_t item, float &t)>;
+
+  void build(const std::vector<AABB> &items);
+  /// Move \p item and refit its ancestors.
+  void update(uint32_t item, const AABB &bounds);
+  /// Set an item's bounds without touching the tree, refit() afterwards.
+  inline void setItemBounds(uint32_t item, const AABB &bounds) {
+    mItemBounds[item] = bounds;
+  }
+  /// Refit every node bottom up, cheaper than update() when many items moved.
+  void refit();
+  void clear();
+
+  /// Items whose bounds are entirely inside \p frustum go to \p inside, ones
+  /// that straddle a plane go to \p partial for a finer test.
+  void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &inside,
+                    std::vector<uint32_t> &partial) const;
+  /// Closest item along the ray within \p t, which is updated on a hit.
+  /// Without \p test the item AABBs are used as the hit shapes.
+  bool raycast(const vec3 &origin, const vec3 &dir, float &t, uint32_t &item,
+               const RayTest &test = nullptr) const;
+
+  inline bool empty() const { return mNodes.empty(); }
+  inline size_t numItems() const { return mItemBounds.size(); }
+  inline const std::vector<Node> &nodes() const { return mNodes; }
+
+private:
+  uint32_t buildNode(uint32_t begin, uint32_t end, uint32_t parent);
+  void makeLeaf(Node &node, uint32_t index, uint32_t begin, uint32_t end);
+  AABB leafBounds(const Node &node) const;
+
+  std::vector<Node> mNodes;
+  std::vector<AABB> mItemBounds;
+  /// Item indices, each leaf owns a contiguous range.
+  std::vector<uint32_t> mItemOrder;
+  std::vector<uint32_t> mItemLeaf;
+  std::vector<uint32_t> mParents;
+  /// Item centroids, only used while building.
+  std::vector<vec3> mCentroids;
+};
+
+} // namespace Engine
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Axis aligned bounding box.
+struct AABB {
+  vec3 min{0.0f};
+  vec3 max{0.0f};
+
+  inline vec3 centre() const { return 0.5f * (min + max); }
+  inline vec3 extent() const { return 0.5f * (max - min); }
+  /// Smallest AABB enclosing this box after transforming it by \p mat.
+  AABB transform(const mat4 &mat) const;
+};
+
+/// Bounding sphere, an infinite radius means the object is never culled.
+struct BoundingSphere {
+  vec3 centre{0.0f};
+  float radius = 0.0f;
+
+  /// Conservative bound after transforming by \p mat, the radius grows by
+  /// the largest axis scale.
+  BoundingSphere transform(const mat4 &mat) const;
+};
+
+/// Bounds of a set of positions, \p stride is in bytes.
+void computeBounds(const void *positions, size_t count, size_t stride,
+                   AABB &aabb, BoundingSphere &sphere);
+
+/// View frustum as inward facing planes (xyz normal, w distance).
+struct Frustum {
+  enum { Left, Right, Bottom, Top, Near, Far };
+
+  vec4 planes[6];
+  int numPlanes = 6;
+
+  /// Extract planes from a combined projection * view (* model) matrix.
+  /// With \p depthClamp set geometry past the far plane still reaches the
+  /// screen, so the far plane is not tested.
+  static Frustum fromMatrix(const mat4 &mat, bool depthClamp = false);
+};
+
+/// Bounding spheres stored as a structure of arrays so that the culling
+/// kernel can test several at once.
+struct SphereBatch {
+  std::vector<float> x, y, z, radius;
+
+  inline size_t size() const { return x.size(); }
+  void clear();
+  void reserve(size_t n);
+  void push_back(const BoundingSphere &sphere);
+};
+
+/// Test every sphere of \p batch against \p frustum, \p visible[i] is set to
+/// 1 when sphere i is at least partially inside or its bounds are NaN. Uses
+/// SSE when available. Returns the number of visible spheres.
+size_t cullSpheres(const Frustum &frustum, const SphereBatch &batch,
+                   std::vector<uint8_t> &visible);
+
+} // namespace Engine
@@ -0,0 +1,164 @@
+#pragma once
+
+/// CPU instrumentation, built only when ENGINE_PROFILING is defined (the
+/// ENGINE_PROFILING CMake option). Otherwise the macros below expand to
+/// nothing and none of this exists.
+///
+///   PROFILE_SCOPE("name")   time the enclosing block
+///   PROFILE_FUNCTION()      same, named after the function
+///   PROFILE_FRAME()         mark the start of a frame, on the main thread
+///   PROFILE_THREAD("name")  name the calling thread in traces
+
+#ifdef ENGINE_PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Hierarchical CPU zones. Every thread writes finished zones into its own
+/// ring buffer, so recording takes no locks: the owning thread is the only
+/// writer and publishes each zone with a release store of the head. Buffers
+/// are registered once per thread and live as long as the profiler.
+///
+/// The main thread's zones are folded into per-frame timings and rolling
+/// averages at every PROFILE_FRAME(), the whole history can be exported as
+/// a Chrome trace (chrome://tracing, Perfetto) for offline analysis.
+class CpuProfiler {
+public:
+  struct Zone {
+    const char *name;
+    /// Nanoseconds since the profiler started.
+    uint64_t beginNs, endNs;
+    uint32_t depth;
+  };
+
+  static CpuProfiler &getInstance() {
+    static CpuProfiler instance;
+    return instance;
+  }
+  CpuProfiler(CpuProfiler const &) = delete;
+  void operator=(CpuProfiler const &) = delete;
+
+  /// steady_clock is a vDSO call on the platforms we care about and, unlike
+  /// raw rdtsc, needs no calibration and is consistent across cores.
+  inline uint64_t now() const {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - mEpoch)
+                        .count());
+  }
+
+  /// Hot path for CpuZone, returns the new zone's depth.
+  inline uint32_t enter() { return threadBuffer().depth++; }
+  inline void leave(const char *name, uint64_t beginNs, uint32_t depth) {
+    auto &buffer = threadBuffer();
+    buffer.depth = depth;
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.zones[head & (Capacity - 1)] = Zone{name, beginNs, now(), depth};
+    buffer.head.store(head + 1, std::memory_order_release);
+  }
+
+  void markFrame();
+  void setThreadName(const char *name);
+
+  /// Write every zone still in the buffers as Chrome trace event JSON.
+  /// Zones being written by other threads while this runs may be lost.
+  bool writeChromeTrace(const std::string &path);
+
+  /// Zones of the last complete frame on the main thread, parents first.
+  inline const std::vector<Zone> &getLastFrame() const { return mLastFrame; }
+  inline float getLastFrameMs() const { return mLastFrameMs; }
+  /// Mean over the last HistoryLength frames of the zone at \p path, zone
+  /// names joined by '/', e.g. "Render/Cull". 0 if never seen.
+  float getAverageMs(const std::string &path) const;
+
+  /// ImGui window with the last frame's zones and their rolling averages.
+  void draw(bool *p_open = nullptr);
+
+  /// Zones kept per thread, a power of two.
+  static constexpr uint64_t Capacity = 1 << 16;
+  static constexpr uint HistoryLength = 64;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct ThreadBuffer {
+    std::array<Zone, Capacity> zones;
+    std::atomic<uint64_t> head{0};
+    uint32_t depth = 0;
+    uint32_t id = 0;
+    std::string name;
+  };
+  struct History {
+    std::array<float, HistoryLength> samples{};
+    uint next = 0, count = 0;
+    float sum = 0.0f;
+    void add(float ms);
+  };
+
+  CpuProfiler() : mEpoch(Clock::now()) {}
+
+  inline ThreadBuffer &threadBuffer() {
+    thread_local ThreadBuffer *buffer = registerThread();
+    return *buffer;
+  }
+  ThreadBuffer *registerThread();
+
+  Clock::time_point mEpoch;
+  std::mutex mThreadsMutex;
+  std::vector<uptr<ThreadBuffer>> mThreads;
+
+  /// Start of the frame in progress, and the buffer of the thread marking
+  /// frames.
+  uint64_t mFrameStartNs = 0;
+  ThreadBuffer *mFrameThread = nullptr;
+  std::vector<Zone> mLastFrame;
+  float mLastFrameMs = 0.0f;
+  std::vector<std::string> mPathScratch;
+  std::unordered_map<std::string, History> mHistory;
+};
+
+/// RAII zone, use through PROFILE_SCOPE.
+class CpuZone {
+public:
+  explicit CpuZone(const char *name)
+      : mName(name), mDepth(CpuProfiler::getInstance().enter()),
+        mBeginNs(CpuProfiler::getInstance().now()) {}
+  ~CpuZone() { CpuProfiler::getInstance().leave(mName, mBeginNs, mDepth); }
+  CpuZone(CpuZone const &) = delete;
+  void operator=(CpuZone const &) = delete;
+
+private:
+  const char *mName;
+  uint32_t mDepth;
+  uint64_t mBeginNs;
+};
+
+} // namespace Engine
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+  Engine::CpuZone PROFILE_CONCAT(_cpu_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#define PROFILE_FRAME() Engine::CpuProfiler::getInstance().markFrame()
+#define PROFILE_THREAD(name)                                                   \
+  Engine::CpuProfiler::getInstance().setThreadName(name)
+
+#else
+
+#define PROFILE_SCOPE(name) (void)0
+#define PROFILE_FUNCTION() (void)0
+#define PROFILE_FRAME() (void)0
+#define PROFILE_THREAD(name) (void)0
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Reports files that were written to. On Linux this is inotify on the
+/// files' directories, so editors that save by writing a temporary file and
+/// renaming it over the original are caught too. Elsewhere the files'
+/// modification times are checked every PollInterval.
+///
+/// Nothing here blocks, poll() is meant to be called once per frame.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(FileWatcher const &) = delete;
+  void operator=(FileWatcher const &) = delete;
+
+  /// Start watching \p path, relative paths are taken from the working
+  /// directory.
+  void watch(const std::string &path);
+  /// Watched files changed since the last call, as given to watch(). Each
+  /// file is reported once however many times it was written. If changes
+  /// may have been missed, every watched file is reported.
+  std::vector<std::string> poll();
+
+  static constexpr std::chrono::milliseconds PollInterval{250};
+
+private:
+  using Path = std::filesystem::path;
+  static Path normalize(const std::string &path);
+
+  /// Normalized path -> path as given to watch().
+  std::unordered_map<std::string, std::string> mFiles;
+#ifdef __linux__
+  int mFd = -1;
+  /// inotify watch descriptor -> directory.
+  std::unordered_map<int, Path> mDirectories;
+  std::vector<char> mEventBuffer;
+#else
+  std::unordered_map<std::string, std::filesystem::file_time_type> mTimes;
+  std::chrono::steady_clock::time_point mLastPoll;
+#endif
+};
+
+} // namespace Engine
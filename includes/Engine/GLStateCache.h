@@ -0,0 +1,106 @@
+#pragma once
+
+#include <GL/gl3w.h>
+#include <array>
+#include <cstdint>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Shadow copy of the GL state the engine touches. Every bind/enable goes
+/// through here so that calls which would not change anything are never
+/// issued to the driver. There is a single GL context, so like Log this is a
+/// singleton.
+///
+/// Code outside the engine that changes GL state behind our back (ImGui's
+/// backend restores what it touches, so it is fine) must call invalidate().
+class GLStateCache {
+public:
+  struct Counters {
+    uint issued = 0;
+    uint elided = 0;
+  };
+
+  static GLStateCache &getInstance() {
+    static GLStateCache instance;
+    return instance;
+  }
+  GLStateCache(GLStateCache const &) = delete;
+  void operator=(GLStateCache const &) = delete;
+
+  /// Forget everything, the next call of each kind is always issued.
+  void invalidate();
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  void bindFramebuffer(GLuint fbo);
+  /// Tracks GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER and GL_UNIFORM_BUFFER,
+  /// other targets are passed straight through.
+  void bindBuffer(GLenum target, GLuint buffer);
+  void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+  /// Tracks GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP per unit.
+  void bindTexture(uint unit, GLenum target, GLuint texture);
+
+  void enable(GLenum cap) { setCapability(cap, true); }
+  void disable(GLenum cap) { setCapability(cap, false); }
+  void depthMask(bool write);
+  void depthFunc(GLenum func);
+  void blendFunc(GLenum src, GLenum dst);
+
+  /// Deleting a bound object implicitly rebinds 0, keep the shadow in sync.
+  void deleteBuffer(GLuint buffer);
+  void deleteProgram(GLuint program);
+  void deleteTexture(GLuint texture);
+  void deleteVertexArray(GLuint vao);
+
+  /// Whether the context exposes \p name, e.g. "GL_ARB_buffer_storage".
+  static bool hasExtension(const char *name);
+
+  inline const Counters &getCounters() const { return mCounters; }
+  inline void resetCounters() { mCounters = Counters{}; }
+
+private:
+  GLStateCache() { invalidate(); }
+
+  static constexpr GLuint Unknown = ~GLuint(0);
+  static constexpr uint MaxTextureUnits = 32;
+  enum Capability { DepthTest, DepthClamp, Blend, CullFace, ScissorTest,
+                    StencilTest, NumCapabilities };
+  enum TextureTarget { Texture2D, TextureCube, NumTextureTargets };
+  enum BufferTarget { ArrayBuffer, ElementBuffer, UniformBuffer,
+                      NumBufferTargets };
+
+  /// Map GL enums onto the tracked slots above, -1 if untracked.
+  static int bufferIndex(GLenum target);
+  static int textureIndex(GLenum target);
+  static int capabilityIndex(GLenum cap);
+
+  void setCapability(GLenum cap, bool enabled);
+  /// Returns true if the call needs to be issued and updates the shadow.
+  template <typename T> inline bool update(T &shadow, T value) {
+    if (shadow == value) {
+      mCounters.elided++;
+      return false;
+    }
+    shadow = value;
+    mCounters.issued++;
+    return true;
+  }
+
+  GLuint mProgram;
+  GLuint mVertexArray;
+  GLuint mFramebuffer;
+  std::array<GLuint, NumBufferTargets> mBuffers;
+  GLuint mActiveUnit;
+  std::array<std::array<GLuint, NumTextureTargets>, MaxTextureUnits>
+      mTextures;
+  std::array<int8_t, NumCapabilities> mCapabilities;
+  int8_t mDepthMask;
+  GLenum mDepthFunc;
+  GLenum mBlendSrc, mBlendDst;
+
+  Counters mCounters;
+};
+
+} // namespace Engine
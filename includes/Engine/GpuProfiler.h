@@ -0,0 +1,141 @@
+#pragma once
+
+#include <GL/gl3w.h>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Nested GPU timings from GL_TIMESTAMP queries. Every scope writes a
+/// timestamp when it opens and one when it closes, so unlike GL_TIME_ELAPSED
+/// scopes can nest freely. Queries of the last few frames stay in flight and
+/// are only read back once available, which means results lag a couple of
+/// frames but reading them never stalls the pipeline. There is a single GL
+/// context, so like Log this is a singleton.
+///
+/// Usage: beginFrame(), any number of GPU_SCOPE("name") blocks, endFrame().
+/// Scope names must outlive the profiler, string literals are the intent.
+class GpuProfiler {
+public:
+  struct Scope {
+    const char *name;
+    uint depth;
+    /// Relative to the start of the frame, in milliseconds.
+    float startMs;
+    float durationMs;
+  };
+
+  struct Frame {
+    uint64_t index = 0;
+    float durationMs = 0.0f;
+    /// In the order they were opened, parents before their children.
+    std::vector<Scope> scopes;
+  };
+
+  static GpuProfiler &getInstance() {
+    static GpuProfiler instance;
+    return instance;
+  }
+  GpuProfiler(GpuProfiler const &) = delete;
+  void operator=(GpuProfiler const &) = delete;
+
+  /// Returns the index of the frame, the same one handed to the callback.
+  uint64_t beginFrame();
+  void endFrame();
+  void pushScope(const char *name);
+  void popScope();
+  /// Wait for every frame still in flight and report it, call before the
+  /// context goes away.
+  void flush();
+  /// Flush, then release every query, before the context goes.
+  void shutdown();
+
+  /// Called with every frame once its queries have come back.
+  inline void setFrameCallback(std::function<void(const Frame &)> cb) {
+    mFrameCallback = std::move(cb);
+  }
+  /// Index the next beginFrame() will return.
+  inline uint64_t getFrameIndex() const { return mFrameIndex; }
+  /// Most recent frame whose results are in.
+  inline const Frame &getLastFrame() const { return mLastFrame; }
+  /// Mean over the last HistoryLength frames of the scope at \p path, scope
+  /// names joined by '/', e.g. "Render/Geometry pass". 0 if never seen.
+  float getAverageMs(const std::string &path) const;
+
+  inline void setEnabled(bool enabled) { mEnabled = enabled; }
+  inline bool isEnabled() const { return mEnabled; }
+
+  /// ImGui window with the rolling averages and a timeline of the last frame.
+  void draw(bool *p_open = nullptr);
+
+  static constexpr uint HistoryLength = 64;
+  /// Frames allowed in flight before new ones are skipped rather than wait.
+  static constexpr uint MaxFramesInFlight = 4;
+
+private:
+  GpuProfiler() = default;
+
+  struct PendingScope {
+    const char *name;
+    uint depth;
+    GLuint begin, end;
+  };
+  struct PendingFrame {
+    uint64_t index;
+    GLuint begin, end;
+    std::vector<PendingScope> scopes;
+  };
+  struct History {
+    std::array<float, HistoryLength> samples{};
+    uint next = 0, count = 0;
+    float sum = 0.0f;
+    void add(float ms);
+  };
+
+  GLuint timestamp();
+  /// Read back finished frames, blocking for all of them if \p wait.
+  void collect(bool wait);
+  void resolve(const PendingFrame &frame);
+
+  bool mEnabled = true;
+  /// False while a frame is skipped because too many are in flight.
+  bool mRecording = false;
+  uint64_t mFrameIndex = 0;
+  PendingFrame mCurrent;
+  /// Indices into mCurrent.scopes of the scopes still open.
+  std::vector<size_t> mOpenScopes;
+  /// Oldest first, queries complete in submission order.
+  std::deque<PendingFrame> mPending;
+  std::vector<GLuint> mFreeQueries;
+
+  Frame mLastFrame;
+  std::vector<std::string> mPathScratch;
+  std::unordered_map<std::string, History> mHistory;
+  History mFrameHistory;
+  std::function<void(const Frame &)> mFrameCallback;
+};
+
+/// Times the enclosing block.
+class GpuScope {
+public:
+  explicit GpuScope(const char *name) {
+    GpuProfiler::getInstance().pushScope(name);
+  }
+  ~GpuScope() { GpuProfiler::getInstance().popScope(); }
+  GpuScope(GpuScope const &) = delete;
+  void operator=(GpuScope const &) = delete;
+};
+
+} // namespace Engine
+
+#define GPU_SCOPE_CONCAT_(a, b) a##b
+#define GPU_SCOPE_CONCAT(a, b) GPU_SCOPE_CONCAT_(a, b)
+#define GPU_SCOPE(name)                                                        \
+  Engine::GpuScope GPU_SCOPE_CONCAT(_gpu_scope_, __LINE__)(name)
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Unit sphere made by repeatedly splitting each face of an icosahedron into
+/// four. Positions are unit length, so they double as the normals, and
+/// faces are wound counter clockwise seen from outside.
+///
+/// Each level only appends vertices, the first numVertices(l) positions are
+/// the vertices of level l.
+struct Icosphere {
+  std::vector<vec3> positions;
+  std::vector<uint32_t> indices;
+
+  /// Deepest level generate() accepts, 10M vertices.
+  static constexpr int MaxLevel = 10;
+
+  static constexpr size_t numVertices(int level) {
+    return 10 * (size_t(1) << (2 * level)) + 2;
+  }
+  static constexpr size_t numEdges(int level) {
+    return 30 * (size_t(1) << (2 * level));
+  }
+  static constexpr size_t numFaces(int level) {
+    return 20 * (size_t(1) << (2 * level));
+  }
+
+  /// Largest distance between the triangles and the unit sphere, at the
+  /// centre of the flattest one.
+  float error() const;
+
+  /// Subdivide \p level times, clamped to MaxLevel. Every buffer is sized
+  /// exactly up front and each pass is split across \p threads threads, 0
+  /// uses one per core. Small levels always run on the calling thread.
+  static Icosphere generate(int level, uint threads = 0);
+};
+
+} // namespace Engine
@@ -17,12 +17,20 @@ struct LineVertexData {
 
 class LineMesh : public Mesh<LineVertexData, vec3, float, vec3> {
 public:
-  LineMesh();
+  /// With a \p stream buffer the vertices are streamed each endLine(),
+  /// otherwise the whole mesh is re-uploaded through finalize().
+  LineMesh(StreamBuffer *stream = nullptr);
   void startLine();
   void addPoint(const vec3 &p);
   void endLine();
+  inline void setStreamBuffer(StreamBuffer *stream) { mStream = stream; }
+  inline StreamBuffer *streamBuffer() const { return mStream; }
 private:
   std::vector<LineVertexData> mData;
+  StreamBuffer *mStream;
+  /// Indices only depend on the number of points, and a shorter line uses a
+  /// prefix of a longer one's, so the index buffer only grows.
+  size_t mIndexCapacity = 0;
 };
 
 class Line : public Renderable<LineMesh> {
@@ -31,7 +39,11 @@ public:
   void startLine();
   void addPoint(const vec3 &p);
   void endLine();
+  /// Switch between streaming through the renderer's StreamBuffer (the
+  /// default) and re-uploading with finalize() every endLine().
+  void setStreaming(bool streaming);
 private:
+  Renderer &mRenderer;
   inline LineMesh &line() { return dynamic_cast<LineMesh&>(mesh()); }
 };
 
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Read-only view of a whole file mapped into memory, so that loaders can
+/// parse or decode straight out of the page cache instead of copying the
+/// file into a buffer first. The pages are requested ahead of time and
+/// hinted for sequential access.
+///
+/// Setting up and tearing down a mapping costs more than reading a few
+/// pages, so files under MapThreshold are read into a buffer instead.
+///
+/// Safe to use from any thread. Empty files open fine and have no data.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(MappedFile const &) = delete;
+  void operator=(MappedFile const &) = delete;
+
+  inline bool isOpen() const { return mOpen; }
+  inline const uint8_t *data() const { return mData; }
+  inline size_t size() const { return mSize; }
+  inline std::string_view view() const {
+    return {reinterpret_cast<const char *>(mData), mSize};
+  }
+
+  static constexpr size_t MapThreshold = 64 * 1024;
+
+private:
+  void close();
+
+  const uint8_t *mData = nullptr;
+  std::vector<uint8_t> mBuffer;
+  size_t mSize = 0;
+  bool mOpen = false;
+#ifdef _WIN32
+  void *mFile = nullptr;
+  void *mMapping = nullptr;
+#endif
+};
+
+} // namespace Engine
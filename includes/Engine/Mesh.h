@@ -1,6 +1,13 @@
 #pragma once
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <set>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -8,43 +15,40 @@
 #include <glfw/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Bounds.h"
+#include "GLStateCache.h"
+#include "MeshOptimize.h"
 #include "Shader.h"
+#include "Simplify.h"
+#include "StreamBuffer.h"
 #include "Types.h"
+#include "VertexFormats.h"
 
 namespace {
-  void bindGLAttrib(int index, int numElements, GLenum type, int stride, int offset) {
-    glVertexAttribPointer(index, numElements, type, GL_FALSE, stride,
-                        (void *)(offset));
+  void bindGLAttrib(int index, int numElements, GLenum type, int stride,
+                    int offset, bool normalized = false) {
+    glVertexAttribPointer(index, numElements, type,
+                          normalized ? GL_TRUE : GL_FALSE, stride,
+                          (void *)(offset));
     glEnableVertexAttribArray(index);
   }
 
+  /// Attributes are laid out back to back in the order of the Mesh's types,
+  /// see Engine::AttributeFormat for what each is read as.
   template<typename T>
   void bindType(int index, int stride, int& offset) {
-    throw std::runtime_error("Unsupported vertex attribute.");
-  }
-
-  template<>
-  void bindType<int>(int index, int stride, int& offset) {
-    bindGLAttrib(index, 1, GL_INT, stride, offset);
-    offset += sizeof(int);
-  }
-
-  template<>
-  void bindType<float>(int index, int stride, int& offset) {
-    bindGLAttrib(index, 1, GL_FLOAT, stride, offset);
-    offset += sizeof(float);
-  }
-
-  template<>
-  void bindType<vec2>(int index, int stride, int& offset) {
-    bindGLAttrib(index, 2, GL_FLOAT, stride, offset);
-    offset += 2*sizeof(float);
-  }
-
-  template<>
-  void bindType<vec3>(int index, int stride, int& offset) {
-    bindGLAttrib(index, 3, GL_FLOAT, stride, offset);
-    offset += 3*sizeof(float);
+    using Format = Engine::AttributeFormat<T>;
+    if constexpr (!Format::supported) {
+      throw std::runtime_error("Unsupported vertex attribute.");
+    } else if constexpr (Format::integer) {
+      glVertexAttribIPointer(index, Format::size, Format::type, stride,
+                             (void *)(intptr_t)offset);
+      glEnableVertexAttribArray(index);
+    } else {
+      bindGLAttrib(index, Format::size, Format::type, stride, offset,
+                   Format::normalized);
+    }
+    offset += sizeof(T);
   }
 
   template<typename First>
@@ -130,49 +134,329 @@ struct VertexData {
   vec2 mTextureCoord;
 };
 
+/// How often a mesh's buffers are expected to change, passed on to GL as the
+/// usage hint. Static meshes get buffers of exactly their size, dynamic ones
+/// grow geometrically to absorb resizes, and stream meshes orphan their
+/// storage on every upload so the driver never has to wait on the GPU.
+enum class BufferUsage { Static, Dynamic, Stream };
+
 template <typename Data, typename... Types>
 class Mesh {
 public:
-  Mesh(const std::string &name, GLenum mode) : mName(name), mMode(mode) {
-      mModelMat = mat4(1.0f);
-    glGenVertexArrays(1, &mVAO);
-    glBindVertexArray(mVAO);
-    glGenBuffers(1, &mVBO);
-    glGenBuffers(1, &mEBO);
+  /// Element range waiting to be uploaded.
+  struct DirtyRange {
+    size_t begin = 0, end = 0;
+
+    inline bool empty() const { return begin >= end; }
+    inline void add(size_t b, size_t e) {
+      if (b >= e)
+        return;
+      begin = empty() ? b : std::min(begin, b);
+      end = empty() ? e : std::max(end, e);
+    }
+  };
+
+  /// One level of detail, a range of the index buffer over the shared
+  /// vertices. \p error is how far it strays from the full detail surface,
+  /// in model units.
+  struct Lod {
+    uint32_t firstIndex = 0;
+    uint32_t numIndices = 0;
+    float error = 0.0f;
+  };
+
+  /// Vertices and indices with their GL buffers and vertex array. Meshes
+  /// made from the same Storage draw the same geometry and only differ in
+  /// their transform, e.g. all Spheres of one subdivision level.
+  struct Storage {
+    Storage() {
+      glGenVertexArrays(1, &vao);
+      GLStateCache::getInstance().bindVertexArray(vao);
+      glGenBuffers(1, &vbo);
+      glGenBuffers(1, &ebo);
+    }
+    Storage(Storage const &) = delete;
+    void operator=(Storage const &) = delete;
+
+    GLuint vao, vbo, ebo;
+    std::vector<Data> vertices;
+    std::vector<uint32_t> indices;
+    /// GPU buffer sizes in elements, and what changed since the last
+    /// upload.
+    size_t vertexCapacity = 0, indexCapacity = 0;
+    DirtyRange vertexDirty, indexDirty;
+    /// Model space bounds of the vertices, updated by finalize().
+    AABB localAABB;
+    BoundingSphere localSphere;
+    /// Full detail first, empty when the whole index buffer is the only
+    /// level.
+    std::vector<Lod> lods;
+    /// Applied ahead of the model matrix, takes quantized positions back
+    /// to model space.
+    mat4 dequantize{1.0f};
+  };
+
+  /// Share of the threshold a level's error has to clear before switching,
+  /// so that objects sitting at a switching distance don't flicker.
+  static constexpr float LodHysteresis = 0.2f;
+
+  Mesh(const std::string &name, GLenum mode,
+       BufferUsage usage = BufferUsage::Static)
+      : Mesh(name, mode, std::make_shared<Storage>(), usage) {}
+  /// Draw \p storage, which other meshes may be drawing already. Changes to
+  /// its vertices or indices show up in all of them.
+  Mesh(const std::string &name, GLenum mode, sptr<Storage> storage,
+       BufferUsage usage = BufferUsage::Static)
+      : mName(name), mMode(mode), mUsage(usage),
+        mStorage(std::move(storage)), mVAO(mStorage->vao) {
+    mModelMat = mStorage->dequantize;
+  }
+  virtual ~Mesh() {
+    if (mVAO != mStorage->vao)
+      GLStateCache::getInstance().deleteVertexArray(mVAO);
   }
-  virtual ~Mesh() = default;
   void draw(const Application &app) {
-    glBindVertexArray(mVAO);
+    // The VAO is left bound, the state cache skips the rebind when the next
+    // draw uses the same mesh.
+    GLStateCache::getInstance().bindVertexArray(mVAO);
+
+    // Streamed vertices sit at some offset into the ring buffer.
+    if (mStreamBuffer) {
+      if (!mStorage->indices.empty()) {
+        glDrawElementsBaseVertex(mMode, GLsizei(mNumStreamedIndices),
+                                 GL_UNSIGNED_INT, 0, mBaseVertex);
+      } else {
+        glDrawArrays(mMode, mBaseVertex, GLsizei(mNumStreamedVertices));
+      }
+      return;
+    }
 
     // if we provided indices, do an indexed draw.
-    if (!mIndices.empty()) {
-      glDrawElements(mMode, mIndices.size(), GL_UNSIGNED_INT, 0);
+    if (!mStorage->indices.empty()) {
+      auto lod = currentLod();
+      glDrawElements(mMode, lod.numIndices, GL_UNSIGNED_INT,
+                     (void *)(lod.firstIndex * sizeof(uint32_t)));
     } else {
-      glDrawArrays(mMode, 0, mVertexData.size());
+      glDrawArrays(mMode, 0, mStorage->vertices.size());
     }
-
-    glBindVertexArray(0);
   }
+  /// Draw \p count copies of the mesh in a single call, per instance
+  /// attributes must already be attached to this mesh's VAO.
+  void drawInstanced(const Application &app, int count) {
+    GLStateCache::getInstance().bindVertexArray(mVAO);
+
+    if (!mStorage->indices.empty()) {
+      auto lod = currentLod();
+      glDrawElementsInstanced(mMode, lod.numIndices, GL_UNSIGNED_INT,
+                              (void *)(lod.firstIndex * sizeof(uint32_t)),
+                              count);
+    } else {
+      glDrawArraysInstanced(mMode, 0, mStorage->vertices.size(), count);
+    }
+  }
+  /// Upload whatever changed since the last finalize(). Only the dirty
+  /// vertex and index ranges are sent, storage is only reallocated when it
+  /// has to grow, and attribute pointers are set up once per VAO.
   void finalize(bool updateVertexData = true) {
-    glBindVertexArray(mVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-    glBufferData(GL_ARRAY_BUFFER, mVertexData.size() * sizeof(Data),
-                &mVertexData[0], GL_STATIC_DRAW);
-
-    if (!mIndices.empty()) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(uint32_t),
-                  &mIndices[0], GL_STATIC_DRAW);
+    auto &state = GLStateCache::getInstance();
+    auto &storage = *mStorage;
+    state.bindVertexArray(mVAO);
+    bool verticesChanged = !storage.vertexDirty.empty();
+    state.bindBuffer(GL_ARRAY_BUFFER, storage.vbo);
+    upload(GL_ARRAY_BUFFER, storage.vertices, storage.vertexCapacity,
+           storage.vertexDirty);
+    finalizeIndices();
+
+    if (!mAttributesBound || mStreamBuffer) {
+      int offset = 0;
+      ::bindAttributes<Types...>(sizeof(Data), offset, 0);
+      mAttributesBound = true;
+      mStreamBuffer = nullptr;
     }
 
+    if (verticesChanged) {
+      computeLocalBounds(storage.vertices.data(), storage.vertices.size());
+      transformed();
+    }
+  }
+  /// Upload just the indices, for streamed meshes whose vertices change
+  /// every frame but whose indices don't.
+  void finalizeIndices() {
+    auto &state = GLStateCache::getInstance();
+    auto &storage = *mStorage;
+    state.bindVertexArray(mVAO);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, storage.ebo);
+    upload(GL_ELEMENT_ARRAY_BUFFER, storage.indices, storage.indexCapacity,
+           storage.indexDirty);
+  }
+  /// Draw through a vertex array of this mesh's own over the same buffers,
+  /// so that attributes added to it, like per instance ones, don't reach
+  /// other meshes sharing the storage.
+  void ownVertexArray() {
+    if (mVAO != mStorage->vao)
+      return;
+    auto &state = GLStateCache::getInstance();
+    glGenVertexArrays(1, &mVAO);
+    state.bindVertexArray(mVAO);
+    state.bindBuffer(GL_ARRAY_BUFFER, mStorage->vbo);
     int offset = 0;
     ::bindAttributes<Types...>(sizeof(Data), offset, 0);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mStorage->ebo);
+    mAttributesBound = true;
+  }
+  /// Write \p count vertices into \p buffer and draw from there, instead of
+  /// re-uploading through finalize(). For geometry rewritten every frame:
+  /// the GPU storage is never reallocated and the attributes are only set up
+  /// again when the buffer itself changes. Indexed meshes draw the first
+  /// \p numIndices indices, relative to the streamed vertices.
+  void stream(StreamBuffer &buffer, const Data *vertices, size_t count,
+              size_t numIndices = 0) {
+    auto allocation = buffer.allocate(count * sizeof(Data), sizeof(Data));
+    if (count)
+      std::memcpy(allocation.data, vertices, count * sizeof(Data));
+    buffer.commit();
+
+    if (&buffer != mStreamBuffer || buffer.generation() != mStreamGeneration) {
+      auto &state = GLStateCache::getInstance();
+      state.bindVertexArray(mVAO);
+      state.bindBuffer(GL_ARRAY_BUFFER, buffer.id());
+      int offset = 0;
+      ::bindAttributes<Types...>(sizeof(Data), offset, 0);
+      mStreamBuffer = &buffer;
+      mStreamGeneration = buffer.generation();
+    }
+    mBaseVertex = GLint(allocation.offset / sizeof(Data));
+    mNumStreamedVertices = count;
+    mNumStreamedIndices = numIndices;
+
+    computeLocalBounds(vertices, count);
+    transformed();
   }
 
-  inline void setVertexData(const std::vector<Data> &data) { mVertexData = data; }
+  /// Replacing the data only marks the range that actually differs dirty.
+  inline void setVertexData(const std::vector<Data> &data) {
+    markChanged(mStorage->vertices, data, mStorage->vertexDirty);
+    mStorage->vertices = data;
+  }
   inline void setIndices(const std::vector<uint32_t> &indices) {
-    mIndices = indices;
+    markChanged(mStorage->indices, indices, mStorage->indexDirty);
+    mStorage->indices = indices;
+  }
+  /// Overwrite \p count vertices starting at \p first, within the current
+  /// vertex count.
+  inline void updateVertices(size_t first, const Data *data, size_t count) {
+    std::copy(data, data + count, editVertices(first, first + count));
+  }
+  inline void updateIndices(size_t first, const uint32_t *data,
+                            size_t count) {
+    std::copy(data, data + count, mStorage->indices.begin() + first);
+    mStorage->indexDirty.add(first, first + count);
+  }
+  /// Write access to vertices [\p begin, \p end), uploaded by the next
+  /// finalize().
+  inline Data *editVertices(size_t begin, size_t end) {
+    mStorage->vertexDirty.add(begin, end);
+    return mStorage->vertices.data() + begin;
+  }
+  inline size_t getNumVertices() const { return mStorage->vertices.size(); }
+
+  /// Levels of detail, each a range of the index buffer, full detail first.
+  /// Takes effect with the next finalize() of the indices.
+  inline void setLods(std::vector<Lod> lods) {
+    mStorage->lods = std::move(lods);
+    mLod = 0;
+  }
+  /// Add up to \p maxLods coarser levels made by simplify(), each aiming at
+  /// \p reduction times the triangles of the one before, behind the full
+  /// detail indices. Stops early once a level barely shrinks. Needs indexed
+  /// triangles with positions as the leading vec3, call finalize() after.
+  void generateLods(int maxLods = 4, float reduction = 0.5f) {
+    using First = std::tuple_element_t<0, std::tuple<Types...>>;
+    auto &storage = *mStorage;
+    if constexpr (std::is_same_v<First, vec3>) {
+      if (mMode != GL_TRIANGLES || storage.indices.empty())
+        return;
+      std::vector<uint32_t> current(
+          storage.indices.begin(),
+          storage.indices.begin() + (storage.lods.empty()
+                                         ? storage.indices.size()
+                                         : storage.lods[0].numIndices));
+      std::vector<Lod> lods{{0, uint32_t(current.size()), 0.0f}};
+      std::vector<uint32_t> indices = current;
+      for (int i = 0; i < maxLods; i++) {
+        float error;
+        auto next = simplify(storage.vertices.data(), storage.vertices.size(),
+                             sizeof(Data), current,
+                             size_t(current.size() / 3 * reduction) * 3,
+                             error);
+        if (next.empty() || next.size() > current.size() * 9 / 10)
+          break;
+        // Each level is simplified from the last, errors add up.
+        lods.push_back(Lod{uint32_t(indices.size()), uint32_t(next.size()),
+                           lods.back().error + error});
+        indices.insert(indices.end(), next.begin(), next.end());
+        current = std::move(next);
+      }
+      setIndices(indices);
+      setLods(lods);
+    }
+  }
+  /// Reorder the geometry for the GPU with optimizeMesh(), each level of
+  /// detail on its own. Unindexed triangles become indexed. Overdraw
+  /// ordering needs positions as the leading vec3. Call finalize() after.
+  void optimize() {
+    using First = std::tuple_element_t<0, std::tuple<Types...>>;
+    auto &storage = *mStorage;
+    if (mMode != GL_TRIANGLES || storage.vertices.empty())
+      return;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (const auto &lod : storage.lods)
+      ranges.emplace_back(lod.firstIndex, lod.numIndices);
+    auto vertices = storage.vertices;
+    auto indices = storage.indices;
+    vertices.resize(optimizeMesh(vertices.data(), vertices.size(),
+                                 sizeof(Data), indices, ranges,
+                                 std::is_same_v<First, vec3>));
+    setVertexData(vertices);
+    setIndices(indices);
+  }
+  inline size_t getNumLods() const {
+    return std::max<size_t>(1, mStorage->lods.size());
   }
+  inline const std::vector<Lod> &getLods() const { return mStorage->lods; }
+  inline uint getLodIndex() const { return mLod; }
+  inline void setLodIndex(uint lod) {
+    mLod = std::min<uint>(lod, uint(getNumLods() - 1));
+  }
+  /// Move towards the coarsest level whose error covers at most \p threshold
+  /// pixels, given that one model unit covers \p pixelsPerUnit pixels
+  /// before the model matrix. Within LodHysteresis of the threshold the
+  /// current level is kept.
+  void selectLod(float pixelsPerUnit, float threshold) {
+    const auto &lods = mStorage->lods;
+    if (lods.size() < 2)
+      return;
+    float scale = pixelsPerUnit * getModelScale();
+    size_t lod = std::min<size_t>(mLod, lods.size() - 1);
+    while (lod > 0 &&
+           lods[lod].error * scale > threshold * (1.0f + LodHysteresis))
+      lod--;
+    while (lod + 1 < lods.size() &&
+           lods[lod + 1].error * scale < threshold * (1.0f - LodHysteresis))
+      lod++;
+    mLod = uint(lod);
+  }
+  /// Triangles the next draw submits, or would at full detail.
+  inline size_t getNumTriangles(bool fullDetail = false) const {
+    if (mMode != GL_TRIANGLES)
+      return 0;
+    if (mStorage->indices.empty())
+      return mStorage->vertices.size() / 3;
+    return (fullDetail ? fullDetailLod() : currentLod()).numIndices / 3;
+  }
+  inline BufferUsage usage() const { return mUsage; }
+  /// Takes effect the next time the buffers are reallocated.
+  inline void setUsage(BufferUsage usage) { mUsage = usage; }
   inline void flipNormals() {
     for (auto &f : mFaces)
       f.flipNormal();
@@ -181,54 +465,256 @@ public:
   inline size_t getNumFaces() const { return mFaces.size(); }
   inline const Face &getFace(uint32_t index) const { return mFaces[index]; }
   inline const mat4 &getModelMat() const { return mModelMat; }
+  /// Largest axis scale of the model matrix.
+  inline float getModelScale() const {
+    return std::sqrt(std::max({glm::dot(mModelMat[0], mModelMat[0]),
+                               glm::dot(mModelMat[1], mModelMat[1]),
+                               glm::dot(mModelMat[2], mModelMat[2])}));
+  }
   inline const mat4 &getScaleMat() const { return mScaleMat; }
   inline void setModelMat(const mat4 &mat) {
-    mModelMat = mat * mTranslateMat * mRotateMat * mScaleMat;
+    mModelMat =
+        mat * mTranslateMat * mRotateMat * mScaleMat * mStorage->dequantize;
+    transformed();
   }
   inline mat4 getUnscaledMat() const { return mTranslateMat * mRotateMat; }
+  /// For quantized positions, the model space transform they are stored
+  /// relative to. It is part of getModelMat() and shared through the
+  /// storage, set it before other meshes draw the same storage.
+  inline const mat4 &getDequantizeMat() const { return mStorage->dequantize; }
+  inline void setDequantizeMat(const mat4 &mat) {
+    mStorage->dequantize = mat;
+    mModelMat = mTranslateMat * mRotateMat * mScaleMat * mat;
+    transformed();
+  }
   inline const std::string &name() const { return mName; }
+  inline GLuint vao() const { return mVAO; }
+  /// Hand to another mesh's constructor to draw the same geometry.
+  inline const sptr<Storage> &storage() const { return mStorage; }
+  /// Model space bounds of the vertex data, updated by finalize().
+  inline const AABB &getLocalAABB() const { return mStorage->localAABB; }
+  inline const BoundingSphere &getLocalBoundingSphere() const {
+    return mStorage->localSphere;
+  }
+  /// Bounds with the model matrix applied.
+  inline AABB getAABB() const {
+    return mStorage->localAABB.transform(mModelMat);
+  }
+  inline BoundingSphere getBoundingSphere() const {
+    return mStorage->localSphere.transform(mModelMat);
+  }
+
+  /// Called whenever the model matrix or the bounds change, the renderer
+  /// uses this to keep its BVH up to date.
+  inline void setTransformCallback(std::function<void()> callback) {
+    mTransformCallback = std::move(callback);
+  }
 
   inline mat4 getModelMat() { return mModelMat; }
-  inline void resetModelMat() { mModelMat = mat4(1.0f); }
+  inline void resetModelMat() {
+    mModelMat = mStorage->dequantize;
+    transformed();
+  }
   inline void rotate(float degrees, const vec3 &axis) {
     mRotateMat = glm::rotate(mRotateMat, glm::radians(degrees), axis);
-    mModelMat = mTranslateMat * mRotateMat * mScaleMat;
+    mModelMat = mTranslateMat * mRotateMat * mScaleMat * mStorage->dequantize;
+    transformed();
   }
   inline void translate(const vec3 &vec) {
     mTranslateMat = glm::translate(mTranslateMat, vec);
-    mModelMat = mTranslateMat * mRotateMat * mScaleMat;
+    mModelMat = mTranslateMat * mRotateMat * mScaleMat * mStorage->dequantize;
+    transformed();
   }
   
   inline void scale(const vec3 &vec) {
     mScaleMat = glm::scale(mScaleMat, vec);
-    mModelMat = mTranslateMat * mRotateMat * mScaleMat;
+    mModelMat = mTranslateMat * mRotateMat * mScaleMat * mStorage->dequantize;
+    transformed();
   }
   inline void setScale(const vec3 &vec) {
     mScaleMat = glm::scale(mat4(1.0), vec);
-    mModelMat = mTranslateMat * mRotateMat * mScaleMat;
+    mModelMat = mTranslateMat * mRotateMat * mScaleMat * mStorage->dequantize;
+    transformed();
   }
 
   bool mAreNormalsFlipped = false;
   static constexpr std::tuple<Types...> layout;
+  /// First attribute location not used by the vertex layout.
+  static constexpr int numAttributes = sizeof...(Types);
 
 protected:
-  std::vector<uint32_t> mIndices;
   std::vector<Face> mFaces;
-  mat4 mTranslateMat;
-  mat4 mScaleMat;
-  mat4 mRotateMat;
+  mat4 mTranslateMat{1.0f};
+  mat4 mScaleMat{1.0f};
+  mat4 mRotateMat{1.0f};
   mat4 mModelMat;
 
 private:
+  template <typename T>
+  static void markChanged(const std::vector<T> &current,
+                          const std::vector<T> &data, DirtyRange &dirty) {
+    // Trim the unchanged prefix, and suffix when the size is the same, so
+    // regenerating a mesh with the same topology doesn't resend it all.
+    size_t common = std::min(current.size(), data.size());
+    size_t begin = 0;
+    while (begin < common &&
+           std::memcmp(&current[begin], &data[begin], sizeof(T)) == 0)
+      begin++;
+    size_t end = data.size();
+    if (current.size() == data.size()) {
+      while (end > begin &&
+             std::memcmp(&current[end - 1], &data[end - 1], sizeof(T)) == 0)
+        end--;
+    }
+    dirty.add(begin, end);
+  }
+
+  inline Lod fullDetailLod() const {
+    const auto &storage = *mStorage;
+    return storage.lods.empty()
+               ? Lod{0, uint32_t(storage.indices.size()), 0.0f}
+               : storage.lods[0];
+  }
+  inline Lod currentLod() const {
+    const auto &storage = *mStorage;
+    return storage.lods.empty() ? fullDetailLod()
+                                : storage.lods[std::min<size_t>(
+                                      mLod, storage.lods.size() - 1)];
+  }
+
+  inline GLenum glUsage() const {
+    switch (mUsage) {
+    case BufferUsage::Dynamic:
+      return GL_DYNAMIC_DRAW;
+    case BufferUsage::Stream:
+      return GL_STREAM_DRAW;
+    default:
+      return GL_STATIC_DRAW;
+    }
+  }
+
+  /// Send \p data's dirty range to the buffer bound at \p target.
+  template <typename T>
+  void upload(GLenum target, const std::vector<T> &data, size_t &capacity,
+              DirtyRange &dirty) {
+    dirty.end = std::min(dirty.end, data.size());
+    if (data.size() > capacity) {
+      capacity = mUsage == BufferUsage::Static
+                     ? data.size()
+                     : std::max(data.size(), 2 * capacity);
+      glBufferData(target, capacity * sizeof(T), nullptr, glUsage());
+      dirty = DirtyRange{0, data.size()};
+    } else if (mUsage == BufferUsage::Stream && !dirty.empty()) {
+      // Orphan, the old contents may still be in use by the GPU.
+      glBufferData(target, capacity * sizeof(T), nullptr, glUsage());
+      dirty = DirtyRange{0, data.size()};
+    }
+    if (!dirty.empty()) {
+      glBufferSubData(target, dirty.begin * sizeof(T),
+                      (dirty.end - dirty.begin) * sizeof(T),
+                      data.data() + dirty.begin);
+    }
+    dirty = DirtyRange{};
+  }
+
+  inline void transformed() {
+    if (mTransformCallback)
+      mTransformCallback();
+  }
+
+  void computeLocalBounds(const Data *vertices, size_t count) {
+    // Positions are expected to be the leading vec3 of each vertex, layouts
+    // without one can't be bounded and are never culled.
+    using First = std::tuple_element_t<0, std::tuple<Types...>>;
+    if constexpr (std::is_same_v<First, vec3>) {
+      computeBounds(vertices, count, sizeof(Data), mStorage->localAABB,
+                    mStorage->localSphere);
+    } else if constexpr (std::is_same_v<First, Normalized<int16_t, 4>>) {
+      std::vector<vec3> positions(count);
+      for (size_t i = 0; i < count; i++) {
+        const auto &p = reinterpret_cast<const First &>(vertices[i]);
+        positions[i] = vec3(fromSNorm(p.v[0]), fromSNorm(p.v[1]),
+                            fromSNorm(p.v[2]));
+      }
+      computeBounds(positions.data(), count, sizeof(vec3),
+                    mStorage->localAABB, mStorage->localSphere);
+    } else {
+      mStorage->localSphere.radius = std::numeric_limits<float>::infinity();
+    }
+  }
+
   std::string mName;
   GLenum mMode;
-  GLuint mVAO, mVBO, mEBO;
-  GLuint mNormalBO;
-  GLuint mIndexBO;
-
-  std::vector<Data> mVertexData;
+  BufferUsage mUsage;
+  sptr<Storage> mStorage;
+  /// The storage's vertex array, unless ownVertexArray() made one.
+  GLuint mVAO;
+  /// Level of detail drawn, per mesh since sharers sit at other distances.
+  uint mLod = 0;
+  bool mAttributesBound = false;
+  std::function<void()> mTransformCallback;
+
+  /// Set while the vertices come from a StreamBuffer.
+  StreamBuffer *mStreamBuffer = nullptr;
+  uint mStreamGeneration = 0;
+  GLint mBaseVertex = 0;
+  size_t mNumStreamedVertices = 0;
+  size_t mNumStreamedIndices = 0;
 };
 
 using StandardMeshData = VertexData;
 using StandardMesh = Mesh<StandardMeshData, vec3, vec3, vec2>;
+
+/// Half of StandardMeshData's 32 bytes: the position in 16 bits per axis
+/// relative to the mesh's bounds, the normal in 10, and half float UVs.
+/// Shaders written for StandardMesh draw it unchanged, the model matrix
+/// scales positions back up.
+struct CompactVertexData {
+  Normalized<int16_t, 4> mPos;
+  Packed1010102 mNormal;
+  Half<2> mTextureCoord;
+};
+using CompactMesh =
+    Mesh<CompactVertexData, Normalized<int16_t, 4>, Packed1010102, Half<2>>;
+
+/// Quantize \p count vertices into \p out. Positions are stored relative
+/// to the centre of their bounds and scaled by the largest half extent, the
+/// same for every axis so normals are unaffected. Returns the matrix taking
+/// them back, the CompactMesh's dequantize matrix.
+inline mat4 compactVertices(const StandardMeshData *vertices, size_t count,
+                            CompactVertexData *out) {
+  AABB box;
+  BoundingSphere sphere;
+  computeBounds(vertices, count, sizeof(StandardMeshData), box, sphere);
+  vec3 extent = box.extent();
+  float scale = std::max({extent.x, extent.y, extent.z, 1e-20f});
+  for (size_t i = 0; i < count; i++) {
+    const auto &v = vertices[i];
+    vec3 p = (v.mPos - box.centre()) / scale;
+    out[i].mPos = {toSNorm<int16_t>(p.x), toSNorm<int16_t>(p.y),
+                   toSNorm<int16_t>(p.z), toSNorm<int16_t>(1.0f)};
+    out[i].mNormal = packSNorm1010102(vec4(v.mNormal, 0.0f));
+    out[i].mTextureCoord = {toHalf(v.mTextureCoord.x),
+                            toHalf(v.mTextureCoord.y)};
+  }
+  return glm::scale(glm::translate(mat4(1.0f), box.centre()), vec3(scale));
+}
+
+/// Give \p to \p from's vertices, indices and levels of detail as
+/// CompactVertexData. Call finalize() on \p to after.
+inline void compactMesh(const StandardMesh &from, CompactMesh &to) {
+  const auto &storage = *from.storage();
+  std::vector<CompactVertexData> vertices(storage.vertices.size());
+  mat4 dequantize = compactVertices(storage.vertices.data(),
+                                    storage.vertices.size(), vertices.data());
+  // Errors are measured in stored units, like the positions.
+  std::vector<CompactMesh::Lod> lods;
+  for (const auto &lod : storage.lods)
+    lods.push_back({lod.firstIndex, lod.numIndices,
+                    lod.error / dequantize[0][0]});
+  to.setVertexData(vertices);
+  to.setIndices(storage.indices);
+  to.setLods(std::move(lods));
+  to.setDequantizeMat(dequantize);
+}
 } // namespace Engine
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// How well a triangle list uses the post-transform vertex cache, simulated
+/// as a FIFO of \p cacheSize entries like most hardware.
+struct VertexCacheStats {
+  /// Vertices transformed per triangle: 3 with no reuse, 0.5 is the limit
+  /// for large closed meshes.
+  float acmr = 0.0f;
+  /// Vertices transformed per distinct vertex used, 1 is ideal.
+  float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t count,
+                                    size_t numVertices, uint cacheSize = 16);
+
+/// Map each of \p count vertices, \p stride bytes apart, to the first vertex
+/// with the same bytes, numbered by first appearance. Returns the number of
+/// distinct vertices.
+size_t deduplicateVertices(const void *vertices, size_t count, size_t stride,
+                           std::vector<uint32_t> &remap);
+
+/// Reorder the triangles of \p indices so vertices are reused while still
+/// in the post-transform cache, scoring candidates by cache position and
+/// remaining valence (Forsyth).
+void optimizeVertexCache(uint32_t *indices, size_t count,
+                         size_t numVertices);
+
+/// Reorder cache optimized triangles against overdraw: split the list into
+/// clusters that stay within \p threshold times its ACMR even from a cold
+/// cache, and draw the clusters facing away from the centre first. The
+/// result is kept only if the whole list stays within \p threshold too.
+void optimizeOverdraw(uint32_t *indices, size_t count, const void *positions,
+                      size_t numVertices, size_t stride,
+                      float threshold = 1.05f);
+
+/// Number the vertices in the order \p indices first uses them, so vertex
+/// fetch walks the buffer forwards. \p remap maps old to new, unused
+/// vertices get UINT32_MAX. Returns the number of vertices used.
+size_t optimizeVertexFetch(const uint32_t *indices, size_t count,
+                           size_t numVertices, std::vector<uint32_t> &remap);
+
+/// All of the above in order: merge vertices with identical bytes, order
+/// the triangles of each (first index, index count) range in \p ranges,
+/// or of all of \p indices when empty, for the cache and, with
+/// \p overdraw, against overdraw using the vec3 at the start of each
+/// vertex, then renumber the vertices by first use.
+///
+/// The \p count vertices, \p stride bytes apart, are rewritten in place and
+/// the number kept is returned. Empty \p indices stand for unindexed
+/// triangles and are filled in.
+size_t optimizeMesh(void *vertices, size_t count, size_t stride,
+                    std::vector<uint32_t> &indices,
+                    const std::vector<std::pair<uint32_t, uint32_t>> &ranges,
+                    bool overdraw = true);
+
+} // namespace Engine
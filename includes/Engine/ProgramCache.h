@@ -0,0 +1,79 @@
+#pragma once
+
+#include <GL/gl3w.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// On-disk cache of linked program binaries (ARB_get_program_binary, core in
+/// 4.1), so that shaders seen on a previous run skip compiling and linking.
+///
+/// Entries are keyed by a hash of every stage's final source together with
+/// the driver's vendor, renderer and version strings, since binaries are
+/// only valid for the driver that produced them. A binary the driver turns
+/// down (e.g. after an update that kept the version string) is deleted and
+/// the caller falls back to compiling from source. Like GLStateCache this
+/// is a singleton, there is one context.
+class ProgramCache {
+public:
+  struct Stats {
+    /// Programs loaded from a binary, and time spent doing so.
+    uint hits = 0;
+    float loadMs = 0.0f;
+    /// Programs compiled from source, and time spent doing so.
+    uint misses = 0;
+    float compileMs = 0.0f;
+    /// Binaries found on disk but rejected by the driver.
+    uint rejected = 0;
+  };
+
+  static ProgramCache &getInstance() {
+    static ProgramCache instance;
+    return instance;
+  }
+  ProgramCache(ProgramCache const &) = delete;
+  void operator=(ProgramCache const &) = delete;
+
+  /// Defaults to "shader_cache" in the working directory.
+  void setDirectory(std::string directory);
+  inline void setEnabled(bool enabled) { mEnabled = enabled; }
+  /// False when disabled or when the driver offers no binary formats.
+  bool isEnabled();
+
+  /// Key for a program built from \p sources, one string per stage in a
+  /// fixed order (missing stages as empty strings).
+  uint64_t key(const std::vector<std::string> &sources);
+  /// Load the binary for \p key into \p program, which must not have been
+  /// linked. False on a miss or when the driver rejects the binary.
+  bool load(uint64_t key, GLuint program);
+  /// Write \p program's binary. Call prepare() on it before linking.
+  void store(uint64_t key, GLuint program);
+  /// Ask the driver to keep the binary of \p program retrievable.
+  void prepare(GLuint program);
+
+  /// Account for a program compiled from source, for the stats.
+  inline void addCompileTime(float ms) {
+    mStats.misses++;
+    mStats.compileMs += ms;
+  }
+  inline const Stats &getStats() const { return mStats; }
+
+private:
+  ProgramCache() = default;
+
+  std::string pathFor(uint64_t key) const;
+
+  std::string mDirectory = "shader_cache";
+  bool mEnabled = true;
+  /// -1 until the driver was asked whether it supports binaries.
+  int mSupported = -1;
+  /// Hash of the driver strings, mixed into every key.
+  uint64_t mDriverHash = 0;
+  Stats mStats;
+};
+
+} // namespace Engine
@@ -1,16 +1,26 @@
 #pragma once
 #include "Mesh.h"
+#include "BVH.h"
+#include "Bounds.h"
 #include "Camera.h"
+#include "FileWatcher.h"
+#include "GLStateCache.h"
+#include "GpuProfiler.h"
 #include "Log.h"
 #include "Shader.h"
+#include "StreamBuffer.h"
 #include "Types.h"
 #include "Texture.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
 #include "UIManager.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <cstddef>
 #include <functional>
+#include <initializer_list>
 #include <map>
 #include <type_traits>
 #include <vector>
@@ -35,7 +45,54 @@ struct Material {
 
 class RenderInterface {
   public:
+    virtual ~RenderInterface() = default;
     virtual void draw(const Application &app, Shader &shader) = 0;
+
+    // State used to build the draw packet sort key.
+    virtual int shaderID() const = 0;
+    virtual uint textureID() const = 0;
+    virtual uint vertexArray() const = 0;
+    /// Model space origin, used to sort by distance from the camera.
+    virtual vec3 origin() const = 0;
+    /// Bounds with the model matrix applied, used for frustum culling.
+    virtual BoundingSphere bounds() const = 0;
+    /// \p callback is run whenever bounds() changes.
+    virtual void setBoundsCallback(std::function<void()> callback) {
+      mBoundsCallback = std::move(callback);
+    }
+    /// Pick the level of detail for the next draw, given that one world
+    /// unit at the nearest point of bounds() covers \p pixelsPerUnit pixels
+    /// and \p threshold pixels of error are acceptable.
+    virtual void selectLod(float /*pixelsPerUnit*/, float /*threshold*/) {}
+    /// Triangles the next draw submits, or would at full detail.
+    virtual size_t numTriangles(bool /*fullDetail*/) const { return 0; }
+    /// Nothing to draw, e.g. an InstancedRenderable without instances. The
+    /// renderer skips these without issuing or counting a draw.
+    virtual bool isEmpty() const { return false; }
+
+    /// Transparent renderables are drawn after all opaque ones, back to
+    /// front with blending enabled and depth writes disabled.
+    inline bool isTransparent() const { return mTransparent; }
+    inline void setTransparent(bool transparent) { mTransparent = transparent; }
+
+    /// Whether draw() applies the world transform given to
+    /// Renderer::renderFrame on top of the model matrix, the default.
+    /// Renderables drawn with their model matrix alone are culled, sorted
+    /// and picked without it. Set it before the first frame they are in.
+    inline bool usesWorldTransform() const { return mUsesWorldTransform; }
+    inline void setUsesWorldTransform(bool uses) {
+      mUsesWorldTransform = uses;
+    }
+
+  protected:
+    inline void boundsChanged() {
+      if (mBoundsCallback)
+        mBoundsCallback();
+    }
+
+    bool mTransparent = false;
+    bool mUsesWorldTransform = true;
+    std::function<void()> mBoundsCallback;
 };
 
 /// Encapsulation of shader, material, and mesh which allow us to show something
@@ -53,7 +110,23 @@ public:
 
   inline T &mesh() { return *mMesh; }
   inline const Material &material() { return mMaterial; }
-  inline int shaderID() { return mShaderID; }
+  int shaderID() const override { return mShaderID; }
+  uint textureID() const override { return mTexture ? mTexture->id() : 0; }
+  uint vertexArray() const override { return mMesh->vao(); }
+  vec3 origin() const override { return vec3(mMesh->getModelMat()[3]); }
+  BoundingSphere bounds() const override {
+    return mMesh->getBoundingSphere();
+  }
+  /// Moving the mesh is what changes the bounds, so hand the callback on.
+  void setBoundsCallback(std::function<void()> callback) override {
+    mMesh->setTransformCallback(std::move(callback));
+  }
+  void selectLod(float pixelsPerUnit, float threshold) override {
+    mMesh->selectLod(pixelsPerUnit, threshold);
+  }
+  size_t numTriangles(bool fullDetail) const override {
+    return mMesh->getNumTriangles(fullDetail);
+  }
   void bindMaterial(const Material &material) {
     mMaterial = material;
   }
@@ -64,38 +137,326 @@ public:
     mPerObject = cb;
   }
   void draw(const Application &app, Shader &shader) override {
-    if (mTexture) {
-      glActiveTexture(GL_TEXTURE0);
-      mTexture->bind();
-    }
+    if (mTexture)
+      mTexture->bind(0);
 
     mPerObject(shader, *mMesh);
     LOG_IF_GL_ERR();
     mMesh->draw(app);
     LOG_IF_GL_ERR();
+  }
+
+private:
+  uptr<T> mMesh;
+  Material mMaterial;
+  sptr<Texture> mTexture;
+  int mShaderID = -1;
+  std::function<void(Shader &, const T &)> mPerObject;
+};
+
+/// Per instance attributes of an InstancedRenderable. They are bound to the
+/// attribute locations directly following the mesh's vertex layout, i.e. for a
+/// StandardMesh the model matrix takes locations 3-6, the colour 7 and the
+/// material index 8.
+struct InstanceData {
+  mat4 model{1.0f};
+  vec4 colour{1.0f};
+  int material = 0;
+};
+
+/// Draws many copies of one mesh with a single instanced draw call. Instances
+/// are kept densely packed so that the whole set can be uploaded as one
+/// buffer; IDs handed out stay stable while other instances are removed.
+/// Instance transforms apply on top of the mesh's own model matrix, e.g. a
+/// Sphere's centre and radius.
+template<typename T>
+class InstancedRenderable : public RenderInterface {
+public:
+  using Mesh = T;
+  using InstanceID = uint32_t;
+
+  InstancedRenderable(uptr<T> mesh, const Material &material, int shaderID,
+                      sptr<Texture> texture = nullptr)
+      : mMesh(std::move(mesh)), mMaterial(material),
+        mTexture(std::move(texture)), mShaderID(shaderID) {
+    auto &state = GLStateCache::getInstance();
+    glGenBuffers(1, &mInstanceVBO);
+    // Keep the instance attributes off meshes sharing the geometry.
+    mMesh->ownVertexArray();
+    state.bindVertexArray(mMesh->vao());
+    state.bindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+
+    const int stride = sizeof(InstanceData);
+    const int base = T::numAttributes;
+    for (int i = 0; i < 4; i++) {
+      glVertexAttribPointer(base + i, 4, GL_FLOAT, GL_FALSE, stride,
+                            (void *)(offsetof(InstanceData, model) +
+                                     i * sizeof(vec4)));
+      glEnableVertexAttribArray(base + i);
+      glVertexAttribDivisor(base + i, 1);
+    }
+    glVertexAttribPointer(base + 4, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(InstanceData, colour));
+    glEnableVertexAttribArray(base + 4);
+    glVertexAttribDivisor(base + 4, 1);
+    glVertexAttribIPointer(base + 5, 1, GL_INT, stride,
+                           (void *)offsetof(InstanceData, material));
+    glEnableVertexAttribArray(base + 5);
+    glVertexAttribDivisor(base + 5, 1);
+  }
+  ~InstancedRenderable() override {
+    GLStateCache::getInstance().deleteBuffer(mInstanceVBO);
+  }
+
+  inline T &mesh() { return *mMesh; }
+  inline const Material &material() { return mMaterial; }
+  int shaderID() const override { return mShaderID; }
+  uint textureID() const override { return mTexture ? mTexture->id() : 0; }
+  uint vertexArray() const override { return mMesh->vao(); }
+  vec3 origin() const override { return vec3(mMesh->getModelMat()[3]); }
+  /// The whole set is culled as one, the bounds enclose every instance and
+  /// are recomputed lazily after instances change.
+  BoundingSphere bounds() const override {
+    if (mBoundsDirty) {
+      AABB box;
+      const auto &local = mMesh->getLocalBoundingSphere();
+      const mat4 &meshModel = mMesh->getModelMat();
+      for (size_t i = 0; i < mInstances.size(); i++) {
+        auto s = local.transform(mInstances[i].model * meshModel);
+        AABB sphereBox{s.centre - vec3(s.radius), s.centre + vec3(s.radius)};
+        box.min = i == 0 ? sphereBox.min : glm::min(box.min, sphereBox.min);
+        box.max = i == 0 ? sphereBox.max : glm::max(box.max, sphereBox.max);
+      }
+      mBounds = BoundingSphere{box.centre(), glm::length(box.extent())};
+      mBoundsDirty = false;
+    }
+    return mBounds;
+  }
+  inline size_t numInstances() const { return mInstances.size(); }
+  /// Every instance draws the same level, the one the nearest needs.
+  /// Instance scales are not taken into account.
+  void selectLod(float pixelsPerUnit, float threshold) override {
+    mMesh->selectLod(pixelsPerUnit, threshold);
+  }
+  size_t numTriangles(bool fullDetail) const override {
+    return mMesh->getNumTriangles(fullDetail) * mInstances.size();
+  }
+  bool isEmpty() const override { return mInstances.empty(); }
+  /// Whether \p id was handed out by addInstances() and not removed since.
+  inline bool isLive(InstanceID id) const {
+    return id < mIDToIndex.size() && mIDToIndex[id] < mIndexToID.size() &&
+           mIndexToID[mIDToIndex[id]] == id;
+  }
+  void bindCallback(std::function<void(Shader &, const T &)> cb) {
+    mPerDraw = cb;
+  }
+
+  std::vector<InstanceID> addInstances(const std::vector<InstanceData> &data) {
+    std::vector<InstanceID> ids;
+    ids.reserve(data.size());
+    markDirty(mInstances.size(), mInstances.size() + data.size());
+    for (const auto &d : data) {
+      InstanceID id;
+      if (!mFreeIDs.empty()) {
+        id = mFreeIDs.back();
+        mFreeIDs.pop_back();
+      } else {
+        id = InstanceID(mIDToIndex.size());
+        mIDToIndex.push_back(0);
+      }
+      mIDToIndex[id] = uint32_t(mInstances.size());
+      mIndexToID.push_back(id);
+      mInstances.push_back(d);
+      ids.push_back(id);
+    }
+    return ids;
+  }
 
-    if (mTexture) {
-      glBindTexture(GL_TEXTURE_2D, 0);
+  /// IDs that are not live (see isLive()) are ignored, here and in
+  /// removeInstances().
+  void updateInstances(const std::vector<InstanceID> &ids,
+                       const std::vector<InstanceData> &data) {
+    for (size_t i = 0; i < ids.size() && i < data.size(); i++) {
+      if (!isLive(ids[i]))
+        continue;
+      auto index = mIDToIndex[ids[i]];
+      mInstances[index] = data[i];
+      markDirty(index, index + 1);
     }
   }
 
+  /// Removal swaps the last instance into the hole, so only the moved
+  /// instances need to be re-uploaded.
+  void removeInstances(const std::vector<InstanceID> &ids) {
+    bool removed = false;
+    for (auto id : ids) {
+      if (!isLive(id))
+        continue;
+      removed = true;
+      auto index = mIDToIndex[id];
+      auto last = uint32_t(mInstances.size() - 1);
+      if (index != last) {
+        mInstances[index] = mInstances[last];
+        mIndexToID[index] = mIndexToID[last];
+        mIDToIndex[mIndexToID[index]] = index;
+        markDirty(index, index + 1);
+      }
+      mInstances.pop_back();
+      mIndexToID.pop_back();
+      mFreeIDs.push_back(id);
+    }
+    // Removing the last instance moves nothing, the bounds still shrink.
+    if (removed)
+      markBoundsDirty();
+  }
+
+  void clearInstances() {
+    mInstances.clear();
+    mIndexToID.clear();
+    mIDToIndex.clear();
+    mFreeIDs.clear();
+    mDirtyBegin = mDirtyEnd = 0;
+    mBoundsDirty = true;
+    boundsChanged();
+  }
+
+  void draw(const Application &app, Shader &shader) override {
+    if (mInstances.empty())
+      return;
+    upload();
+
+    if (mTexture)
+      mTexture->bind(0);
+
+    if (mPerDraw)
+      mPerDraw(shader, *mMesh);
+    LOG_IF_GL_ERR();
+    mMesh->drawInstanced(app, int(mInstances.size()));
+    LOG_IF_GL_ERR();
+  }
+
 private:
+  inline void markBoundsDirty() {
+    if (!mBoundsDirty)
+      boundsChanged();
+    mBoundsDirty = true;
+  }
+
+  inline void markDirty(size_t begin, size_t end) {
+    markBoundsDirty();
+    if (mDirtyBegin == mDirtyEnd) {
+      mDirtyBegin = begin;
+      mDirtyEnd = end;
+    } else {
+      mDirtyBegin = std::min(mDirtyBegin, begin);
+      mDirtyEnd = std::max(mDirtyEnd, end);
+    }
+  }
+
+  /// Only grow the GPU buffer when we run out of room, otherwise upload just
+  /// the range touched since the last draw.
+  void upload() {
+    const mat4 &meshModel = mMesh->getModelMat();
+    if (meshModel != mMeshModel) {
+      mMeshModel = meshModel;
+      markDirty(0, mInstances.size());
+    }
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+    if (mInstances.size() > mCapacity) {
+      mCapacity = std::max(mInstances.size(), mCapacity * 2);
+      glBufferData(GL_ARRAY_BUFFER, mCapacity * sizeof(InstanceData), nullptr,
+                   GL_DYNAMIC_DRAW);
+      mDirtyBegin = 0;
+      mDirtyEnd = mInstances.size();
+    }
+    mDirtyEnd = std::min(mDirtyEnd, mInstances.size());
+    if (mDirtyBegin < mDirtyEnd) {
+      const InstanceData *data = &mInstances[mDirtyBegin];
+      if (mMeshModel != mat4(1.0f)) {
+        mTransformed.assign(mInstances.begin() + mDirtyBegin,
+                            mInstances.begin() + mDirtyEnd);
+        for (auto &instance : mTransformed)
+          instance.model = instance.model * mMeshModel;
+        data = mTransformed.data();
+      }
+      glBufferSubData(GL_ARRAY_BUFFER, mDirtyBegin * sizeof(InstanceData),
+                      (mDirtyEnd - mDirtyBegin) * sizeof(InstanceData), data);
+    }
+    mDirtyBegin = mDirtyEnd = 0;
+  }
+
   uptr<T> mMesh;
   Material mMaterial;
   sptr<Texture> mTexture;
   int mShaderID;
-  std::function<void(Shader &, const T &)> mPerObject;
+  std::function<void(Shader &, const T &)> mPerDraw;
+
+  GLuint mInstanceVBO = 0;
+  size_t mCapacity = 0;
+  size_t mDirtyBegin = 0, mDirtyEnd = 0;
+  std::vector<InstanceData> mInstances;
+  std::vector<InstanceID> mIndexToID;
+  std::vector<uint32_t> mIDToIndex;
+  std::vector<InstanceID> mFreeIDs;
+  /// Mesh model matrix the GPU copy was made with, and scratch space for
+  /// instances with it applied.
+  mat4 mMeshModel{1.0f};
+  std::vector<InstanceData> mTransformed;
+  mutable BoundingSphere mBounds;
+  mutable bool mBoundsDirty = true;
+};
+
+/// CPU mirror of the std140 "Frame" uniform block shared by all shaders,
+/// declared once in shaders/frame.glsl for them to #include.
+struct FrameUniforms {
+  mat4 view;
+  mat4 proj;
+  mat4 viewProj;
+  vec3 cameraPos;
+  float time;
+  vec2 resolution;
+  vec2 pad;
+};
+static_assert(sizeof(FrameUniforms) == 224, "FrameUniforms must match std140");
+
+/// One entry of the per-frame draw queue. Packets are radix sorted on \p key
+/// before execution, see Renderer::renderGeometry for the key layout.
+struct DrawPacket {
+  uint64_t key;
+  RenderInterface *renderable;
+};
+
+/// Counters gathered while rendering the last frame.
+struct RenderStats {
+  uint drawCalls = 0;
+  /// CPU time spent submitting the frame, in milliseconds.
+  float cpuTimeMs = 0.0f;
+  /// GL state changes sent to the driver and skipped by the GLStateCache.
+  uint stateChangesIssued = 0;
+  uint stateChangesElided = 0;
+  /// Renderables tested against the view frustum and how many survived.
+  uint culled = 0;
+  uint visible = 0;
+  /// Shaders whose program is still being built.
+  uint shadersBuilding = 0;
+  /// Textures from the TextureLoader still showing their placeholder.
+  uint texturesLoading = 0;
+  /// Triangles submitted, and how many there would be without levels of
+  /// detail.
+  size_t triangles = 0;
+  size_t trianglesFullDetail = 0;
 };
 
 class Renderer {
 public:
   Renderer();
-  virtual ~Renderer() = default;
+  virtual ~Renderer();
   void renderFrame(const Application &app, const mat4 &worldTransform);
   //void addLight(const Application &app, sptr<Mesh> mesh, vec3 &colour);
 
   template<typename M>
   Renderable<M> *addRenderable(int renderGroup, uptr<RenderInterface> renderable) {
+    mSceneDirty = true;
     mRenderGroups[renderGroup].push_back(std::move(renderable));
     return dynamic_cast<Renderable<M>*>(mRenderGroups[renderGroup].back().get());
   }
@@ -110,13 +471,39 @@ public:
     return addRenderable<M>(shaderID, std::move(renderable));
   }
 
+  template<typename M, typename ... Args>
+  InstancedRenderable<M> *createInstancedRenderable(
+    const Material &material,
+    int shaderID,
+    Args&& ... args) {
+    auto mesh = std::make_unique<M>(std::forward<Args>(args) ...);
+    auto renderable = std::make_unique<InstancedRenderable<M>>(
+        std::move(mesh), material, shaderID);
+    auto *ptr = renderable.get();
+    mSceneDirty = true;
+    mRenderGroups[shaderID].push_back(std::move(renderable));
+    return ptr;
+  }
+
+  /// The shader builds in the background, renderables using it are skipped
+  /// until it is ready. See finishShaders() to wait instead.
   int createShader(const Shader::Info & shader_info) {
     auto shader = std::make_unique<Shader>(shader_info);
     auto id = shader->id();
+    if (mShaderWatcher) {
+      for (const auto &path : shader->getSourcePaths())
+        mShaderWatcher->watch(path);
+    }
     mShaders[id] = std::move(shader);
     return id;
   }
 
+  /// Shader built from the same files as \p baseID with \p defines added
+  /// (see Shader::Info::defines), so that branches an uber-shader takes on
+  /// uniforms can be compiled out instead. Variants are cached by source
+  /// files and define set, in any order, asking again returns the same ID.
+  int createShaderVariant(int baseID, std::vector<std::string> defines);
+
   inline Shader & getShader(int id) {
     if (mShaders.count(id) == 0)
       throw std::invalid_argument("ID does not map to an existing shader.");
@@ -124,33 +511,116 @@ public:
     return *mShaders[id];
   }
 
+  /// Block until every shader build in flight is done.
+  void finishShaders();
+  /// Rebuild shaders in the background whenever one of their source files
+  /// is saved. Each keeps drawing with its current program until the new
+  /// one links, compile errors go to the Log.
+  void setShaderHotReload(bool enabled);
+
   void clearRenderGroup(int shaderID) {
+    mSceneDirty = true;
     mRenderGroups[shaderID].clear();
   }
 
+  inline const RenderStats &getStats() const { return mStats; }
+  /// Framebuffer renderFrame() draws into, 0 for the window.
+  inline void setRenderTarget(GLuint fbo) { mRenderTarget = fbo; }
+  /// Shared ring buffer for per-frame geometry, fenced after each frame.
+  inline StreamBuffer &getStreamBuffer() { return *mStreamBuffer; }
+  inline void setCullingEnabled(bool enabled) { mCullingEnabled = enabled; }
+  inline bool isCullingEnabled() const { return mCullingEnabled; }
+  /// Meshes with levels of detail draw the coarsest one whose error stays
+  /// within the threshold, in pixels, on screen.
+  inline void setLodEnabled(bool enabled) { mLodEnabled = enabled; }
+  inline bool isLodEnabled() const { return mLodEnabled; }
+  inline void setLodThreshold(float pixels) { mLodThreshold = pixels; }
+  inline float getLodThreshold() const { return mLodThreshold; }
+  inline const FrameUniforms &getFrameUniforms() const {
+    return mFrameUniforms;
+  }
+
   template<typename T>
   void removeRenderable(uptr<Renderable<T>> renderable) {
     auto &group = mRenderGroups[renderable->shaderID()];
     auto iter = std::find(group.begin(), group.end(), renderable);
-    if (iter != group.end())
+    if (iter != group.end()) {
       group.erase(iter);
+      mSceneDirty = true;
+    }
   }
 
+  /// Closest renderable under the cursor position \p x, \p y (window
+  /// coordinates, as given to mouse callbacks) in the last rendered frame, or
+  /// nullptr. Renderables are hit tested against their bounding spheres.
+  RenderInterface *pick(const Application &app, double x, double y);
+
 private:
   void renderGeometry(const Application &app, const mat4 &worldTransform,
                       sptr<Shader> overrideShader = nullptr);
   //void renderLights(const Application &app, const mat4 &worldTransform);
   void renderText(const Application &app);
+  void updateFrameUniforms(const Application &app);
+  /// Move shader builds along, called once per frame.
+  void pollShaders();
+  /// Run \p fn on every shader, the ones made with createShader() and the
+  /// renderer's own.
+  template <typename F> void forEachShader(F &&fn) {
+    for (auto &shader : mShaders)
+      fn(*shader.second);
+    for (auto *shader : {mDepthShader.get(), mLightShader.get()}) {
+      if (shader)
+        fn(*shader);
+    }
+  }
+  void logProgramStats() const;
+  /// Rebuild the scene BVH after renderables were added or removed, or refit
+  /// it for the ones that moved since the last frame.
+  void updateSceneBVH();
+  void markMoved(uint32_t item);
 
   uptr<Shader> mLightShader;
   uptr<Shader> mDepthShader;
   std::unordered_map<int, uptr<Shader>> mShaders;
-  /// Group of renderables by shaderID.
-  std::unordered_map<int, std::vector<uptr<RenderInterface>>> mRenderGroups;
+  /// Source files and sorted defines -> shader ID, see createShaderVariant().
+  std::unordered_map<std::string, int> mShaderVariants;
+  /// Group of renderables by shaderID. Only owns them, draw order is decided
+  /// by the sorted draw queue.
+  std::map<int, std::vector<uptr<RenderInterface>>> mRenderGroups;
+  std::vector<DrawPacket> mDrawQueue;
+  std::vector<DrawPacket> mSortScratch;
+  /// Scratch space for frustum culling, kept around to avoid reallocating.
+  bool mCullingEnabled = true;
+  std::vector<RenderInterface *> mCullCandidates;
+  SphereBatch mCullBounds;
+  std::vector<uint8_t> mCullVisible;
+  bool mLodEnabled = true;
+  float mLodThreshold = 1.0f;
+  /// BVH over the world-transform space bounds of every bounded renderable,
+  /// items index mSceneItems. Unbounded ones can't go in a tree and are
+  /// always tested directly, as are the few drawn without the world
+  /// transform, against the camera frustum alone.
+  BVH mSceneBVH;
+  bool mSceneDirty = true;
+  std::vector<RenderInterface *> mSceneItems;
+  std::vector<RenderInterface *> mUnboundedItems;
+  std::vector<RenderInterface *> mUntransformedItems;
+  std::vector<uint8_t> mUntransformedVisible;
+  std::vector<uint32_t> mMovedItems;
+  std::vector<uint8_t> mItemMoved;
+  std::vector<uint32_t> mQueryInside, mQueryPartial;
+  mat4 mLastWorldTransform{1.0f};
   //std::vector<sptr<Mesh>> mLights;
   std::vector<uint> mLightFBOs;
   std::vector<uint> mLightDepthCubeMaps;
   const uint mShadowWidth = 2048;
   const uint mShadowHeight = 2048;
+  RenderStats mStats;
+  FrameUniforms mFrameUniforms;
+  GLuint mFrameUBO;
+  uptr<StreamBuffer> mStreamBuffer;
+  GLuint mRenderTarget = 0;
+  uint mShadersBuilding = 0;
+  uptr<FileWatcher> mShaderWatcher;
 };
 } // namespace Engine
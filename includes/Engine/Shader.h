@@ -1,8 +1,14 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "Types.h"
 
@@ -17,11 +23,78 @@ public:
     std::string fsPath;
     std::string gsPath;
     std::function<void(Shader &)> bindCB;
+    /// Prepended to every stage, "NAME" or "NAME=VALUE", see
+    /// Renderer::createShaderVariant().
+    std::vector<std::string> defines = {};
   };
 
+  /// Pre-resolved uniform slot for hot paths. Setting a uniform through a
+  /// handle costs an array index, no string hashing or driver query. Handles
+  /// stay valid across reload().
+  struct UniformHandle {
+    int slot = -1;
+  };
+
+  /// Uniform block filled once per frame by the Renderer (see
+  /// FrameUniforms), bound to this binding point in every program.
+  static constexpr const char *FrameBlockName = "Frame";
+  static constexpr uint FrameBlockBinding = 0;
+
+  /// Stage sources as read from disk, with #includes expanded and the
+  /// defines injected after #version.
+  struct Sources {
+    std::string vertex, fragment, geometry;
+    /// Every file pulled in by an #include, across all stages.
+    std::vector<std::string> includes;
+    /// Per stage, which file each #line source string number refers to.
+    std::string legends[3];
+    /// Set when a file could not be read, an #include is malformed or an
+    /// included file has a #version.
+    std::string error;
+  };
+
+  /// Returns straight away, the program is built in the background, see
+  /// poll(). Until then isReady() is false and the Renderer skips whatever
+  /// uses this shader.
   Shader(Shader::Info info);
+  ~Shader();
+  Shader(Shader const &) = delete;
+  void operator=(Shader const &) = delete;
+  /// Only valid once isReady().
   void use();
-  bool reload();
+  /// Start rebuilding from the files on disk. The current program stays in
+  /// use until the new one has linked, and is kept if it fails to. See
+  /// isBuilding() and getBuildError() for how it went.
+  void reload();
+
+  /// Move a build along: sources are read on a worker thread, then compiled
+  /// and linked without waiting on the driver. With
+  /// KHR_parallel_shader_compile the driver compiles on its own threads and
+  /// results are only collected once GL_COMPLETION_STATUS_KHR says so,
+  /// otherwise one poll later. With \p wait, block until the build is done.
+  /// Returns isReady().
+  bool poll(bool wait = false);
+  /// There is a linked program to draw with.
+  inline bool isReady() const { return mProgramID != 0; }
+  /// A build is in flight, either the first one or a reload.
+  inline bool isBuilding() const { return mBuild != nullptr; }
+  /// Why the last build failed: unreadable sources, or the compile and
+  /// link logs. Empty while a build is in flight and after one succeeds.
+  inline const std::string &getBuildError() const { return mBuildError; }
+
+  /// Time from reload() (or construction) until the program was in use,
+  /// for the last build that succeeded.
+  inline float getLastBuildMs() const { return mLastBuildMs; }
+  /// Files the stages are read from, as given in the Info, followed by the
+  /// files they #include as of the last build that read its sources.
+  std::vector<std::string> getSourcePaths() const;
+  /// What this shader was created from.
+  Info getInfo() const;
+
+  static bool parallelCompileSupported();
+
+  /// Resolve \p name once, ideally at setup time rather than per frame.
+  UniformHandle getUniformHandle(const std::string &name);
 
   // Uniform functions.
   void setBool(const std::string &name, bool value) const;
@@ -32,15 +105,68 @@ public:
   void setVec2(const std::string &name, float x, float y) const;
   void setVec3(const std::string &name, const vec3 &value) const;
   void setVec3(const std::string &name, float x, float y, float z) const;
+
+  // Handle based uniform functions.
+  void setBool(UniformHandle handle, bool value) const;
+  void setInt(UniformHandle handle, int value) const;
+  void setFloat(UniformHandle handle, float value) const;
+  void setMatrix(UniformHandle handle, const mat4 &value) const;
+  void setVec2(UniformHandle handle, const vec2 &value) const;
+  void setVec3(UniformHandle handle, const vec3 &value) const;
+
   inline int id() const { return mID; }
+
+  /// Number of glGetUniformLocation calls made by all shaders. Lookups only
+  /// happen while reflecting a freshly linked program, so this should not
+  /// move between steady-state frames.
+  static uint64_t getNumLocationQueries() { return sLocationQueries; }
+
 private:
-  bool compile();
-  bool checkCompileErrors(unsigned int shader, std::string type);
-  uint mProgramID;
+  enum Stage { Vertex, Fragment, Geometry, NumStages };
+  struct Build {
+    std::future<Sources> sources;
+    /// 0 while the sources are still being read.
+    uint program = 0;
+    uint stages[NumStages] = {};
+    uint64_t key = 0;
+    /// Sources::legends, for compile errors.
+    std::string legends[NumStages];
+    /// When reload() was called, and when compiling started.
+    std::chrono::steady_clock::time_point requested, start;
+  };
+
+  /// Compile the stages and link, without checking how either went.
+  void issueBuild(const Sources &sources);
+  /// Check the build's status, and use the program if it linked.
+  void completeBuild();
+  void cancelBuild();
+  /// Make \p program, linked, the one in use and end the build. \p origin
+  /// says where it came from, for the log.
+  void install(uint program, const char *origin);
+  bool checkCompileErrors(unsigned int shader, std::string type,
+                          const std::string &path);
+  void reflectUniforms();
+  int getLocation(const std::string &name) const;
+  inline int getLocation(UniformHandle handle) const {
+    return handle.slot < 0 ? -1 : mHandleLocations[handle.slot];
+  }
+
+  uint mProgramID = 0;
+  /// Name -> location of every active uniform, filled by reflectUniforms().
+  std::unordered_map<std::string, int> mUniformLocations;
+  /// Handle slots, re-resolved by name whenever the program is relinked.
+  std::vector<std::string> mHandleNames;
+  std::vector<int> mHandleLocations;
+  static uint64_t sLocationQueries;
   std::function<void(Shader &)> mPerBind;
   // We use our own ID since we are not guaranteed monotonically increasing
   // program IDs from 0.
   int mID;
   std::string mVertexPath, mFragmentPath, mGeometryPath;
+  std::vector<std::string> mDefines;
+  std::vector<std::string> mIncludes;
+  std::unique_ptr<Build> mBuild;
+  std::string mBuildError;
+  float mLastBuildMs = 0.0f;
 };
 } // namespace Engine
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Reduce the triangle list \p indices over \p count positions, \p stride
+/// bytes apart, towards \p targetIndices indices. Edges are collapsed
+/// cheapest first by their quadric error (Garland and Heckbert), skipping
+/// collapses that would flip a triangle.
+///
+/// Vertices are only ever merged into one another, so the result indexes
+/// the same vertex buffer and can sit next to the original as a level of
+/// detail. Vertices on open borders, and ones sharing their position with
+/// another vertex (e.g. on UV or normal seams), stay where they are.
+///
+/// \p error is set to the largest distance between the result and the input
+/// surface, estimated from the quadrics, in model units.
+std::vector<uint32_t> simplify(const void *positions, size_t count,
+                               size_t stride,
+                               const std::vector<uint32_t> &indices,
+                               size_t targetIndices, float &error);
+
+} // namespace Engine
@@ -2,7 +2,6 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
-#include <unordered_map>
 #include <vector>
 
 #include "Mesh.h"
@@ -10,27 +9,25 @@
 
 namespace Engine {
 
+/// Icosphere of the given subdivision level. The geometry is a unit sphere
+/// shared by every Sphere of that level, the centre and radius are applied
+/// through the model matrix, so creating one doesn't touch the GPU after the
+/// first.
 class Sphere : public StandardMesh {
 public:
   Sphere(const vec3 &position, float radius, uint8_t iter);
 
   inline float getRadius() const { return mRadius; };
-  inline void setRadius(float radius) {
-    mRadius = radius;
-    computeVertices();
-  };
+  /// Only changes the scale of the model matrix.
+  void setRadius(float radius);
   inline vec3 getPos() const { return mPosition; }
 
+  /// Unit sphere geometry of subdivision \p level, made on first use.
+  static sptr<Storage> unitSphere(int level);
+
 private:
-  void computeVertices();
-  std::tuple<uint32_t, uint32_t, uint32_t>
-  getCCWOrdering(const std::vector<Point> &, uint32_t, uint32_t,
-                 uint32_t) const;
-  size_t getMidpoint(std::vector<Point> &points, uint32_t iA, uint32_t iB);
-
-  /// Since we share midpoints fairly often, cache them using the indices of
-  /// the points on the ends of the line being divided.
-  std::unordered_map<uint64_t, size_t> mMiddlePointCache;
+  /// Put the centre and radius into the model matrix.
+  void place();
 
   float mRadius;
   vec3 mPosition;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <GL/gl3w.h>
+#include <cstddef>
+#include <deque>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Ring buffer for geometry that is rewritten every frame. Allocations are
+/// carved out one after the other, and each frame's range is fenced once it
+/// has been drawn so the CPU only waits when it laps the GPU.
+///
+/// With ARB_buffer_storage the buffer is mapped once, persistently and
+/// coherently, and allocations are plain pointers into it. On bare GL 3.3
+/// each allocation maps its range unsynchronized, and when a frame starts by
+/// wrapping around the storage is orphaned instead of waiting on the GPU.
+///
+/// Usage per frame: allocate() and write, commit(), draw, then fence() once
+/// every draw reading this frame's data has been issued. The Renderer does
+/// the fence for its own buffer at the end of renderFrame().
+class StreamBuffer {
+public:
+  struct Allocation {
+    /// Write-only, valid until commit().
+    void *data = nullptr;
+    /// Byte offset of the allocation in the buffer.
+    size_t offset = 0;
+  };
+
+  struct Stats {
+    /// Waits on a fence that had not signalled yet.
+    uint stalls = 0;
+    /// Storage orphaned instead of waiting (GL 3.3 path only).
+    uint orphans = 0;
+    /// Times the buffer had to grow to fit a frame.
+    uint grows = 0;
+  };
+
+  explicit StreamBuffer(size_t size);
+  ~StreamBuffer();
+  StreamBuffer(StreamBuffer const &) = delete;
+  void operator=(StreamBuffer const &) = delete;
+
+  /// Reserve \p bytes, with the offset rounded up to a multiple of
+  /// \p alignment (vertex stride for base vertex draws). The buffer grows if
+  /// a frame asks for more than it holds, which changes id().
+  Allocation allocate(size_t bytes, size_t alignment = 4);
+  /// Finish writing the outstanding allocation, required before drawing
+  /// from it.
+  void commit();
+  /// Fence everything allocated since the last fence().
+  void fence();
+
+  inline GLuint id() const { return mBuffer; }
+  /// Bumped every time id() changes, so VAOs know to re-point attributes.
+  inline uint generation() const { return mGeneration; }
+  inline size_t size() const { return mSize; }
+  inline bool isPersistent() const { return mPersistent; }
+  inline const Stats &getStats() const { return mStats; }
+
+  /// ARB_buffer_storage is core in 4.4 and often exposed on 3.3 contexts.
+  static bool persistentMappingSupported();
+
+private:
+  struct Fence {
+    size_t begin, end;
+    GLsync sync;
+  };
+
+  void createStorage(size_t size);
+  void destroyStorage();
+  /// Wait until no in-flight frame reads [begin, end).
+  void waitForRange(size_t begin, size_t end);
+  void dropFences();
+
+  GLuint mBuffer = 0;
+  uint mGeneration = 0;
+  size_t mSize = 0;
+  bool mPersistent = false;
+  char *mMapped = nullptr;
+  bool mMappedRange = false;
+
+  size_t mHead = 0;
+  /// Start of the range not yet fenced, and how many bytes it spans.
+  size_t mFrameBegin = 0;
+  size_t mFrameUsed = 0;
+  /// Oldest first, fences signal in submission order.
+  std::deque<Fence> mFences;
+  Stats mStats;
+};
+
+} // namespace Engine
@@ -1,19 +1,99 @@
 #pragma once
 
+#include <cstdlib>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "MappedFile.h"
 #include "Types.h"
 
 namespace Engine {
 
+class TextureLoader;
+
 class Texture {
 public:
+  enum class State { Loading, Resident, Failed };
+
+  /// Decoded pixels, rows bottom to top as GL expects.
+  struct Image {
+    /// Where a mip level of a compressed image lies in pixels.
+    struct Level {
+      size_t offset, size;
+    };
+
+    int width = 0, height = 0, channels = 0;
+    /// GL compressed internal format, or 0 for 8 bits per channel.
+    uint format = 0;
+    /// Compressed images only, the whole mip chain from level 0 down.
+    std::vector<Level> levels;
+    std::unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, free};
+    /// Compressed images are used in place, the file stays mapped and
+    /// pixels is left empty.
+    MappedFile file;
+    /// Set when the file could not be decoded.
+    std::string error;
+
+    inline const unsigned char *data() const {
+      return pixels ? pixels.get() : file.data();
+    }
+
+    /// Bytes of pixels to upload.
+    inline size_t size() const {
+      return format ? levels.back().offset + levels.back().size
+                    : size_t(width) * height * channels;
+    }
+  };
+
+  /// Decodes and uploads \p path before returning. See TextureLoader to
+  /// load without blocking.
   Texture(const std::string &path);
-  void bind();
+  ~Texture();
+  Texture(Texture const &) = delete;
+  void operator=(Texture const &) = delete;
+
+  void bind(uint unit = 0);
+  /// Valid from construction, the texture object is filled in place once it
+  /// has loaded.
+  inline uint id() const { return mTexture; }
+  inline State state() const { return mState; }
+  inline bool isResident() const { return mState == State::Resident; }
+  inline int width() const { return mWidth; }
+  inline int height() const { return mHeight; }
+  inline int channels() const { return mNumChannels; }
+  /// Estimate of the video memory held, mip chain included.
+  inline size_t memoryBytes() const { return mBytes; }
+
+  /// Read and decode \p path, 1 to 4 channels of 8 bits, or block
+  /// compressed for DDS and KTX files (see TextureFormats). Touches no GL
+  /// state, so it is safe to call from any thread.
+  static Image decode(const std::string &path);
+  /// Whether the context can sample \p image, compressed formats depend on
+  /// extensions.
+  static bool isSupported(const Image &image);
 
 private:
-  int mWidth, mHeight, mNumChannels;
-  unsigned char *mData;
-  uint mTexture;
+  friend class TextureLoader;
+
+  /// A 1x1 placeholder, in the Loading state.
+  Texture();
+
+  /// Define the texture from \p image. With \p pixels null the data is read
+  /// from offset 0 of the bound GL_PIXEL_UNPACK_BUFFER instead.
+  void setImage(const Image &image, const unsigned char *pixels);
+  void setImage(int width, int height, int channels, const void *pixels);
+  /// Build the mip chain and mark the texture resident, once the data given
+  /// to setImage() has landed.
+  void finishUpload();
+  void setFailed();
+
+  int mWidth = 1, mHeight = 1, mNumChannels = 4;
+  /// GL compressed internal format, 0 when uncompressed.
+  uint mFormat = 0;
+  /// Video memory of the levels uploaded so far.
+  size_t mBytes = 4;
+  uint mTexture = 0;
+  State mState = State::Loading;
 };
 } // namespace Engine
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "Texture.h"
+#include "Types.h"
+
+namespace Engine {
+
+/// Shares textures between everything that asks for the same file. Misses
+/// go through the TextureLoader, so get() never blocks.
+///
+/// The cache holds a reference to every texture it handed out. Once nothing
+/// else does, the texture lingers in case it is asked for again, and is
+/// only evicted when the estimated video memory of all cached textures goes
+/// over the budget, least recently requested first. Textures still in use
+/// are never evicted, so the budget can be exceeded by what is in use.
+/// Like GLStateCache this is a singleton, the Renderer calls trim() once per
+/// frame.
+class TextureCache {
+public:
+  struct Stats {
+    uint hits = 0;
+    uint misses = 0;
+    uint evictions = 0;
+    /// Estimated video memory of the cached textures, as of the last trim().
+    size_t residentBytes = 0;
+  };
+
+  static TextureCache &getInstance() {
+    static TextureCache instance;
+    return instance;
+  }
+  TextureCache(TextureCache const &) = delete;
+  void operator=(TextureCache const &) = delete;
+
+  /// The texture for \p path, loading it on a miss. Paths are compared
+  /// after resolving them, so different spellings of a file share a
+  /// texture.
+  sptr<Texture> get(const std::string &path);
+  /// Evict unused textures until the cache fits in the budget.
+  void trim();
+  /// Evict every unused texture, whatever the budget.
+  void clear();
+
+  /// Defaults to 512 MB.
+  inline void setBudget(size_t bytes) { mBudget = bytes; }
+  inline size_t getBudget() const { return mBudget; }
+  inline size_t size() const { return mEntries.size(); }
+  inline const Stats &getStats() const { return mStats; }
+
+  void draw(bool *p_open);
+
+private:
+  struct Entry {
+    sptr<Texture> texture;
+    /// Position in mRecent.
+    std::list<std::string>::iterator recent;
+  };
+
+  TextureCache() = default;
+
+  /// Only the cache holds it.
+  static inline bool isUnused(const Entry &entry) {
+    return entry.texture.use_count() == 1;
+  }
+  void evict(const std::string &key);
+
+  /// Resolved path -> entry.
+  std::unordered_map<std::string, Entry> mEntries;
+  /// Keys, most recently requested first.
+  std::list<std::string> mRecent;
+  size_t mBudget = size_t(512) << 20;
+  Stats mStats;
+};
+
+} // namespace Engine
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "Texture.h"
+#include "Types.h"
+
+namespace Engine {
+
+/// Block compressed textures: reading DDS and KTX (1.1) containers with
+/// their mip chains, and the offline side, encoding and writing DDS, used
+/// by the TexConvert tool.
+///
+/// Block rows are uploaded as stored, so files have to hold the bottom row
+/// of the image first, which is what TexConvert writes. Nothing here
+/// touches GL state.
+namespace TextureFormats {
+
+enum class Block { BC1, BC3, BC5, BC7 };
+
+/// Whether \p path names a container read by readCompressed() rather than
+/// an image for stb_image, going by its extension.
+bool isCompressed(const std::string &path);
+/// Read a DDS or KTX file holding one of the Block formats. On failure the
+/// image has no pixels and its error says why.
+Texture::Image readCompressed(const std::string &path);
+
+/// Encode \p image, 8 bit pixels of 1 to 4 channels, into \p block with a
+/// full mip chain. BC5 keeps the first two channels, e.g. for normal maps.
+Texture::Image compress(const Texture::Image &image, Block block);
+bool writeDDS(const std::string &path, const Texture::Image &image);
+
+/// GL internal format of \p block.
+uint glFormat(Block block);
+/// Bytes per 4x4 block of a GL compressed format, 0 if not a Block format.
+uint blockBytes(uint format);
+
+} // namespace TextureFormats
+} // namespace Engine
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <GL/gl3w.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Texture.h"
+#include "Types.h"
+
+namespace Engine {
+
+/// Loads textures without stalling the frame loop. Files are decoded on a
+/// small pool of worker threads, and the pixels are handed to GL through
+/// pixel buffer objects on the render thread, a few megabytes per frame.
+/// Mipmaps are built once the fence behind an upload has signalled, in a
+/// later frame, and only then is the texture resident.
+///
+/// load() returns straight away with a texture holding a 1x1 placeholder,
+/// so it can be drawn with before it has loaded. Its id() never changes.
+/// Like GLStateCache this is a singleton, the Renderer calls update() once
+/// per frame.
+class TextureLoader {
+public:
+  struct Stats {
+    /// Textures made resident and files that failed to decode.
+    uint loaded = 0;
+    uint failed = 0;
+    /// Time the workers spent decoding, summed over all of them.
+    float decodeMs = 0.0f;
+    /// Time the render thread spent copying into PBOs and issuing uploads.
+    float uploadMs = 0.0f;
+    size_t uploadedBytes = 0;
+  };
+
+  static TextureLoader &getInstance() {
+    static TextureLoader instance;
+    return instance;
+  }
+  TextureLoader(TextureLoader const &) = delete;
+  void operator=(TextureLoader const &) = delete;
+
+  /// Queue \p path for decoding. Dropping the texture before it is resident
+  /// cancels whatever is left of the load.
+  sptr<Texture> load(const std::string &path);
+  /// Upload what has been decoded, within the per frame budget, and finish
+  /// uploads the GPU is done with. Render thread only.
+  void update();
+  /// Block until every texture queued so far is resident or failed.
+  void finish();
+  /// Stop the workers and release GL objects, before the context goes.
+  void shutdown();
+
+  /// Bytes copied into PBOs per update(). A texture larger than the budget
+  /// still goes through, on its own.
+  inline void setUploadBudget(size_t bytes) { mUploadBudget = bytes; }
+  /// Textures queued that are not yet resident or failed.
+  inline uint getNumPending() const { return mPending; }
+  Stats getStats();
+
+private:
+  struct Job {
+    std::weak_ptr<Texture> texture;
+    std::string path;
+  };
+  struct Decoded {
+    std::weak_ptr<Texture> texture;
+    std::string path;
+    Texture::Image image;
+  };
+  struct Upload {
+    std::weak_ptr<Texture> texture;
+    GLuint pbo;
+    GLsync sync;
+  };
+
+  TextureLoader() = default;
+  ~TextureLoader();
+
+  void startWorkers();
+  void workerLoop();
+  /// Start uploads for decoded images, up to \p budget bytes.
+  void startUploads(size_t budget);
+  /// Finish uploads whose fence has signalled, or all of them with \p wait.
+  void finishUploads(bool wait);
+  GLuint acquirePBO();
+
+  std::vector<std::thread> mWorkers;
+  /// Guards everything shared with the workers: the job queue, the decoded
+  /// queue, the stopping flag and the decode time.
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::deque<Job> mJobs;
+  std::deque<Decoded> mDecoded;
+  bool mStopping = false;
+
+  /// Render thread only from here on.
+  std::deque<Upload> mUploads;
+  std::vector<GLuint> mFreePBOs;
+  size_t mUploadBudget = 8 << 20;
+  uint mPending = 0;
+  Stats mStats;
+};
+
+} // namespace Engine
@@ -16,8 +16,11 @@ public:
   void init(GLFWwindow *window, const std::string &glsl_version);
   void shutdown();
   void drawFrame();
+  /// Widgets can be toggled from the View menu, \p visible is whether they
+  /// start out shown.
   void registerWidget(std::string name,
-                      std::function<void(bool *)> widgetRender);
+                      std::function<void(bool *)> widgetRender,
+                      bool visible = true);
 
 private:
   std::vector<std::function<void(bool *)>> mWidgets;
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+
+#include <GL/gl3w.h>
+
+#include "Types.h"
+
+namespace Engine {
+
+/// Vertex attribute types narrower than float vectors. Each is both the
+/// storage in a vertex struct and, in Mesh's attribute list, how GL reads
+/// it.
+
+/// Integers read as floats in [-1, 1] when signed, [0, 1] when not.
+template <typename T, int N> struct Normalized {
+  T v[N];
+};
+/// Integers read as integers, for int, ivec and uvec shader inputs.
+template <typename T, int N> struct Integer {
+  T v[N];
+};
+/// IEEE half floats.
+template <int N> struct Half {
+  uint16_t v[N];
+};
+/// Signed normalized x, y, z in 10 bits each and w in 2, low bits first
+/// (GL_INT_2_10_10_10_REV). A unit normal in 4 bytes.
+struct Packed1010102 {
+  uint32_t bits;
+};
+
+/// How GL reads an attribute of type T: component count and type, whether
+/// integers are normalized, and whether the shader sees them as integers.
+template <typename T> struct AttributeFormat {
+  static constexpr bool supported = false;
+};
+
+template <typename T> constexpr GLenum glComponentType();
+template <> constexpr GLenum glComponentType<int8_t>() { return GL_BYTE; }
+template <> constexpr GLenum glComponentType<uint8_t>() {
+  return GL_UNSIGNED_BYTE;
+}
+template <> constexpr GLenum glComponentType<int16_t>() { return GL_SHORT; }
+template <> constexpr GLenum glComponentType<uint16_t>() {
+  return GL_UNSIGNED_SHORT;
+}
+template <> constexpr GLenum glComponentType<int32_t>() { return GL_INT; }
+template <> constexpr GLenum glComponentType<uint32_t>() {
+  return GL_UNSIGNED_INT;
+}
+
+template <GLint Size, GLenum Type, bool Normalize, bool Int>
+struct AttributeFormatOf {
+  static constexpr bool supported = true;
+  static constexpr GLint size = Size;
+  static constexpr GLenum type = Type;
+  static constexpr bool normalized = Normalize;
+  static constexpr bool integer = Int;
+};
+
+template <>
+struct AttributeFormat<float>
+    : AttributeFormatOf<1, GL_FLOAT, false, false> {};
+template <>
+struct AttributeFormat<vec2>
+    : AttributeFormatOf<2, GL_FLOAT, false, false> {};
+template <>
+struct AttributeFormat<vec3>
+    : AttributeFormatOf<3, GL_FLOAT, false, false> {};
+template <>
+struct AttributeFormat<vec4>
+    : AttributeFormatOf<4, GL_FLOAT, false, false> {};
+template <>
+struct AttributeFormat<int> : AttributeFormatOf<1, GL_INT, false, true> {};
+template <>
+struct AttributeFormat<uint>
+    : AttributeFormatOf<1, GL_UNSIGNED_INT, false, true> {};
+template <typename T, int N>
+struct AttributeFormat<Normalized<T, N>>
+    : AttributeFormatOf<N, glComponentType<T>(), true, false> {};
+template <typename T, int N>
+struct AttributeFormat<Integer<T, N>>
+    : AttributeFormatOf<N, glComponentType<T>(), false, true> {};
+template <int N>
+struct AttributeFormat<Half<N>>
+    : AttributeFormatOf<N, GL_HALF_FLOAT, false, false> {};
+template <>
+struct AttributeFormat<Packed1010102>
+    : AttributeFormatOf<4, GL_INT_2_10_10_10_REV, true, false> {};
+
+/// Round to the nearest half float, out of range values become infinity.
+uint16_t toHalf(float value);
+float fromHalf(uint16_t value);
+
+/// Round \p value, clamped to [-1, 1], to the nearest signed normalized
+/// integer of T, i.e. value * 127 for int8_t.
+template <typename T> T toSNorm(float value);
+template <typename T> float fromSNorm(T value);
+
+Packed1010102 packSNorm1010102(const vec4 &value);
+vec4 unpackSNorm1010102(Packed1010102 packed);
+
+/// Octahedral mapping of a unit vector to [-1, 1]^2: the octahedron
+/// |x| + |y| + |z| = 1 unfolded onto a square. Two normalized 16 bit
+/// components keep normals within 0.05 degrees, two 8 bit ones within 1.
+/// Decode with octDecode() in shaders/octahedral.glsl.
+vec2 octEncode(const vec3 &normal);
+vec3 octDecode(const vec2 &encoded);
+
+} // namespace Engine
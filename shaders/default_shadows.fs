@@ -8,22 +8,33 @@ in VS_OUT {
     vec3 LightPos;
 } fs_in;
 
-struct Material {
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-  float sheen;
-};
-
-uniform Material mat;
+#include "material.glsl"
 uniform sampler2D diffuseTexture;
 uniform samplerCube depthMap;
 
-uniform vec3 viewPos;
+#include "frame.glsl"
+#include "lighting.glsl"
+
 uniform float far_plane;
 
+// Built as an uber-shader the features are switched at draw time,
+// otherwise per variant (see Renderer::createShaderVariant) so that the
+// compiler drops the branches.
+#ifdef UBER_SHADER
 uniform bool hasTexture;
 uniform bool shadows;
+#else
+#ifdef HAS_TEXTURE
+const bool hasTexture = true;
+#else
+const bool hasTexture = false;
+#endif
+#ifdef SHADOWS
+const bool shadows = true;
+#else
+const bool shadows = false;
+#endif
+#endif
 
 float isInShadow(vec3 fragPos)
 {
@@ -49,16 +60,12 @@ void main()
 
     // diffuse
     vec3 lightDir = normalize(fs_in.LightPos - fs_in.FragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = diffuseTerm(normal, lightDir) * lightColor;
 
     // specular
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0;
-    vec3 halfwayDir = normalize(lightDir + viewDir);  
-    spec = pow(max(dot(normal, halfwayDir), 0.0), (hasTexture ? 64.0:mat.sheen));
-    vec3 specular = spec * lightColor;    
+    vec3 viewDir = normalize(cameraPos - fs_in.FragPos);
+    float sheen = hasTexture ? 64.0 : mat.sheen;
+    vec3 specular = blinnPhongTerm(normal, lightDir, viewDir, sheen) * lightColor;
 
     vec3 lighting = (ambient + (1.0 - isInShadow(fs_in.FragPos)) * (diffuse + specular)) * color;    
     
@@ -10,8 +10,8 @@ out VS_OUT {
     vec3 LightPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "frame.glsl"
+
 uniform mat4 model;
 uniform mat4 lightModel;
 uniform vec3 lightPos;
@@ -22,5 +22,5 @@ void main()
     vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
     vs_out.TexCoords = aTexCoords;
     vs_out.LightPos = vec3(lightModel * vec4(lightPos, 1.0));
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProj * model * vec4(aPos, 1.0);
 }  
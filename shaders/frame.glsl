@@ -0,0 +1,10 @@
+// Per frame uniforms, filled once per frame by the Renderer. Must match
+// Engine::FrameUniforms.
+layout(std140) uniform Frame {
+  mat4 view;
+  mat4 proj;
+  mat4 viewProj;
+  vec3 cameraPos;
+  float time;
+  vec2 resolution;
+};
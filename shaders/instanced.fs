@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Pos;
+in vec3 Normal;
+in vec4 Colour;
+
+void main()
+{
+    vec3 lightDir = normalize(vec3(1, 1, 1));
+    float intensity = max(dot(normalize(Normal), lightDir), 0.2);
+    FragColor = vec4(intensity * Colour.rgb, Colour.a);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+// Per instance attributes, see Engine::InstanceData.
+layout(location = 3) in mat4 instanceModel;
+layout(location = 7) in vec4 instanceColour;
+layout(location = 8) in int instanceMaterial;
+
+#include "frame.glsl"
+
+uniform mat4 world;
+
+out vec3 Pos;
+out vec3 Normal;
+out vec4 Colour;
+
+void main(){
+  mat4 model = world * instanceModel;
+  gl_Position = viewProj * model * vec4(pos, 1.0);
+  Normal = mat3(model) * normal;
+  Pos = vec3(model * vec4(pos, 1.0));
+  Colour = instanceColour;
+}
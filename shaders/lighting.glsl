@@ -0,0 +1,30 @@
+// Lighting terms shared by the lit fragment shaders. Directions point away
+// from the surface and are normalised, sheen is the specular exponent.
+
+float diffuseTerm(vec3 normal, vec3 lightDir) {
+  return max(dot(normal, lightDir), 0.0);
+}
+
+// Phong: the view direction against the reflected light.
+float phongTerm(vec3 normal, vec3 lightDir, vec3 viewDir, float sheen) {
+  vec3 reflectDir = reflect(-lightDir, normal);
+  return pow(max(dot(viewDir, reflectDir), 0.0), sheen);
+}
+
+// Blinn-Phong: the normal against the half vector.
+float blinnPhongTerm(vec3 normal, vec3 lightDir, vec3 viewDir, float sheen) {
+  vec3 halfwayDir = normalize(lightDir + viewDir);
+  return pow(max(dot(normal, halfwayDir), 0.0), sheen);
+}
+
+// One point light, ambient and diffuse tinted by its colour and a white
+// highlight on top.
+vec3 shadePhong(vec3 ambient, vec3 diffuse, float sheen, vec3 normal,
+                vec3 fragPos, vec3 lightPos, vec3 viewPos, vec3 lightColour) {
+  vec3 n = normalize(normal);
+  vec3 lightDir = normalize(lightPos - fragPos);
+  vec3 viewDir = normalize(viewPos - fragPos);
+  float diff = diffuseTerm(n, lightDir);
+  float spec = phongTerm(n, lightDir, viewDir, sheen);
+  return (ambient + diff * diffuse) * lightColour + spec;
+}
@@ -0,0 +1,9 @@
+// Mirrors Engine::Material.
+struct Material {
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+  float sheen;
+};
+
+uniform Material mat;
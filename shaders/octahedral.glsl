@@ -0,0 +1,8 @@
+// Mirrors Engine::octDecode(), for normals stored as two normalized
+// components.
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float fold = max(-n.z, 0.0);
+  n.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(n.xy, vec2(0.0)));
+  return normalize(n);
+}
@@ -4,14 +4,14 @@ layout(location = 0) in vec3 pos;
 layout(location = 1) in float sign;
 layout(location = 2) in vec3 prev;
 
+#include "frame.glsl"
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
 uniform float thickness;
-uniform float aspect;
 
 void main(){
-  mat4 mvp = proj * view * model;
+  mat4 mvp = viewProj * model;
+  float aspect = resolution.x / resolution.y;
   vec4 prevProj = mvp * vec4(prev, 1.0);
   vec4 curProj = mvp * vec4(pos, 1.0);
   //vec4 nextProj = mvp * vec4(next, 1.0);